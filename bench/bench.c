@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "bench.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define LIST_BENCH_SUITES(X) \
+    X(alloc) \
+    X(hash) \
+    X(hashtable) \
+    X(rope)
+
+#define DECLARE_SUITE(name) void BENCH_SUITE_NAME(name)(void);
+LIST_BENCH_SUITES(DECLARE_SUITE)
+#undef DECLARE_SUITE
+
+static u64 now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * UINT64_C(1000000000) + (u64)ts.tv_nsec;
+}
+
+static u64 clock_start;
+
+void bench_restart_clock(void) {
+    clock_start = now_ns();
+}
+
+u64 bench_scale(void) {
+    const char *s = getenv("BENCH_SCALE");
+    u64 scale = s ? strtoull(s, NULL, 10) : 1;
+    return scale ? scale : 1;
+}
+
+void bench_print_header(const char *suite) {
+    printf("\n  ===== %s =====\n\n", suite);
+    printf("    %-32s %12s %12s %10s %10s\n", "benchmark", "ns/op", "peak RSS kB", "minflt", "majflt");
+}
+
+bool bench_run(const char *suite, const char *name, bench_fn fn, void *data, bench_result *out) {
+    int fds[2];
+    bench_result res;
+    memset(&res, 0, sizeof(res));
+
+    fflush(stdout);
+    if (pipe(fds) != 0)
+        return false;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        struct rusage before, after;
+        close(fds[0]);
+        getrusage(RUSAGE_SELF, &before);
+        clock_start = now_ns();
+        res.ops = fn(data);
+        res.ns = now_ns() - clock_start;
+        getrusage(RUSAGE_SELF, &after);
+        res.maxrss_kb = after.ru_maxrss;
+        res.minflt = after.ru_minflt - before.ru_minflt;
+        res.majflt = after.ru_majflt - before.ru_majflt;
+        ssize_t YU_UNUSED(n) = write(fds[1], &res, sizeof(res));
+        _exit(0);
+    }
+
+    close(fds[1]);
+    bool ok = read(fds[0], &res, sizeof(res)) == (ssize_t)sizeof(res);
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    if (ok && res.ops > 0) {
+        printf("    %-32s %12.1f %12ld %10ld %10ld\n", name,
+               (double)res.ns / (double)res.ops, res.maxrss_kb, res.minflt, res.majflt);
+    } else {
+        printf("    %-32s %12s\n", name, "FAILED");
+        fprintf(stderr, "bench: %s/%s did not complete\n", suite, name);
+        ok = false;
+    }
+    if (out)
+        *out = res;
+    return ok;
+}
+
+static bool selected(const char *suite, int argc, char **argv) {
+    if (argc < 2)
+        return true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], suite) == 0)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+#define RUN_SUITE(name) \
+    if (selected(#name, argc, argv)) { \
+        bench_print_header(#name); \
+        BENCH_SUITE_NAME(name)(); \
+    }
+    LIST_BENCH_SUITES(RUN_SUITE)
+#undef RUN_SUITE
+    return 0;
+}
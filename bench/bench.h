@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#pragma once
+
+// clock_gettime, fork & co. aren't visible in strict C99/C11 mode
+#define _POSIX_C_SOURCE 200809L
+
+#include "yu_common.h"
+
+/**
+ * A tiny microbenchmark harness.
+ *
+ * Benchmarks are plain functions that run a workload and return how many
+ * operations they performed. bench_run() executes each one in a forked child
+ * so that peak RSS and page fault counts (taken from getrusage) belong to that
+ * benchmark alone. The parent prints a row with ns/op, peak RSS and minor/major
+ * page faults. Peak RSS includes the (small, constant) footprint of the harness.
+ *
+ * A bench ‘suite’ is a function `void bench_<name>(void)` that calls
+ * bench_run() for every workload it knows about. Suites are listed in
+ * LIST_BENCH_SUITES in bench/bench.c. Passing suite names on the command line
+ * runs only those suites.
+ */
+
+typedef u64 (*bench_fn)(void *data);
+
+typedef struct {
+    u64 ops;
+    u64 ns;
+    long maxrss_kb;
+    long minflt;
+    long majflt;
+} bench_result;
+
+#define BENCH_SUITE_NAME(name) YU_NAME(bench, name)
+
+// Scale factor for workload sizes. Defaults to 1; set with BENCH_SCALE in the
+// environment to make runs longer (or shorter) without recompiling.
+u64 bench_scale(void);
+
+// Returns false if the child failed to report (crashed, aborted, …).
+bool bench_run(const char *suite, const char *name, bench_fn fn, void *data, bench_result *out);
+
+void bench_print_header(const char *suite);
+
+// Called from inside a benchmark to leave its setup out of the timing.
+// Page faults and peak RSS still include the setup.
+void bench_restart_clock(void);
+
+// Cheap deterministic PRNG so workloads are identical across backends
+// without pulling SFMT's state into the cache.
+YU_INLINE
+u64 bench_rand(u64 *state) {
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+// Keep the compiler from discarding otherwise-unused results.
+#define BENCH_CLOBBER(x) __asm__ __volatile__("" : : "g"(x) : "memory")
@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "bench.h"
+
+#include "internal_alloc.h"
+#include "sys_alloc.h"
+#include "ned_alloc.h"
+#include "tl_alloc.h"
+
+/**
+ * Every workload runs unchanged against every backend in LIST_ALLOC_BACKENDS.
+ * Adding a backend means writing an init/fini pair and adding one line there.
+ * Workloads that need an optional part of the allocator API (e.g. reserve)
+ * are reported as n/a for backends that don't provide it.
+ */
+
+#define LIST_ALLOC_BACKENDS(X) \
+    X(sys) \
+    X(ned) \
+    X(internal) \
+    X(tl)
+
+#define LIST_ALLOC_WORKLOADS(X) \
+    X(churn, "small-object churn") \
+    X(realloc_grow, "realloc growth") \
+    X(aligned, "aligned allocation") \
+    X(pages, "reserve/commit/decommit") \
+    X(ctx_free, "whole-context free")
+
+union backend_storage {
+    sys_allocator sys;
+    ned_allocator ned;
+    internal_allocator internal;
+    struct {
+        sys_allocator backing;
+        tl_heap heap;
+        tl_allocator ctx;
+    } tl;
+};
+
+struct backend {
+    const char *name;
+    yu_allocator *(*init)(union backend_storage *s);
+    void (*fini)(union backend_storage *s);
+};
+
+static yu_allocator *init_sys(union backend_storage *s) {
+    sys_alloc_ctx_init(&s->sys);
+    return (yu_allocator *)&s->sys;
+}
+static void fini_sys(union backend_storage *s) {
+    yu_alloc_ctx_free(&s->sys);
+}
+
+static yu_allocator *init_ned(union backend_storage *s) {
+    ned_alloc_ctx_init(&s->ned, 0);
+    return (yu_allocator *)&s->ned;
+}
+static void fini_ned(union backend_storage *s) {
+    yu_alloc_ctx_free(&s->ned);
+}
+
+static yu_allocator *init_internal(union backend_storage *s) {
+    internal_alloc_ctx_init(&s->internal);
+    return (yu_allocator *)&s->internal;
+}
+static void fini_internal(union backend_storage *s) {
+    yu_alloc_ctx_free(&s->internal);
+}
+
+static yu_allocator *init_tl(union backend_storage *s) {
+    sys_alloc_ctx_init(&s->tl.backing);
+    tl_heap_init(&s->tl.heap, (yu_allocator *)&s->tl.backing);
+    tl_alloc_ctx_init(&s->tl.ctx, &s->tl.heap);
+    return (yu_allocator *)&s->tl.ctx;
+}
+static void fini_tl(union backend_storage *s) {
+    yu_alloc_ctx_free(&s->tl.ctx);
+    yu_alloc_ctx_free(&s->tl.backing);
+}
+
+#define BACKEND_ENTRY(name) { #name, YU_NAME(init, name), YU_NAME(fini, name) },
+static const struct backend backends[] = {
+    LIST_ALLOC_BACKENDS(BACKEND_ENTRY)
+};
+#undef BACKEND_ENTRY
+
+static union backend_storage storage;
+
+/* Workloads */
+
+#define CHURN_SLOTS 4096
+
+// Random frees and allocations of 8–256 bytes over a fixed-size working set.
+static u64 work_churn(void *data) {
+    const struct backend *b = data;
+    yu_allocator *ctx = b->init(&storage);
+    static void *slots[CHURN_SLOTS];
+    u64 rng = 88172645463325252ull, ops = UINT64_C(2000000) * bench_scale();
+
+    memset(slots, 0, sizeof(slots));
+    for (u64 i = 0; i < ops; i++) {
+        u64 r = bench_rand(&rng);
+        u32 slot = r % CHURN_SLOTS;
+        if (slots[slot])
+            yu_free(ctx, slots[slot]);
+        slots[slot] = yu_xalloc(ctx, 1, 8 + (r >> 32) % 249);
+        *(u8 *)slots[slot] = (u8)i;
+    }
+    for (u32 i = 0; i < CHURN_SLOTS; i++) {
+        if (slots[i])
+            yu_free(ctx, slots[i]);
+    }
+    b->fini(&storage);
+    return ops;
+}
+
+#define GROW_BUFS 256
+#define GROW_MAX (256*1024)
+
+// Interleaved buffers growing by 1.5× up to GROW_MAX, touching the new tail
+// each time (as yu_buf and the string builders do).
+static u64 work_realloc_grow(void *data) {
+    const struct backend *b = data;
+    yu_allocator *ctx = b->init(&storage);
+    static u8 *bufs[GROW_BUFS];
+    static size_t sizes[GROW_BUFS];
+    u64 ops = 0, rounds = bench_scale();
+
+    for (u64 round = 0; round < rounds; round++) {
+        for (u32 i = 0; i < GROW_BUFS; i++) {
+            sizes[i] = 16;
+            bufs[i] = yu_xalloc(ctx, 1, sizes[i]);
+        }
+        for (bool grew = true; grew; ) {
+            grew = false;
+            for (u32 i = 0; i < GROW_BUFS; i++) {
+                if (sizes[i] >= GROW_MAX)
+                    continue;
+                size_t next = sizes[i] + sizes[i] / 2;
+                bufs[i] = yu_xrealloc(ctx, bufs[i], 1, next);
+                bufs[i][next - 1] = (u8)next;
+                sizes[i] = next;
+                grew = true;
+                ops++;
+            }
+        }
+        for (u32 i = 0; i < GROW_BUFS; i++)
+            yu_free(ctx, bufs[i]);
+    }
+    b->fini(&storage);
+    return ops;
+}
+
+#define ALIGNED_SLOTS 1024
+
+// Like churn, but each request asks for an alignment between 16 and 4096.
+static u64 work_aligned(void *data) {
+    const struct backend *b = data;
+    yu_allocator *ctx = b->init(&storage);
+    static void *slots[ALIGNED_SLOTS];
+    u64 rng = 0x9e3779b97f4a7c15ull, ops = UINT64_C(500000) * bench_scale();
+
+    memset(slots, 0, sizeof(slots));
+    for (u64 i = 0; i < ops; i++) {
+        u64 r = bench_rand(&rng);
+        u32 slot = r % ALIGNED_SLOTS;
+        size_t align = (size_t)16 << ((r >> 16) % 9);
+        if (slots[slot])
+            yu_free(ctx, slots[slot]);
+        if (yu_alloc(ctx, &slots[slot], 1, 64 + (r >> 32) % 961, align) != YU_OK)
+            abort();
+        assert(((uintptr_t)slots[slot] & (align - 1)) == 0);
+    }
+    for (u32 i = 0; i < ALIGNED_SLOTS; i++) {
+        if (slots[i])
+            yu_free(ctx, slots[i]);
+    }
+    b->fini(&storage);
+    return ops;
+}
+
+#define PAGES_RESERVE (4*1024*1024)
+#define PAGES_CHUNK (64*1024)
+
+// Reserve an address range, commit and touch it chunk by chunk, then
+// decommit and release it. Each commit or decommit counts as one op.
+static u64 work_pages(void *data) {
+    const struct backend *b = data;
+    yu_allocator *ctx = b->init(&storage);
+    size_t pgsz = yu_virtual_pagesize(0);
+    u64 ops = 0, rounds = 50 * bench_scale();
+
+    for (u64 round = 0; round < rounds; round++) {
+        u8 *base;
+        if (yu_reserve(ctx, (void **)&base, PAGES_RESERVE, 1) != YU_OK)
+            abort();
+        for (size_t off = 0; off < PAGES_RESERVE; off += PAGES_CHUNK) {
+            if (yu_commit(ctx, base + off, PAGES_CHUNK, 1) != YU_OK)
+                abort();
+            for (size_t p = 0; p < PAGES_CHUNK; p += pgsz)
+                base[off + p] = 1;
+            ops++;
+        }
+        for (size_t off = 0; off < PAGES_RESERVE; off += PAGES_CHUNK) {
+            yu_decommit(ctx, base + off, PAGES_CHUNK, 1);
+            ops++;
+        }
+        yu_release(ctx, base);
+    }
+    b->fini(&storage);
+    return ops;
+}
+
+#define CTX_ALLOCS 10000
+
+// Create a context, fill it with small objects, and throw the whole thing
+// away without freeing anything individually.
+static u64 work_ctx_free(void *data) {
+    const struct backend *b = data;
+    u64 rng = 0x2545f4914f6cdd1dull, rounds = 100 * bench_scale();
+
+    for (u64 round = 0; round < rounds; round++) {
+        yu_allocator *ctx = b->init(&storage);
+        for (u32 i = 0; i < CTX_ALLOCS; i++)
+            BENCH_CLOBBER(yu_xalloc(ctx, 1, 16 + bench_rand(&rng) % 113));
+        b->fini(&storage);
+    }
+    return rounds * CTX_ALLOCS;
+}
+
+/* Which workloads a backend can run */
+
+static bool supports_churn(yu_allocator * YU_UNUSED(a)) { return true; }
+static bool supports_realloc_grow(yu_allocator * YU_UNUSED(a)) { return true; }
+static bool supports_aligned(yu_allocator * YU_UNUSED(a)) { return true; }
+
+static bool supports_pages(yu_allocator *a) {
+    return a->reserve && a->commit && a->decommit && a->release;
+}
+
+// internal_alloc's free_ctx is a no-op, so every round would just leak.
+static bool supports_ctx_free(yu_allocator *a) {
+    return a->free_ctx != (yu_ctx_free_fn)internal_alloc_ctx_free;
+}
+
+void BENCH_SUITE_NAME(alloc)(void) {
+    char label[64];
+    for (u32 i = 0; i < elemcount(backends); i++) {
+        const struct backend *b = &backends[i];
+        // Initialize once in the parent just to look at the function table
+        yu_allocator *probe = b->init(&storage);
+
+#define RUN_WORKLOAD(wl, desc) \
+        snprintf(label, sizeof(label), "%s: %s", b->name, desc); \
+        if (YU_NAME(supports, wl)(probe)) \
+            bench_run("alloc", label, YU_NAME(work, wl), (void *)b, NULL); \
+        else \
+            printf("    %-32s %12s\n", label, "n/a");
+
+        LIST_ALLOC_WORKLOADS(RUN_WORKLOAD)
+#undef RUN_WORKLOAD
+
+        b->fini(&storage);
+    }
+}
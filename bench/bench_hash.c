@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "bench.h"
+
+/**
+ * Throughput of the buffer hashes every yu_buf_freeze pays for, on the
+ * dictionary in test/words.txt (short keys, like most interned strings) and on
+ * large buffers. yu_fnv1a is run both as dispatched (possibly AVX2) and
+ * portable, next to the byte-at-a-time FNV-1a it replaced.
+ */
+
+#define LIST_HASH_FUNCS(X) \
+    X(fnv1a, "fnv1a") \
+    X(fnv1a_portable, "fnv1a (portable)") \
+    X(fnv1a_bytewise, "fnv1a (byte at a time)") \
+    X(murmur2, "murmur2")
+
+#define WORDS_PATH "test/words.txt"
+#define WORDS_ROUNDS 20
+#define LARGE_SIZE (64*1024)
+#define LARGE_ROUNDS 5000
+
+static u64 hash_fnv1a(const u8 *bytes, u64 len) {
+    return yu_fnv1a(bytes, len);
+}
+
+static u64 hash_fnv1a_portable(const u8 *bytes, u64 len) {
+    return yu__fnv1a_portable(bytes, len);
+}
+
+static u64 hash_fnv1a_bytewise(const u8 *bytes, u64 len) {
+    u64 hash = 0xcbf29ce484222325ull;
+    for (u64 i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static u64 hash_murmur2(const u8 *bytes, u64 len) {
+    return yu_murmur2(bytes, len);
+}
+
+typedef u64 (*hash_fn)(const u8 *bytes, u64 len);
+
+// All words back to back, with offsets[i]..offsets[i+1] the i-th (newline
+// included, which doesn't matter for timing)
+struct words {
+    u8 *bytes;
+    u32 *offsets;
+    u32 count;
+};
+
+static bool load_words(struct words *w) {
+    FILE *f = fopen(WORDS_PATH, "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    w->bytes = malloc(size);
+    w->offsets = malloc((size + 1) * sizeof(u32));
+    bool ok = fread(w->bytes, 1, size, f) == (size_t)size;
+    fclose(f);
+
+    w->count = 0;
+    w->offsets[0] = 0;
+    for (long i = 0; ok && i < size; i++) {
+        if (w->bytes[i] == '\n')
+            w->offsets[++w->count] = i + 1;
+    }
+    return ok;
+}
+
+static u64 work_words(hash_fn hash) {
+    struct words w;
+    if (!load_words(&w))
+        return 0;
+    u64 rounds = WORDS_ROUNDS * bench_scale(), sum = 0;
+    bench_restart_clock();
+    for (u64 round = 0; round < rounds; round++) {
+        for (u32 i = 0; i < w.count; i++)
+            sum += hash(w.bytes + w.offsets[i], w.offsets[i + 1] - w.offsets[i] - 1);
+    }
+    BENCH_CLOBBER(sum);
+    free(w.bytes);
+    free(w.offsets);
+    return rounds * w.count;
+}
+
+static u64 work_large(hash_fn hash) {
+    u8 *buf = malloc(LARGE_SIZE);
+    u64 rng = 1, rounds = LARGE_ROUNDS * bench_scale(), sum = 0;
+    for (u32 i = 0; i < LARGE_SIZE; i += 8) {
+        u64 r = bench_rand(&rng);
+        memcpy(buf + i, &r, 8);
+    }
+    bench_restart_clock();
+    for (u64 round = 0; round < rounds; round++) {
+        // Keep the compiler from hoisting the hash out of the loop
+        BENCH_CLOBBER(buf);
+        sum += hash(buf, LARGE_SIZE);
+    }
+    BENCH_CLOBBER(sum);
+    free(buf);
+    return rounds;
+}
+
+#define DEFINE_WORKLOAD(fn, fdesc) \
+    static u64 YU_NAME(words, fn)(void * YU_UNUSED(data)) { return work_words(YU_NAME(hash, fn)); } \
+    static u64 YU_NAME(large, fn)(void * YU_UNUSED(data)) { return work_large(YU_NAME(hash, fn)); }
+
+LIST_HASH_FUNCS(DEFINE_WORKLOAD)
+
+void BENCH_SUITE_NAME(hash)(void) {
+    char label[64];
+#define RUN_WORKLOAD(fn, fdesc, wl, wdesc) \
+    snprintf(label, sizeof(label), "%s: %s", fdesc, wdesc); \
+    bench_run("hash", label, YU_NAME(wl, fn), NULL, NULL);
+#define RUN_WORDS(fn, fdesc) RUN_WORKLOAD(fn, fdesc, words, "words.txt")
+#define RUN_LARGE(fn, fdesc) RUN_WORKLOAD(fn, fdesc, large, "64 KiB buffers")
+
+    LIST_HASH_FUNCS(RUN_WORDS)
+    LIST_HASH_FUNCS(RUN_LARGE)
+
+#undef RUN_LARGE
+#undef RUN_WORDS
+#undef RUN_WORKLOAD
+}
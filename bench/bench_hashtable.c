@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "bench.h"
+
+#include "internal_alloc.h"
+
+/**
+ * The cuckoo YU_HASHTABLE against the Swiss-table YU_FLATTABLE, instantiated
+ * with identical key/value types and hash functions and run through the same
+ * workloads as test_hashtable: sequential inserts that force growth, lookups
+ * that hit, lookups that miss, insert/remove churn and iteration.
+ */
+
+YU_INLINE
+u64 mix64(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+#define keyhash_1(x) mix64(x)
+#define keyhash_2(x) mix64((x) ^ 0x9e3779b97f4a7c15ull)
+#define key_eq(a,b) ((a) == (b))
+
+YU_HASHTABLE(cuckoo, u64, u64, keyhash_1, keyhash_2, key_eq)
+YU_HASHTABLE_IMPL(cuckoo, u64, u64, keyhash_1, keyhash_2, key_eq)
+
+YU_FLATTABLE(flat, u64, u64, keyhash_1, keyhash_2, key_eq)
+YU_FLATTABLE_IMPL(flat, u64, u64, keyhash_1, keyhash_2, key_eq)
+
+#define LIST_TABLES(X) \
+    X(cuckoo) \
+    X(flat)
+
+#define LIST_TABLE_WORKLOADS(X) \
+    X(insert, "insert (growing)") \
+    X(get_hit, "get, present keys") \
+    X(get_miss, "get, absent keys") \
+    X(churn, "put/remove churn") \
+    X(iter, "iterate")
+
+#define TABLE_KEYS (UINT64_C(1000000) * bench_scale())
+
+static u32 sum_cb(u64 key, u64 val, void *data) {
+    *(u64 *)data += key ^ val;
+    return 0;
+}
+
+#define DEFINE_WORKLOADS(tbl) \
+static u64 YU_NAME(tbl, fill)(tbl *t, internal_allocator *mctx, u64 n) { \
+    internal_alloc_ctx_init(mctx); \
+    YU_NAME(tbl, init)(t, 16, (yu_allocator *)mctx); \
+    for (u64 i = 0; i < n; i++) \
+        YU_NAME(tbl, put)(t, i * 7, i, NULL); \
+    return n; \
+} \
+\
+static u64 YU_NAME(tbl, work_insert)(void * YU_UNUSED(data)) { \
+    internal_allocator mctx; \
+    tbl t; \
+    u64 n = YU_NAME(tbl, fill)(&t, &mctx, TABLE_KEYS); \
+    YU_NAME(tbl, free)(&t); \
+    return n; \
+} \
+\
+static u64 YU_NAME(tbl, work_get_hit)(void * YU_UNUSED(data)) { \
+    internal_allocator mctx; \
+    tbl t; \
+    u64 n = YU_NAME(tbl, fill)(&t, &mctx, TABLE_KEYS), rng = 1, sum = 0, v; \
+    bench_restart_clock(); \
+    for (u64 i = 0; i < n; i++) { \
+        if (YU_NAME(tbl, get)(&t, (bench_rand(&rng) % n) * 7, &v)) \
+            sum += v; \
+    } \
+    BENCH_CLOBBER(sum); \
+    YU_NAME(tbl, free)(&t); \
+    return n; \
+} \
+\
+static u64 YU_NAME(tbl, work_get_miss)(void * YU_UNUSED(data)) { \
+    internal_allocator mctx; \
+    tbl t; \
+    u64 n = YU_NAME(tbl, fill)(&t, &mctx, TABLE_KEYS), rng = 1, found = 0; \
+    bench_restart_clock(); \
+    for (u64 i = 0; i < n; i++) \
+        found += YU_NAME(tbl, get)(&t, (bench_rand(&rng) % n) * 7 + 1, NULL); \
+    BENCH_CLOBBER(found); \
+    YU_NAME(tbl, free)(&t); \
+    return n; \
+} \
+\
+static u64 YU_NAME(tbl, work_churn)(void * YU_UNUSED(data)) { \
+    internal_allocator mctx; \
+    tbl t; \
+    u64 live = TABLE_KEYS / 10, n = YU_NAME(tbl, fill)(&t, &mctx, live); \
+    bench_restart_clock(); \
+    for (u64 i = n; i < n + TABLE_KEYS; i++) { \
+        YU_NAME(tbl, remove)(&t, (i - live) * 7, NULL); \
+        YU_NAME(tbl, put)(&t, i * 7, i, NULL); \
+    } \
+    YU_NAME(tbl, free)(&t); \
+    return TABLE_KEYS * 2; \
+} \
+\
+static u64 YU_NAME(tbl, work_iter)(void * YU_UNUSED(data)) { \
+    internal_allocator mctx; \
+    tbl t; \
+    u64 n = YU_NAME(tbl, fill)(&t, &mctx, TABLE_KEYS), sum = 0; \
+    bench_restart_clock(); \
+    for (u32 round = 0; round < 10; round++) \
+        YU_NAME(tbl, iter)(&t, sum_cb, &sum); \
+    BENCH_CLOBBER(sum); \
+    YU_NAME(tbl, free)(&t); \
+    return n * 10; \
+}
+
+LIST_TABLES(DEFINE_WORKLOADS)
+
+#define GET_MANY_BATCH 256
+
+// The same lookups as get_hit, but through get_many in batches
+static u64 cuckoo_work_get_many(void * YU_UNUSED(data)) {
+    internal_allocator mctx;
+    cuckoo t;
+    u64 n = cuckoo_fill(&t, &mctx, TABLE_KEYS), rng = 1, sum = 0;
+    u64 keys[GET_MANY_BATCH], vals[GET_MANY_BATCH];
+    bool found[GET_MANY_BATCH];
+    bench_restart_clock();
+    for (u64 i = 0; i < n; i += GET_MANY_BATCH) {
+        for (u32 j = 0; j < GET_MANY_BATCH; j++)
+            keys[j] = (bench_rand(&rng) % n) * 7;
+        cuckoo_get_many(&t, keys, GET_MANY_BATCH, vals, found);
+        for (u32 j = 0; j < GET_MANY_BATCH; j++) {
+            if (found[j])
+                sum += vals[j];
+        }
+    }
+    BENCH_CLOBBER(sum);
+    cuckoo_free(&t);
+    return n;
+}
+
+void BENCH_SUITE_NAME(hashtable)(void) {
+    char label[64];
+#define RUN_WORKLOAD(tbl, wl, desc) \
+    snprintf(label, sizeof(label), "%s: %s", #tbl, desc); \
+    bench_run("hashtable", label, CAT(CAT(tbl, _work_), wl), NULL, NULL);
+#define RUN_TABLE(wl, desc) \
+    RUN_WORKLOAD(cuckoo, wl, desc) \
+    RUN_WORKLOAD(flat, wl, desc)
+
+    LIST_TABLE_WORKLOADS(RUN_TABLE)
+    RUN_WORKLOAD(cuckoo, get_many, "get_many, present keys")
+
+#undef RUN_TABLE
+#undef RUN_WORKLOAD
+}
@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "bench.h"
+
+#include "rope.h"
+#include "sys_alloc.h"
+
+/**
+ * Editor-style rope workloads: lots of small inserts at random positions, the
+ * same with deletes mixed in, typing into a large rope and reading the result
+ * back a code point at a time. Node allocation and picking node heights
+ * dominate the first two. Opening test/words.txt by mapping it is measured
+ * against reading it in and inserting it, in bytes opened. Searching it is
+ * measured against flattening it for strstr, both for every word that ends in
+ * "ing" (in bytes searched) and for the next one after a random position (in
+ * searches).
+ */
+
+#define ROPE_EDITS (UINT64_C(200000) * bench_scale())
+#define WORDS_PATH "test/words.txt"
+#define OPEN_ROUNDS (20 * bench_scale())
+#define FIND_NEXT_SEARCHES (2000 * bench_scale())
+
+static const u8 *snippets[] = {
+    (const u8 *)"a", (const u8 *)"hello ", (const u8 *)"ф",
+    (const u8 *)"the quick brown fox jumps over the lazy dog\n"
+};
+
+static u64 work_insert(void * YU_UNUSED(data)) {
+    sys_allocator mctx;
+    sfmt_t rng;
+    u64 state = 1;
+    sys_alloc_ctx_init(&mctx);
+    sfmt_init_gen_rand(&rng, 1);
+    rope *r = rope_new((yu_allocator *)&mctx, &rng);
+    for (u64 i = 0; i < ROPE_EDITS; i++) {
+        u64 x = bench_rand(&state);
+        if (rope_insert(r, x % (rope_char_count(r) + 1), snippets[(x >> 32) % elemcount(snippets)]) != ROPE_OK)
+            return 0;
+    }
+    BENCH_CLOBBER(r);
+    rope_free(r);
+    yu_alloc_ctx_free(&mctx);
+    return ROPE_EDITS;
+}
+
+static u64 work_churn(void * YU_UNUSED(data)) {
+    sys_allocator mctx;
+    sfmt_t rng;
+    u64 state = 1;
+    sys_alloc_ctx_init(&mctx);
+    sfmt_init_gen_rand(&rng, 1);
+    rope *r = rope_new((yu_allocator *)&mctx, &rng);
+    for (u64 i = 0; i < ROPE_EDITS; i++) {
+        u64 x = bench_rand(&state), len = rope_char_count(r);
+        // Deletes take out about as much as inserts put in, so the rope
+        // stays small-ish and nodes keep being freed
+        if (len > 4096 && (x & 1))
+            rope_del(r, x % len, (x >> 40) % 64);
+        else if (rope_insert(r, x % (len + 1), snippets[(x >> 32) % elemcount(snippets)]) != ROPE_OK)
+            return 0;
+    }
+    BENCH_CLOBBER(r);
+    rope_free(r);
+    yu_alloc_ctx_free(&mctx);
+    return ROPE_EDITS;
+}
+
+// Typing a character at a time in the middle of a large document, by
+// position or through a cursor
+static u64 type_into(bool use_cursor) {
+    sys_allocator mctx;
+    sfmt_t rng;
+    u64 state = 1;
+    sys_alloc_ctx_init(&mctx);
+    sfmt_init_gen_rand(&rng, 1);
+    rope *r = rope_new((yu_allocator *)&mctx, &rng);
+    for (u64 i = 0; i < ROPE_EDITS; i++) {
+        if (rope_insert(r, rope_char_count(r), snippets[bench_rand(&state) % elemcount(snippets)]) != ROPE_OK)
+            return 0;
+    }
+    size_t pos = rope_char_count(r) / 2;
+    rope_cursor c;
+    rope_cursor_init(&c, r, pos);
+    bench_restart_clock();
+    for (u64 i = 0; i < ROPE_EDITS; i++) {
+        // A line at a time, then move on like an editor would
+        if (i % 64 == 0) {
+            pos = bench_rand(&state) % rope_char_count(r);
+            rope_cursor_seek(&c, pos);
+        }
+        if (use_cursor ? rope_cursor_insert(&c, (const u8 *)"x") != ROPE_OK
+                : rope_insert(r, pos++, (const u8 *)"x") != ROPE_OK)
+            return 0;
+    }
+    BENCH_CLOBBER(r);
+    rope_free(r);
+    yu_alloc_ctx_free(&mctx);
+    return ROPE_EDITS;
+}
+
+static u64 work_type_pos(void * YU_UNUSED(data)) {
+    return type_into(false);
+}
+
+static u64 work_type_cursor(void * YU_UNUSED(data)) {
+    return type_into(true);
+}
+
+static u64 work_iter(void * YU_UNUSED(data)) {
+    sys_allocator mctx;
+    sfmt_t rng;
+    u64 state = 1, sum = 0, n = 0;
+    u32 cp;
+    sys_alloc_ctx_init(&mctx);
+    sfmt_init_gen_rand(&rng, 1);
+    rope *r = rope_new((yu_allocator *)&mctx, &rng);
+    for (u64 i = 0; i < ROPE_EDITS; i++) {
+        u64 x = bench_rand(&state);
+        if (rope_insert(r, x % (rope_char_count(r) + 1), snippets[(x >> 32) % elemcount(snippets)]) != ROPE_OK)
+            return 0;
+    }
+    bench_restart_clock();
+    for (u32 round = 0; round < 10; round++) {
+        rope_text_iter it;
+        rope_text_iter_init(&it, r);
+        while (rope_next_cp(&it, &cp)) {
+            sum += cp;
+            n++;
+        }
+    }
+    BENCH_CLOBBER(sum);
+    rope_free(r);
+    yu_alloc_ctx_free(&mctx);
+    return n;
+}
+
+static u64 open_words(bool map) {
+    sys_allocator mctx;
+    sfmt_t rng;
+    u64 bytes = 0;
+    sys_alloc_ctx_init(&mctx);
+    sfmt_init_gen_rand(&rng, 1);
+    for (u64 round = 0; round < OPEN_ROUNDS; round++) {
+        rope *r;
+        if (map) {
+            r = rope_new_from_file((yu_allocator *)&mctx, &rng, WORDS_PATH);
+        } else {
+            FILE *f = fopen(WORDS_PATH, "rb");
+            if (!f)
+                return 0;
+            fseek(f, 0, SEEK_END);
+            long size = ftell(f);
+            fseek(f, 0, SEEK_SET);
+            u8 *buf = malloc(size + 1);
+            buf[fread(buf, 1, size, f)] = '\0';
+            fclose(f);
+            r = rope_new_with_utf8((yu_allocator *)&mctx, &rng, buf);
+            free(buf);
+        }
+        if (!r)
+            return 0;
+        bytes += rope_byte_count(r);
+        rope_free(r);
+    }
+    yu_alloc_ctx_free(&mctx);
+    return bytes;
+}
+
+static u64 work_open_mapped(void * YU_UNUSED(data)) {
+    return open_words(true);
+}
+
+static u64 work_open_read(void * YU_UNUSED(data)) {
+    return open_words(false);
+}
+
+static u32 count_match(size_t YU_UNUSED(pos), void *data) {
+    ++*(u64 *)data;
+    return 0;
+}
+
+static u64 find_words(bool flatten) {
+    sys_allocator mctx;
+    sfmt_t rng;
+    u64 found = 0;
+    sys_alloc_ctx_init(&mctx);
+    sfmt_init_gen_rand(&rng, 1);
+    rope *r = rope_new_from_file((yu_allocator *)&mctx, &rng, WORDS_PATH);
+    if (!r)
+        return 0;
+    bench_restart_clock();
+    for (u64 round = 0; round < OPEN_ROUNDS; round++) {
+        if (flatten) {
+            u8 *s = rope_create_cstr(r);
+            for (char *p = (char *)s; (p = strstr(p, "ing\n")) != NULL; p += 4)
+                found++;
+            yu_free((yu_allocator *)&mctx, s);
+        } else {
+            rope_find_all(r, (const u8 *)"ing\n", count_match, &found);
+        }
+    }
+    BENCH_CLOBBER(found);
+    u64 bytes = OPEN_ROUNDS * rope_byte_count(r);
+    rope_free(r);
+    yu_alloc_ctx_free(&mctx);
+    return bytes;
+}
+
+static u64 work_find_all(void * YU_UNUSED(data)) {
+    return find_words(false);
+}
+
+static u64 work_find_flat(void * YU_UNUSED(data)) {
+    return find_words(true);
+}
+
+// words.txt is ASCII, so there's no need to convert between character and
+// byte positions for strstr
+static u64 find_next(bool flatten) {
+    sys_allocator mctx;
+    sfmt_t rng;
+    u64 state = 1, sum = 0;
+    sys_alloc_ctx_init(&mctx);
+    sfmt_init_gen_rand(&rng, 1);
+    rope *r = rope_new_from_file((yu_allocator *)&mctx, &rng, WORDS_PATH);
+    if (!r)
+        return 0;
+    bench_restart_clock();
+    for (u64 i = 0; i < FIND_NEXT_SEARCHES; i++) {
+        size_t pos = bench_rand(&state) % rope_char_count(r);
+        if (flatten) {
+            u8 *s = rope_create_cstr(r);
+            char *p = strstr((char *)s + pos, "ing\n");
+            sum += p ? (size_t)(p - (char *)s) : SIZE_MAX;
+            yu_free((yu_allocator *)&mctx, s);
+        } else {
+            sum += rope_find(r, (const u8 *)"ing\n", pos);
+        }
+    }
+    BENCH_CLOBBER(sum);
+    rope_free(r);
+    yu_alloc_ctx_free(&mctx);
+    return FIND_NEXT_SEARCHES;
+}
+
+static u64 work_find_next(void * YU_UNUSED(data)) {
+    return find_next(false);
+}
+
+static u64 work_find_next_flat(void * YU_UNUSED(data)) {
+    return find_next(true);
+}
+
+void BENCH_SUITE_NAME(rope)(void) {
+    bench_run("rope", "small inserts", work_insert, NULL, NULL);
+    bench_run("rope", "inserts and deletes", work_churn, NULL, NULL);
+    bench_run("rope", "typing, by position", work_type_pos, NULL, NULL);
+    bench_run("rope", "typing, through a cursor", work_type_cursor, NULL, NULL);
+    bench_run("rope", "iterate code points", work_iter, NULL, NULL);
+    bench_run("rope", "open words.txt, mapped", work_open_mapped, NULL, NULL);
+    bench_run("rope", "open words.txt, read in", work_open_read, NULL, NULL);
+    bench_run("rope", "find all, in place", work_find_all, NULL, NULL);
+    bench_run("rope", "find all, flattened first", work_find_flat, NULL, NULL);
+    bench_run("rope", "find next, in place", work_find_next, NULL, NULL);
+    bench_run("rope", "find next, flattened first", work_find_next_flat, NULL, NULL);
+}
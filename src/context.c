@@ -10,6 +10,9 @@ void yu_tuple_append(yu_ctx *ctx, value_t tup, value_t value) {
     struct boxed_value *val = value_get_ptr(tup);
     assert(boxed_value_get_type(val) == VALUE_TUPLE);
     gc_barrier(ctx->gc, value_to_ptr(value));
+    // Tuples are meant to be finished before they're hashed, but don't keep a
+    // stale hash around if one was
+    val->tuple_cache.flags = 0;
 
     u8 i = 0;
     value_t v;
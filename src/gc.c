@@ -20,6 +20,31 @@ int arena_gray_cmp(struct arena_handle *a, struct arena_handle *b) {
 YU_SPLAYTREE_IMPL(root_list, value_handle, root_list_ptr_cmp, true)
 YU_QUICKHEAP_IMPL(arena_heap, struct arena_handle *, arena_gray_cmp, YU_QUICKHEAP_MAXHEAP)
 
+static
+void collect_for_pressure(struct gc_info *gc) {
+    // Soft pressure just finishes the current cycle; hard pressure makes it
+    // a major collection so the oldest generation gets compacted too.
+    if (gc->major_pending)
+        gc->collecting_generation = GC_NUM_GENERATIONS-1;
+    gc->collect_pending = gc->major_pending = false;
+    gc_full_collect(gc);
+}
+
+// Pressure can be signalled by any allocation from mem_ctx. Outside the
+// collector that's a fine time to collect, and the allocation gets to use
+// whatever the collection frees. The ones the collector makes itself halfway
+// through allocating a value or sweeping an arena aren't, so those just note
+// it and collect at the next gc_alloc_val.
+static
+void collect_on_pressure(yu_mem_pressure level, size_t YU_UNUSED(requested), void *data) {
+    struct gc_info *gc = data;
+    gc->collect_pending = true;
+    if (level == YU_MEM_PRESSURE_HARD)
+        gc->major_pending = true;
+    if (!gc->busy)
+        collect_for_pressure(gc);
+}
+
 YU_ERR_RET gc_init(struct gc_info *gc, yu_allocator *mctx) {
     YU_ERR_DEFVAR
 
@@ -37,11 +62,17 @@ YU_ERR_RET gc_init(struct gc_info *gc, yu_allocator *mctx) {
 
     gc->collecting_generation = 0;
     gc->active_gray = NULL;
+    gc->strs = NULL;
+    gc->busy = 0;
+    gc->collect_pending = gc->major_pending = false;
+
+    yu_alloc_add_pressure_hook(mctx, collect_on_pressure, gc);
 
     YU_ERR_DEFAULT_HANDLER(yu_local_err)
 }
 
 void gc_free(struct gc_info *gc) {
+    yu_alloc_remove_pressure_hook(gc->mem_ctx, collect_on_pressure, gc);
     root_list_free(&gc->roots);
     arena_heap_free(&gc->a_gray);
     for (u8 i = 0; i < GC_NUM_GENERATIONS; i++)
@@ -88,22 +119,45 @@ void collect_arena(struct arena_handle *a, void *data) {
 }
 
 value_handle gc_alloc_val(struct gc_info *gc, value_type type) {
+    if (gc->collect_pending)
+        collect_for_pressure(gc);
+    ++gc->busy;
     struct boxed_value *v = arena_alloc_val_check(gc->arenas[0], collect_arena, gc);
     boxed_value_set_type(v, type);
     boxed_value_set_gray(v, boxed_value_is_traversable(v));
+    v->tag = NULL;
     if (type == VALUE_TABLE) {
         v->v.tbl = yu_xalloc(gc->mem_ctx, 1, sizeof(value_table));
         value_table_init(v->v.tbl, 10, gc->mem_ctx);
     }
     else if (type == VALUE_TUPLE)
         v->v.tup[0] = v->v.tup[1] = v->v.tup[2] = value_empty();
-    return gc_make_handle(gc, v);
+    value_handle h = gc_make_handle(gc, v);
+    --gc->busy;
+    return h;
+}
+
+void gc_track_strings(struct gc_info *gc, yu_str_ctx *strs) {
+    gc->strs = strs;
+}
+
+value_handle gc_alloc_str(struct gc_info *gc, yu_str s) {
+    assert(gc->strs != NULL && YU_STR_DAT(s)->ctx == gc->strs);
+    // s may already be the collector's and referenced by nothing else, and
+    // gc_alloc_val can collect; this keeps it through the next sweep
+    yu_str_gc_reach(s);
+    value_handle h = gc_alloc_val(gc, VALUE_STR);
+    value_deref(h)->v.s = s;
+    yu_str_gc_own(s);
+    return h;
 }
 
 void gc_root(struct gc_info *gc, value_handle v) {
+    ++gc->busy;
     bool already_rooted = root_list_insert(&gc->roots, v, NULL);
     assert(!already_rooted);
     gc_mark(gc, value_deref(v));
+    --gc->busy;
 }
 
 void gc_unroot(struct gc_info *gc, value_handle v) {
@@ -115,8 +169,11 @@ static
 void push_gray(struct gc_info *gc, struct boxed_value *v) {
     struct arena_handle *a = boxed_value_owner(v);
     arena_push_gray(a, v);
-    if (arena_gray_count(a) == 1)
+    if (arena_gray_count(a) == 1) {
+        ++gc->busy;
         arena_heap_push(&gc->a_gray, a);
+        --gc->busy;
+    }
 }
 
 void gc_barrier(struct gc_info *gc, value_handle val) {
@@ -197,17 +254,17 @@ bool scan_step(struct gc_info *gc) {
 
 bool gc_scan_step(struct gc_info *gc) {
     bool sweep = false;
+    ++gc->busy;
     for (u32 i = 0; i < GC_INCREMENTAL_STEP_COUNT; i++) {
         if (!scan_step(gc)) {
             sweep = true;
             break;
         }
     }
-    if (sweep) {
+    if (sweep)
         gc_sweep(gc);
-        return true;
-    }
-    return false;
+    --gc->busy;
+    return sweep;
 }
 
 static
@@ -225,9 +282,35 @@ void move_ptr(struct boxed_value *old_ptr, struct boxed_value *new_ptr, void *da
     assert(false);
 }
 
+// Lets the string table know which strings are still referenced by surviving
+// values, and frees the rest. Only done after a major collection: that's the
+// only time every value left in the arenas is known to be alive, rather than
+// just not collected yet.
+static
+void sweep_strings(struct gc_info *gc) {
+    // A collection set off by pressure can land in the middle of the string
+    // table's own put; freeing strings then would pull entries out from under
+    // it. They'll keep until the next major collection.
+    if (gc->strs->bufctx.busy)
+        return;
+    for (u8 i = 0; i < GC_NUM_GENERATIONS; i++) {
+        for (struct arena_handle *a = gc->arenas[i]; a; a = a->next) {
+            for (struct boxed_value *v = a->self->objs; v < a->self->next; v++) {
+                if (boxed_value_get_type(v) == VALUE_STR)
+                    yu_str_gc_reach(v->v.s);
+                if (v->tag != NULL)
+                    yu_str_gc_reach(v->tag);
+            }
+        }
+    }
+    yu_str_ctx_sweep(gc->strs);
+}
+
 void gc_sweep(struct gc_info *gc) {
     u8 current_gen = gc->collecting_generation+1;
-    if (current_gen == GC_NUM_GENERATIONS) {
+    bool major = current_gen == GC_NUM_GENERATIONS;
+    ++gc->busy;
+    if (major) {
         arena_compact(gc->arenas[GC_NUM_GENERATIONS-1], move_ptr, gc);
         --current_gen;
     }
@@ -235,14 +318,19 @@ void gc_sweep(struct gc_info *gc) {
         arena_promote(gc->arenas[current_gen], move_ptr, gc);
         arena_empty(gc->arenas[current_gen]);
     }
+    if (major && gc->strs != NULL)
+        sweep_strings(gc);
     // `promote` will have un-marked all root objects, so let's go ahead and do that again
     struct root_list_nodelist *n = gc->roots.nodes;
     while (n) {
         gc_mark(gc, value_deref(n->n->dat));
         n = n->next;
     }
+    --gc->busy;
 }
 
 void gc_full_collect(struct gc_info *gc) {
+    ++gc->busy;
     while (!gc_scan_step(gc)) { }
+    --gc->busy;
 }
@@ -87,6 +87,17 @@ struct gc_info {
     struct arena_handle *active_gray; // Popped off the gray priority heap
 
     u8 collecting_generation;
+
+    // Nonzero while the collector's own structures are being modified.
+    // Memory pressure in the meantime only sets the pending flags, which
+    // the next gc_alloc_val acts on.
+    u32 busy;
+    bool collect_pending, major_pending;
+
+    // Strings handed to the collector by gc_alloc_str. Major collections
+    // sweep them out of their intern table once no surviving value
+    // references them.
+    yu_str_ctx *strs;
 };
 
 YU_ERR_RET gc_init(struct gc_info *gc, yu_allocator *mctx);
@@ -95,6 +106,11 @@ void gc_free(struct gc_info *gc);
 value_handle gc_make_handle(struct gc_info *gc, struct boxed_value *v);
 value_handle gc_alloc_val(struct gc_info *gc, value_type type);
 
+// Strings given to gc_alloc_str must come from strs
+void gc_track_strings(struct gc_info *gc, yu_str_ctx *strs);
+// Boxes s as a VALUE_STR, handing it over to the collector (see yu_str_gc_own)
+value_handle gc_alloc_str(struct gc_info *gc, yu_str s);
+
 void gc_root(struct gc_info *gc, value_handle v);
 void gc_unroot(struct gc_info *gc, value_handle v);
 
@@ -11,6 +11,7 @@ YU_ERR_RET lexer_open(struct lexer *lex, FILE *in, yu_allocator *mctx) {
     YU_ERR_DEFVAR
     lex->mem_ctx = mctx;
     yu_str_ctx_init(&lex->str_ctx, mctx);
+    lex->active_b.buf = NULL;
     lex->in = in;
     YU_THROWIF(yylex_init_extra(lex, &lex->scanner) != 0, YU_ERR_UNKNOWN_FATAL);
     lex->buf = yy_create_buffer(in, YY_BUF_SIZE, lex->scanner);
@@ -20,6 +21,9 @@ YU_ERR_RET lexer_open(struct lexer *lex, FILE *in, yu_allocator *mctx) {
 }
 
 void lexer_close(struct lexer *lex) {
+    // Input may have ended in the middle of a string literal
+    if (lex->active_b.buf != NULL)
+        yu_str_builder_free(&lex->active_b);
     yu_str_ctx_free(&lex->str_ctx);
     fclose(lex->in);
     yy_delete_buffer(lex->buf, lex->scanner);
@@ -43,6 +43,8 @@ struct lexer {
     FILE *in;
 
     yu_str active_s;
+    // Contents of the string literal being lexed
+    yu_str_builder active_b;
 
     char *err_msg;
 };
@@ -288,6 +288,25 @@ bool value_is_aux(value_t val) {
            val.as_int64 <= NANBOX_MAX_AUX;
 }
 
+// Aux values are one of the tags 1..5 in the top 16 bits over a 48-bit payload
+YU_INLINE
+uint32_t value_aux_tag(value_t val) {
+    assert(value_is_aux(val));
+    return (uint32_t)(val.as_int64 >> 48);
+}
+YU_INLINE
+uint64_t value_aux_payload(value_t val) {
+    assert(value_is_aux(val));
+    return val.as_int64 & ~NANBOX_HIGH16_TAG;
+}
+YU_INLINE
+value_t value_from_aux(uint32_t tag, uint64_t payload) {
+    value_t val;
+    assert(tag >= 1 && tag <= 5 && !(payload & NANBOX_HIGH16_TAG));
+    val.as_int64 = (uint64_t)tag << 48 | payload;
+    return val;
+}
+
 /* end if !32-bit */
 #else
 
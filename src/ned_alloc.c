@@ -16,17 +16,21 @@ yu_err ned_alloc_ctx_init(ned_allocator *ctx, size_t init_capacity) {
   ctx->base.release = (yu_release_fn)ned_release;
   ctx->base.commit = (yu_commit_fn)ned_commit;
   ctx->base.decommit = (yu_decommit_fn)ned_decommit;
+  ctx->base.limits = NULL;
 
-  if ((ctx->pool = nedcreatepool(0, 1)) == NULL)
+  if (internal_alloc_ctx_init(&ctx->tbl_mctx) != YU_OK)
     return YU_ERR_ALLOC_FAIL;
 
-  return YU_OK;
-}
+  ctx->capacity = init_capacity;
+  ctx->live = 0;
+  if ((ctx->pool = nedcreatepool(init_capacity, 1)) == NULL) {
+    yu_alloc_ctx_free(&ctx->tbl_mctx);
+    return YU_ERR_ALLOC_FAIL;
+  }
 
-static
-u32 free_ctx_all(void *address, size_t YU_UNUSED(sz), void * YU_UNUSED(data)) {
-  free(address);
-  return 0;
+  sysmem_pgtbl_init(&ctx->pgs, 20, &ctx->tbl_mctx);
+
+  return YU_OK;
 }
 
 static
@@ -39,6 +43,9 @@ u32 release_ctx_all(void *page, size_t sz, void *data) {
 
 void ned_alloc_ctx_free(ned_allocator *ctx) {
   neddestroypool(ctx->pool);
+  sysmem_pgtbl_iter(&ctx->pgs, release_ctx_all, (void *)(yu_virtual_pagesize(0)-1));
+  sysmem_pgtbl_free(&ctx->pgs);
+  yu_alloc_ctx_free(&ctx->tbl_mctx);
 }
 
 yu_err ned_alloc(ned_allocator *ctx, void **out, size_t num, size_t elem_size, size_t alignment) {
@@ -47,6 +54,7 @@ yu_err ned_alloc(ned_allocator *ctx, void **out, size_t num, size_t elem_size, s
     *out = NULL;
     return YU_ERR_ALLOC_FAIL;
   }
+  ctx->live++;
   *out = ptr;
   return YU_OK;
 }
@@ -58,11 +66,24 @@ yu_err ned_realloc(ned_allocator *ctx, void **ptr, size_t num, size_t elem_size,
     *ptr = safety_first;
     return YU_ERR_ALLOC_FAIL;
   }
+  if (safety_first == NULL)
+    ctx->live++;
   *ptr = newptr;
   return YU_OK;
 }
 
 void ned_free(ned_allocator *ctx, void *ptr) {
+  // Same as sys_free — only check the page table if `ptr` looks like a page.
+  size_t pgsz = yu_virtual_pagesize(0)-1, sz, free_sz;
+  if (((uintptr_t)ptr & pgsz) == 0) {
+    if (sysmem_pgtbl_remove(&ctx->pgs, ptr, &sz)) {
+      free_sz = (sz & pgsz) == 0 ? sz : (sz+pgsz) & ~pgsz;
+      yu_virtual_free(ptr, free_sz, YU_VIRTUAL_DECOMMIT | YU_VIRTUAL_RELEASE);
+      return;
+    }
+  }
+  if (ptr != NULL)
+    ctx->live--;
   nedpfree2(ctx->pool, ptr, NM_SKIP_TOLERANCE_CHECKS);
 }
 
@@ -80,25 +101,87 @@ struct malloc_chunk {
 #define chunksize(p)        ((p)->head & ~FLAG_BITS)
 
 size_t ned_allocated_size(ned_allocator *ctx, void *ptr) {
+  size_t sz;
+  if (((uintptr_t)ptr & (yu_virtual_pagesize(0)-1)) == 0) {
+    if (sysmem_pgtbl_get(&ctx->pgs, ptr, &sz))
+      return sz;
+  }
   return chunksize(mem2chunk(ptr));
 }
 
-size_t ned_usable_size(ned_allocator * YU_UNUSED(ctx), void *ptr) {
+size_t ned_usable_size(ned_allocator *ctx, void *ptr) {
+  size_t pgsz = yu_virtual_pagesize(0)-1, sz;
+  if (((uintptr_t)ptr & pgsz) == 0) {
+    if (sysmem_pgtbl_get(&ctx->pgs, ptr, &sz))
+      return (sz & pgsz) == 0 ? sz : (sz+pgsz) & ~pgsz;
+  }
   return nedmemsize(ptr);
 }
 
 yu_err ned_reserve(ned_allocator *ctx, void **out, size_t num, size_t elem_size) {
-  return YU_ERR_ALLOC_FAIL;
+  void *pg;
+  size_t pgsz = yu_virtual_pagesize(0)-1, alloc_sz = num * elem_size, usable_sz;
+  assert(alloc_sz > 0);
+  if (alloc_sz == 0)
+    return YU_ERR_ALLOC_FAIL;
+  if ((alloc_sz & pgsz) != 0)
+    alloc_sz = (alloc_sz+pgsz) & ~pgsz;
+  usable_sz = yu_virtual_alloc(&pg, NULL, alloc_sz, YU_VIRTUAL_RESERVE);
+  if (usable_sz == 0)
+    return YU_ERR_ALLOC_FAIL;
+  // See the note in sys_reserve about this assumption.
+  assert(usable_sz == alloc_sz);
+  *out = pg;
+  sysmem_pgtbl_put(&ctx->pgs, pg, num * elem_size, NULL);
+  return YU_OK;
 }
 
 yu_err ned_commit(ned_allocator * YU_UNUSED(ctx), void *ptr, size_t num, size_t elem_size) {
-  return YU_ERR_ALLOC_FAIL;
+  if (yu_virtual_alloc(&ptr, ptr, num * elem_size, YU_VIRTUAL_COMMIT) == 0)
+    return YU_ERR_ALLOC_FAIL;
+  return YU_OK;
 }
 
 yu_err ned_release(ned_allocator *ctx, void *ptr) {
-  return YU_ERR_ALLOC_FAIL;
+  size_t pgsz = yu_virtual_pagesize(0)-1, sz, free_sz;
+  if (!sysmem_pgtbl_remove(&ctx->pgs, ptr, &sz))
+    return YU_ERR_ALLOC_FAIL;
+  free_sz = (sz & pgsz) == 0 ? sz : (sz+pgsz) & ~pgsz;
+  yu_virtual_free(ptr, free_sz, YU_VIRTUAL_RELEASE);
+  return YU_OK;
+}
+
+// Whatever the pool grew into below its bookkeeping can't be trimmed, but
+// with nothing left in it, it can be swapped for a new one. That costs a
+// whole new pool, so it's only worth it once the old one has grown well past
+// where a fresh one would start.
+static
+bool swap_idle_pool(ned_allocator *ctx) {
+  if (ctx->live != 0 || nedpmalloc_footprint(ctx->pool) <= ctx->capacity + NED_IDLE_SWAP_THRESHOLD)
+    return false;
+  nedpool *fresh = nedcreatepool(ctx->capacity, 1);
+  if (fresh == NULL)
+    return false;
+  neddestroypool(ctx->pool);
+  ctx->pool = fresh;
+  return true;
+}
+
+yu_err ned_decommit(ned_allocator *ctx, void *ptr, size_t num, size_t elem_size) {
+  yu_virtual_free(ptr, num * elem_size, YU_VIRTUAL_DECOMMIT);
+  // Someone giving pages back is a good hint that this context is going idle,
+  // so give back whatever the pool isn't using as well. Unlike ned_trim this
+  // leaves the thread cache alone: flushing it is slow (and chatty, as
+  // nedmalloc logs cache statistics whenever it's built with DEBUG defined,
+  // which it always is) for something the GC does this often.
+  if (!swap_idle_pool(ctx))
+    nedpmalloc_trim(ctx->pool, 0);
+  return YU_OK;
 }
 
-yu_err ned_decommit(ned_allocator * YU_UNUSED(ctx), void *ptr, size_t num, size_t elem_size) {
-  return YU_ERR_ALLOC_FAIL;
+bool ned_trim(ned_allocator *ctx) {
+  if (swap_idle_pool(ctx))
+    return true;
+  nedtrimthreadcache(ctx->pool, 0);
+  return nedpmalloc_trim(ctx->pool, 0) != 0;
 }
@@ -6,11 +6,40 @@
 #pragma once
 
 #include "yu_common.h"
+#include "internal_alloc.h"
+#include "sys_alloc.h"
 #include "nedmalloc/nedmalloc.h"
 
+/**
+ * nedmalloc doesn't know anything about reserving address space without
+ * committing it, so page-level allocations bypass the pool and go straight
+ * to the platform layer. They're tracked the same way sys_alloc tracks them
+ * (in a sysmem_pgtbl keyed by the start of the reservation) so that releasing
+ * the context releases every reservation made in it.
+ *
+ * Decommitting also trims the pool: free space at the top of the pool and any
+ * segments that have become completely free are returned to the OS. Idle
+ * contexts can thus be shrunk by decommitting whatever pages they own, or by
+ * calling ned_trim(), which flushes this thread's cache into the pool first.
+ * dlmalloc never trims the segment holding the pool's own bookkeeping, and on
+ * most systems that's the segment the pool grows into, so in practice only a
+ * pool with nothing allocated from it gives much back: once it has grown more
+ * than NED_IDLE_SWAP_THRESHOLD past `init_capacity`, it's replaced with a fresh
+ * one.
+ */
+
+#ifndef NED_IDLE_SWAP_THRESHOLD
+#define NED_IDLE_SWAP_THRESHOLD (4*1024*1024)
+#endif
+
 typedef struct {
   struct yu_mem_funcs base;
   nedpool *pool;
+  size_t capacity;
+  // Blocks allocated from pool and not yet freed
+  size_t live;
+  sysmem_pgtbl pgs;
+  internal_allocator tbl_mctx;
 } ned_allocator;
 
 yu_err ned_alloc_ctx_init(ned_allocator *ctx, size_t init_capacity);
@@ -27,3 +56,7 @@ yu_err ned_reserve(ned_allocator *ctx, void **out, size_t num, size_t elem_size)
 yu_err ned_commit(ned_allocator *ctx, void *ptr, size_t num, size_t elem_size);
 yu_err ned_release(ned_allocator *ctx, void *ptr);
 yu_err ned_decommit(ned_allocator *ctx, void *ptr, size_t num, size_t elem_size);
+
+// Return unused memory held by the pool (and this thread's cache) to the OS.
+// Returns true if any memory was actually released.
+bool ned_trim(ned_allocator *ctx);
@@ -155,3 +155,24 @@ size_t yu_virtual_alloc(void **out, void *addr, size_t sz, yu_virtual_mem_flags
  * value of the out pointer from that function.
  */
 void yu_virtual_free(void *ptr, size_t sz, yu_virtual_mem_flags flags);
+
+/**
+ * Map the whole file at `path` into memory, read-only.
+ *
+ * The file mustn't be changed while it's mapped; what the mapping then shows
+ * differs between systems.
+ *
+ * Returns:
+ * The size of the file in bytes. *out is set to the (page-aligned) start of
+ * the mapping. An empty file can't really be mapped, so for one *out is set to
+ * some non-NULL address and 0 is returned.
+ *
+ * Failure:
+ * If the file can't be opened or mapped, *out is set to NULL and 0 is returned.
+ */
+size_t yu_file_map(const void **out, const char *path);
+
+/**
+ * Unmap a file mapped by yu_file_map(). `sz` must be the size it returned.
+ */
+void yu_file_unmap(const void *ptr, size_t sz);
@@ -5,7 +5,9 @@
 
 #pragma once
 
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 // platform/linux.h redefines these
@@ -105,3 +107,36 @@ void yu_virtual_free(void *ptr, size_t sz, yu_virtual_mem_flags flags) {
   if (flags & YU_VIRTUAL_RELEASE)
     munmap(ptr, sz);
 }
+
+size_t yu_file_map(const void **out, const char *path) {
+  static const char empty[1];
+  struct stat st;
+  void *ptr;
+
+  *out = NULL;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return 0;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    *out = empty;
+    return 0;
+  }
+  ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (ptr == MAP_FAILED)
+    return 0;
+
+  *out = ptr;
+  return st.st_size;
+}
+
+void yu_file_unmap(const void *ptr, size_t sz) {
+  if (sz != 0)
+    munmap((void *)ptr, sz);
+}
@@ -99,3 +99,36 @@ void yu_virtual_free(void *ptr, size_t sz, yu_virtual_mem_flags flags) {
   if (flags & YU_VIRTUAL_RELEASE)
     VirtualFree(ptr, sz, MEM_RELEASE);
 }
+
+size_t yu_file_map(const void **out, const char *path) {
+  static const char empty[1];
+  LARGE_INTEGER size;
+  HANDLE file, mapping;
+
+  *out = NULL;
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return 0;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return 0;
+  }
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    *out = empty;
+    return 0;
+  }
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL)
+    return 0;
+  // The view keeps the mapping (and file) alive
+  *out = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  return *out != NULL ? (size_t)size.QuadPart : 0;
+}
+
+void yu_file_unmap(const void *ptr, size_t sz) {
+  if (sz != 0)
+    UnmapViewOfFile(ptr);
+}
@@ -5,6 +5,112 @@
 // The number of bytes the rope head structure takes up
 static const size_t ROPE_SIZE = sizeof(rope) + sizeof(rope_node) * ROPE_MAX_HEIGHT;
 
+struct rope_slab {
+  struct rope_slab *next;
+  size_t used, size;
+  uint8_t mem[];
+};
+
+struct rope_mapping {
+  const void *addr;
+  size_t size;
+  // The number of ropes sharing it
+  uint32_t refs;
+};
+
+#define ROPE_RAND_CHUNKS (SFMT_N64 * 4)
+
+static
+void init_pool(rope *r) {
+  r->rand_buf = NULL;
+  r->rand_pos = ROPE_RAND_CHUNKS;
+  r->slabs = NULL;
+  memset(r->free_nodes, 0, sizeof(r->free_nodes));
+}
+
+// Draws 16 random bits for random_height
+static
+uint16_t rand_chunk(rope *r) {
+  uint16_t x;
+  if (r->rand_pos == ROPE_RAND_CHUNKS) {
+    if (r->rand_buf == NULL &&
+        yu_alloc(r->mem_ctx, (void **)&r->rand_buf, SFMT_N64, sizeof(uint64_t), 16) != YU_OK) {
+      // Not worth failing over; just draw them one at a time
+      r->rand_buf = NULL;
+      return (uint16_t)sfmt_genrand_uint32(r->rng);
+    }
+    // The bulk generator only starts from a fresh block of state. Anything
+    // else drawing from rng one number at a time will have left it partway
+    // through one, in which case we'd better do the same.
+    if (r->rng->idx == SFMT_N32)
+      sfmt_fill_array64(r->rng, r->rand_buf, SFMT_N64);
+    else {
+      for (int i = 0; i < SFMT_N64; i++)
+        r->rand_buf[i] = (uint64_t)sfmt_genrand_uint32(r->rng) << 32 | sfmt_genrand_uint32(r->rng);
+    }
+    r->rand_pos = 0;
+  }
+  memcpy(&x, (const uint8_t *)r->rand_buf + r->rand_pos++ * sizeof(x), sizeof(x));
+  return x;
+}
+
+static
+uint8_t random_height(rope *r) {
+  // Each level is a 16-bit draw from a buffer SFMT fills in bulk, which is far
+  // cheaper than a call into it (and a division) per level
+  const uint16_t bias = (uint16_t)(ROPE_BIAS * 65536 / 100);
+  uint8_t height = 1;
+
+  // The root node's height is the height of the largest node + 1, so the largest
+  // node can only have ROPE_MAX_HEIGHT - 1.
+  while(height < (ROPE_MAX_HEIGHT - 1) && rand_chunk(r) < bias) {
+    height++;
+  }
+
+  return height;
+}
+
+// Figure out how many bytes to allocate for a node with the specified height.
+static YU_CONST
+size_t node_size(uint8_t height) {
+  return sizeof(rope_node) + height * sizeof(rope_skip_node);
+}
+
+// Allocate and return a new node. The new node will be full of junk, except
+// for its height.
+static YU_MALLOC_LIKE
+rope_node *alloc_node(rope *r, uint8_t height) {
+  rope_node *node = r->free_nodes[height];
+  if (node != NULL) {
+    r->free_nodes[height] = node->nexts[0].node;
+    return node;
+  }
+
+  size_t size = node_size(height);
+  struct rope_slab *slab = r->slabs;
+  if (slab == NULL || slab->used + size > slab->size) {
+    // Each slab is twice the size of the last, so small ropes stay small
+    size_t slab_size = slab ? min(slab->size * 2, ROPE_SLAB_SIZE) : ROPE_MIN_SLAB_SIZE;
+    slab_size = max(slab_size, size);
+    slab = yu_xalloc(r->mem_ctx, 1, sizeof(struct rope_slab) + slab_size);
+    slab->next = r->slabs;
+    slab->used = 0;
+    slab->size = slab_size;
+    r->slabs = slab;
+  }
+  node = (rope_node *)(slab->mem + slab->used);
+  slab->used += size;
+  node->height = height;
+  return node;
+}
+
+// Keeps a node that's been unlinked from the rope for reuse
+static
+void free_node(rope *r, rope_node *node) {
+  node->nexts[0].node = r->free_nodes[node->height];
+  r->free_nodes[node->height] = node;
+}
+
 // Create a new rope with no contents
 rope *rope_new(yu_allocator *mctx, sfmt_t *rng) {
   rope *r = yu_xalloc(mctx, 1, ROPE_SIZE);
@@ -12,7 +118,11 @@ rope *rope_new(yu_allocator *mctx, sfmt_t *rng) {
 
   r->mem_ctx = mctx;
   r->rng = rng;
+  r->edits = 0;
+  r->mapping = NULL;
+  init_pool(r);
 
+  r->head.what = ROPE_NODE_STR;
   r->head.height = 1;
   r->head.num_bytes = 0;
   r->head.nexts[0].node = NULL;
@@ -38,6 +148,9 @@ rope *rope_copy(const rope *other) {
 
   // Just copy most of the head's data. Note this won't copy the nexts list in head.
   *r = *other;
+  init_pool(r);
+  if (r->mapping)
+    r->mapping->refs++;
 
   rope_node *nodes[ROPE_MAX_HEIGHT];
 
@@ -50,12 +163,15 @@ rope *rope_copy(const rope *other) {
   for (rope_node *n = other->head.nexts[0].node; n != NULL; n = n->nexts[0].node) {
     // I wonder if it would be faster if we took this opportunity to rebalance the node list..?
     size_t h = n->height;
-    rope_node *n2 = yu_xalloc(r->mem_ctx, sizeof(rope_node) + h, sizeof(rope_skip_node));
+    rope_node *n2 = alloc_node(r, h);
 
     // Would it be faster to just *n2 = *n; ?
+    n2->what = n->what;
     n2->num_bytes = n->num_bytes;
-    n2->height = h;
-    memcpy(n2->val.str, n->val.str, n->num_bytes);
+    if (n->what == ROPE_NODE_MAPPED)
+      n2->val.mapped = n->val.mapped;
+    else
+      memcpy(n2->val.str, n->val.str, n->num_bytes);
     memcpy(n2->nexts, n->nexts, h * sizeof(rope_skip_node));
 
     for (int i = 0; i < h; i++) {
@@ -70,11 +186,18 @@ rope *rope_copy(const rope *other) {
 // Free the specified rope
 void rope_free(rope *r) {
   assert(r);
-  rope_node *next;
+  struct rope_slab *next;
 
-  for (rope_node *n = r->head.nexts[0].node; n != NULL; n = next) {
-    next = n->nexts[0].node;
-    yu_free(r->mem_ctx, n);
+  // Nodes all live in the slabs
+  for (struct rope_slab *slab = r->slabs; slab != NULL; slab = next) {
+    next = slab->next;
+    yu_free(r->mem_ctx, slab);
+  }
+  if (r->rand_buf)
+    yu_free(r->mem_ctx, r->rand_buf);
+  if (r->mapping && --r->mapping->refs == 0) {
+    yu_file_unmap(r->mapping->addr, r->mapping->size);
+    yu_free(r->mem_ctx, r->mapping);
   }
 
   yu_free(r->mem_ctx, r);
@@ -102,7 +225,7 @@ size_t rope_write_cstr(rope *r, uint8_t * restrict dest) {
   if (num_bytes) {
     uint8_t *p = dest;
     for (rope_node* restrict n = &r->head; n != NULL; n = n->nexts[0].node) {
-      memcpy(p, n->val.str, n->num_bytes);
+      memcpy(p, rope_node_data(n), n->num_bytes);
       p += n->num_bytes;
     }
 
@@ -119,41 +242,6 @@ uint8_t *rope_create_cstr(rope *r) {
   return bytes;
 }
 
-static
-uint8_t random_height(rope *r) {
-  // This function is horribly inefficient. I'm throwing away heaps of entropy, and
-  // the mod could be replaced by some clever shifting.
-  //
-  // However, random_height barely appears in the profiler output - so its probably
-  // not worth investing the time to optimise.
-
-  uint8_t height = 1;
-
-  // The root node's height is the height of the largest node + 1, so the largest
-  // node can only have ROPE_MAX_HEIGHT - 1.
-  while(height < (ROPE_MAX_HEIGHT - 1) && (sfmt_genrand_uint32(r->rng) % 100) < ROPE_BIAS) {
-    height++;
-  }
-
-  return height;
-}
-
-// Figure out how many bytes to allocate for a node with the specified height.
-static YU_CONST
-size_t node_size(uint8_t height) {
-  return sizeof(rope_node) + height * sizeof(rope_skip_node);
-}
-
-// Allocate and return a new node. The new node will be full of junk, except
-// for its height.
-// This function should be replaced at some point with an object pool based version.
-static YU_MALLOC_LIKE
-rope_node *alloc_node(rope *r, uint8_t height) {
-  rope_node *node = yu_xalloc(r->mem_ctx, 1, node_size(height));
-  node->height = height;
-  return node;
-}
-
 // Find out how many bytes the unicode character which starts with the specified byte
 // will occupy in memory.
 // Returns the number of bytes, or SIZE_MAX if the byte is invalid.
@@ -171,10 +259,35 @@ size_t codepoint_size(uint8_t byte) {
 }
 
 // This little function counts how many bytes a certain number of characters take up.
+// len is how many bytes there are to look through, which mapped nodes have a lot of.
 static YU_PURE
-size_t count_bytes_in_utf8(const uint8_t *str, size_t num_chars) {
-  const uint8_t *p = str;
-  for (unsigned int i = 0; i < num_chars; i++) {
+size_t count_bytes_in_utf8(const uint8_t *str, size_t len, size_t num_chars) {
+  size_t i = 0;
+#ifdef __SSE2__
+  // Skip 16 bytes at a time (less the start of a character that runs past
+  // them) while the characters wanted go on past them. Continuation bytes are
+  // 0x80-0xbf, which is less than -64 signed; the rest each start one.
+  const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1), cont_max = _mm_set1_epi8((char)0xbf);
+  while (i + 16 < len) {
+    __m128i leads = _mm_cmpgt_epi8(_mm_loadu_si128((const __m128i *)&str[i]), cont_max);
+    __m128i sum = _mm_sad_epu8(_mm_and_si128(leads, one), zero);
+    size_t n = _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+    if (n >= num_chars)
+      break;
+    if ((str[i + 16] & 0xc0) != 0x80) {
+      i += 16;
+      num_chars -= n;
+    } else {
+      size_t last = 31 - __builtin_clz(_mm_movemask_epi8(leads));
+      if (last == 0)
+        break;
+      i += last;
+      num_chars -= n - 1;
+    }
+  }
+#endif
+  const uint8_t *p = &str[i];
+  for (; num_chars; num_chars--) {
     p += codepoint_size(*p);
   }
   return p - str;
@@ -214,11 +327,112 @@ ssize_t bytelen_and_check_utf8(const uint8_t *str) {
   return p - str;
 }
 
-typedef struct {
-  // This stores the previous node at each height, and the number of characters from the start of
-  // the previous node to the current iterator position.
-  rope_skip_node s[ROPE_MAX_HEIGHT];
-} rope_iter;
+// Like bytelen_and_check_utf8, but for len bytes that aren't NUL terminated
+// (and mustn't contain a NUL either). Returns the number of characters in
+// them, or SIZE_MAX if they aren't valid.
+static YU_PURE
+size_t count_chars_checked(const uint8_t *str, size_t len) {
+  size_t i = 0, chars = 0;
+  while (i < len) {
+#ifdef __SSE2__
+    // Most text is mostly ASCII, which is a character a byte
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16, chars += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+      if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero))))
+        break;
+    }
+    if (i == len)
+      break;
+#endif
+    size_t size = codepoint_size(str[i]);
+    if (size == SIZE_MAX || size > len - i)
+      return SIZE_MAX;
+    for (size_t j = 1; j < size; j++) {
+      if ((str[i + j] & 0xc0) != 0x80)
+        return SIZE_MAX;
+    }
+    i += size;
+    chars++;
+  }
+  return chars;
+}
+
+void rope_text_iter_init(rope_text_iter *it, const rope *r) {
+  it->node = &r->head;
+  it->offset = it->pos = it->ascii_end = 0;
+}
+
+// Moves past the end of the current node (and any empty ones after it).
+// Returns false at the end of the rope.
+static
+bool text_iter_settle(rope_text_iter *it) {
+  while (it->offset == it->node->num_bytes) {
+    if ((it->node = it->node->nexts[0].node) == NULL)
+      return false;
+    it->offset = it->ascii_end = 0;
+  }
+  return true;
+}
+
+bool rope_next_byte(rope_text_iter *it, uint8_t *out) {
+  if (!text_iter_settle(it))
+    return false;
+  *out = rope_node_data(it->node)[it->offset++];
+  ++it->pos;
+  return true;
+}
+
+bool rope_next_cp(rope_text_iter *it, uint32_t *out) {
+  if (!text_iter_settle(it))
+    return false;
+  const uint8_t *s = rope_node_data(it->node);
+  size_t len = it->node->num_bytes;
+  if (it->offset < it->ascii_end) {
+    *out = s[it->offset++];
+    ++it->pos;
+    return true;
+  }
+
+  // Characters never straddle nodes
+  utf8proc_int32_t cp;
+  utf8proc_ssize_t incr = utf8proc_iterate(s + it->offset, len - it->offset, &cp);
+  if (incr < 0) {
+    // rope_insert lets through a few things utf8proc won't decode (e.g.
+    // 5 and 6 byte sequences)
+    cp = 0xfffd;
+    incr = codepoint_size(s[it->offset]);
+  }
+  else if (cp < 0x80)
+    it->ascii_end = yu_str_ascii_run_end(s, len, it->offset);
+  it->offset += incr;
+  it->pos += incr;
+  *out = (uint32_t)cp;
+  return true;
+}
+
+bool rope_next_grapheme(rope_text_iter *it, size_t *start, size_t *len) {
+  uint32_t cp1, cp2;
+  rope_text_iter next;
+
+  if (!text_iter_settle(it))
+    return false;
+  *start = it->pos;
+  if (yu_str_ascii_cluster(it->offset, it->ascii_end)) {
+    ++it->offset;
+    ++it->pos;
+    *len = 1;
+    return true;
+  }
+
+  rope_next_cp(it, &cp1);
+  for (next = *it; rope_next_cp(&next, &cp2); *it = next, cp1 = cp2) {
+    if (utf8proc_grapheme_break(cp1, cp2))
+      break;
+  }
+  *len = it->pos - *start;
+  return true;
+}
 
 // Internal function for navigating to a particular character offset in the rope.
 // The function returns the list of nodes which point past the position, as well as
@@ -255,7 +469,7 @@ rope_node *iter_at_char_pos(rope *r, size_t char_pos, rope_iter *iter) {
     }
   }
 
-  assert(offset <= ROPE_NODE_STR_SIZE);
+  assert(offset <= e->nexts[0].skip_size);
   assert(iter->s[0].node == e);
   return e;
 }
@@ -268,18 +482,13 @@ void update_offset_list(rope *r, rope_iter *iter, size_t num_chars) {
 }
 
 
-// Internal method of rope_insert.
-// This function creates a new node in the rope at the specified position and fills it with the
-// passed string.
+// Links a filled in node into the rope at iter, which is moved past it.
 static
-void insert_at(rope *r, rope_iter *iter, const uint8_t *str, size_t num_bytes, size_t num_chars) {
+void insert_node_at(rope *r, rope_iter *iter, rope_node *new_node, size_t num_chars) {
 
   // This describes how many levels of the iter are filled in.
   uint8_t max_height = r->head.height;
-  uint8_t new_height = random_height(r);
-  rope_node *new_node = alloc_node(r, new_height);
-  new_node->num_bytes = num_bytes;
-  memcpy(new_node->val.str, str, num_bytes);
+  uint8_t new_height = new_node->height;
 
   assert(new_height < ROPE_MAX_HEIGHT);
 
@@ -315,12 +524,36 @@ void insert_at(rope *r, rope_iter *iter, const uint8_t *str, size_t num_bytes, s
   }
 
   r->num_chars += num_chars;
-  r->num_bytes += num_bytes;
+  r->num_bytes += new_node->num_bytes;
+}
+
+// Internal method of rope_insert.
+// This function creates a new node in the rope at the specified position and fills it with the
+// passed string.
+static
+void insert_at(rope *r, rope_iter *iter, const uint8_t *str, size_t num_bytes, size_t num_chars) {
+  rope_node *new_node = alloc_node(r, random_height(r));
+  new_node->what = ROPE_NODE_STR;
+  new_node->num_bytes = num_bytes;
+  memcpy(new_node->val.str, str, num_bytes);
+  insert_node_at(r, iter, new_node, num_chars);
+}
+
+// Like insert_at, but the node just points at bytes in r's mapping
+static
+void insert_mapped_at(rope *r, rope_iter *iter, const uint8_t *bytes, size_t num_bytes, size_t num_chars) {
+  rope_node *new_node = alloc_node(r, random_height(r));
+  new_node->what = ROPE_NODE_MAPPED;
+  new_node->num_bytes = num_bytes;
+  new_node->val.mapped = bytes;
+  insert_node_at(r, iter, new_node, num_chars);
 }
 
 // Insert the given utf8 string into the rope at the specified position.
+// If path_kept isn't NULL, it's set to whether iter is still a valid path to
+// the (unmoved) position, which is the case when the string fit in e.
 static
-ROPE_RESULT rope_insert_at_iter(rope *r, rope_node *e, rope_iter *iter, const uint8_t *str) {
+ROPE_RESULT rope_insert_at_iter(rope *r, rope_node *e, rope_iter *iter, const uint8_t *str, bool *path_kept) {
   // iter.offset contains how far (in characters) into the current element to skip.
   // Figure out how much that is in bytes.
   size_t offset_bytes = 0;
@@ -328,16 +561,19 @@ ROPE_RESULT rope_insert_at_iter(rope *r, rope_node *e, rope_iter *iter, const ui
   size_t offset = iter->s[0].skip_size;
   if (offset) {
     assert(offset <= e->nexts[0].skip_size);
-    offset_bytes = count_bytes_in_utf8(e->val.str, offset);
+    offset_bytes = count_bytes_in_utf8(rope_node_data(e), e->num_bytes, offset);
   }
 
   // We might be able to insert the new data into the current node, depending on
   // how big it is. We'll count the bytes, and also check that its valid utf8.
   ssize_t num_inserted_bytes = bytelen_and_check_utf8(str);
   if (num_inserted_bytes == -1) return ROPE_INVALID_UTF8;
+  r->edits++;
 
-  // Can we insert into the current node?
-  bool insert_here = e->num_bytes + num_inserted_bytes <= ROPE_NODE_STR_SIZE;
+  // Can we insert into the current node? Mapped ones can't be written to.
+  bool insert_here = e->what == ROPE_NODE_STR && e->num_bytes + num_inserted_bytes <= ROPE_NODE_STR_SIZE;
+  if (path_kept)
+    *path_kept = insert_here;
 
   // Can we insert into the subsequent node?
   rope_node *next = NULL;
@@ -348,7 +584,7 @@ ROPE_RESULT rope_insert_at_iter(rope *r, rope_node *e, rope_iter *iter, const ui
     // - There _is_ a next node to insert into
     // - The insert would be at the start of the next node
     // - There's room in the next node
-    if (next && next->num_bytes + num_inserted_bytes <= ROPE_NODE_STR_SIZE) {
+    if (next && next->what == ROPE_NODE_STR && next->num_bytes + num_inserted_bytes <= ROPE_NODE_STR_SIZE) {
       offset = offset_bytes = 0;
       for (int i = 0; i < next->height; i++) {
         iter->s[i].node = next;
@@ -419,7 +655,11 @@ ROPE_RESULT rope_insert_at_iter(rope *r, rope_node *e, rope_iter *iter, const ui
     }
 
     if (num_end_bytes) {
-      insert_at(r, iter, &e->val.str[offset_bytes], num_end_bytes, num_end_chars);
+      // The end of a mapped node can stay where it is
+      if (e->what == ROPE_NODE_MAPPED)
+        insert_mapped_at(r, iter, e->val.mapped + offset_bytes, num_end_bytes, num_end_chars);
+      else
+        insert_at(r, iter, &e->val.str[offset_bytes], num_end_bytes, num_end_chars);
     }
   }
 
@@ -436,19 +676,60 @@ ROPE_RESULT rope_insert(rope *r, size_t pos, const uint8_t * restrict str) {
   // First we need to search for the node where we'll insert the string.
   rope_node *e = iter_at_char_pos(r, pos, &iter);
 
-  rope_result_t result = rope_insert_at_iter(r, e, &iter, str);
+  rope_result_t result = rope_insert_at_iter(r, e, &iter, str, NULL);
 
   ROPE_CHECK(r);
 
   return result;
 }
 
-// Delete num characters at position pos. Deleting past the end of the string
-// has no effect.
+rope *rope_new_from_file(yu_allocator *mctx, sfmt_t *rng, const char *path) {
+  const void *addr;
+  size_t size = yu_file_map(&addr, path);
+  if (addr == NULL)
+    return NULL;
+
+  rope *r = rope_new(mctx, rng);
+  r->mapping = yu_xalloc(mctx, 1, sizeof(struct rope_mapping));
+  r->mapping->addr = addr;
+  r->mapping->size = size;
+  r->mapping->refs = 1;
+
+  rope_iter iter;
+  iter_at_char_pos(r, 0, &iter);
+  const uint8_t *bytes = addr;
+  size_t start = 0;
+  while (start < size) {
+    // Chunks end on a character boundary, a few bytes past a whole number of
+    // pages
+    size_t end = min(start + ROPE_MAPPED_CHUNK, size);
+    while (end < size && end - start < UINT16_MAX && (bytes[end] & 0xc0) == 0x80)
+      end++;
+
+    size_t num_chars = count_chars_checked(&bytes[start], end - start);
+    if (num_chars == SIZE_MAX) {
+      rope_free(r);
+      return NULL;
+    }
+    insert_mapped_at(r, &iter, &bytes[start], end - start, num_chars);
+    start = end;
+  }
+
+  ROPE_CHECK(r);
+  return r;
+}
+
+// Delete num characters at position pos (which iter leads to). Deleting past
+// the end of the string has no effect.
 static
-void rope_del_at_iter(rope *r, rope_node *e, rope_iter *iter, size_t length) {
+void rope_del_at_iter(rope *r, rope_node *e, rope_iter *iter, size_t pos, size_t length) {
   r->num_chars -= length;
+  r->edits++;
   size_t offset = iter->s[0].skip_size;
+  // What's left of a mapped node after deleting from its middle, which goes
+  // back in as a node of its own
+  const uint8_t *tail = NULL;
+  size_t tail_bytes = 0, tail_chars = 0;
   while (length) {
     if (offset == e->nexts[0].skip_size) {
       // End of the current node. Skip to the start of the next one.
@@ -458,21 +739,35 @@ void rope_del_at_iter(rope *r, rope_node *e, rope_iter *iter, size_t length) {
 
     size_t num_chars = e->nexts[0].skip_size;
     size_t removed = min(length, num_chars - offset);
+    // The number of characters taken out of the skip list, which includes any tail
+    size_t dropped = removed;
 
     int i;
     if (removed < num_chars || e == &r->head) {
       // Just trim this node down to size.
-      size_t leading_bytes = count_bytes_in_utf8(e->val.str, offset);
-      size_t removed_bytes = count_bytes_in_utf8(&e->val.str[leading_bytes], removed);
+      const uint8_t *bytes = rope_node_data(e);
+      size_t leading_bytes = count_bytes_in_utf8(bytes, e->num_bytes, offset);
+      size_t removed_bytes = count_bytes_in_utf8(&bytes[leading_bytes], e->num_bytes - leading_bytes, removed);
       size_t trailing_bytes = e->num_bytes - leading_bytes - removed_bytes;
-      if (trailing_bytes) {
+      if (e->what == ROPE_NODE_MAPPED) {
+        if (leading_bytes == 0) {
+          e->val.mapped += removed_bytes;
+        } else if (trailing_bytes) {
+          tail = &bytes[leading_bytes + removed_bytes];
+          tail_bytes = trailing_bytes;
+          tail_chars = num_chars - offset - removed;
+          removed_bytes += tail_bytes;
+          dropped += tail_chars;
+          r->num_chars -= tail_chars;
+        }
+      } else if (trailing_bytes) {
         memmove(&e->val.str[leading_bytes], &e->val.str[leading_bytes + removed_bytes], trailing_bytes);
       }
       e->num_bytes -= removed_bytes;
       r->num_bytes -= removed_bytes;
 
       for (i = 0; i < e->height; i++) {
-        e->nexts[i].skip_size -= removed;
+        e->nexts[i].skip_size -= dropped;
       }
     } else {
       // Remove the node from the list
@@ -482,18 +777,24 @@ void rope_del_at_iter(rope *r, rope_node *e, rope_iter *iter, size_t length) {
       }
 
       r->num_bytes -= e->num_bytes;
-      // TODO: Recycle e.
       rope_node *next = e->nexts[0].node;
-      yu_free(r->mem_ctx, e);
+      free_node(r, e);
       e = next;
     }
 
     for (; i < r->head.height; i++) {
-      iter->s[i].node->nexts[i].skip_size -= removed;
+      iter->s[i].node->nexts[i].skip_size -= dropped;
     }
 
     length -= removed;
   }
+
+  if (tail) {
+    // e now ends at pos, so that's where a search from the head comes out
+    rope_iter tail_iter;
+    iter_at_char_pos(r, pos, &tail_iter);
+    insert_mapped_at(r, &tail_iter, tail, tail_bytes, tail_chars);
+  }
 }
 
 void rope_del(rope *r, size_t pos, size_t length) {
@@ -508,11 +809,243 @@ void rope_del(rope *r, size_t pos, size_t length) {
   // Search for the node where we'll insert the string.
   rope_node *e = iter_at_char_pos(r, pos, &iter);
 
-  rope_del_at_iter(r, e, &iter, length);
+  rope_del_at_iter(r, e, &iter, pos, length);
 
   ROPE_CHECK(r);
 }
 
+void rope_cursor_init(rope_cursor *c, rope *r, size_t pos) {
+  c->r = r;
+  c->pos = min(pos, r->num_chars);
+  // Nothing's been found yet
+  c->edits = r->edits - 1;
+}
+
+void rope_cursor_seek(rope_cursor *c, size_t pos) {
+  c->pos = min(pos, c->r->num_chars);
+}
+
+// The node c->pos is in, with c->path leading to it. The path is reused if
+// nothing's changed the rope since it was found (or kept up to date) and
+// c->pos is still in the same node; that's just a matter of adding the
+// distance moved to each level's offset.
+static
+rope_node *cursor_node(rope_cursor *c) {
+  rope *r = c->r;
+  // Deletes made around the cursor can leave it past the end
+  if (c->edits != r->edits)
+    c->pos = min(c->pos, r->num_chars);
+  else {
+    rope_node *e = c->path.s[0].node;
+    size_t node_start = c->path_pos - c->path.s[0].skip_size;
+    // At the very start of a node iter_at_char_pos would give the end of the
+    // one before; inserting at offset 0 would split e and leave it empty
+    if ((c->pos > node_start || (c->pos == node_start && e == &r->head)) &&
+        c->pos <= node_start + e->nexts[0].skip_size) {
+      for (int i = 0; i < r->head.height; i++)
+        c->path.s[i].skip_size += c->pos - c->path_pos;  // Wraps around when moving back; that's fine
+      c->path_pos = c->pos;
+      return e;
+    }
+  }
+  c->edits = r->edits;
+  c->path_pos = c->pos;
+  return iter_at_char_pos(r, c->pos, &c->path);
+}
+
+ROPE_RESULT rope_cursor_insert(rope_cursor *c, const uint8_t * restrict str) {
+  assert(str);
+  rope *r = c->r;
+  ROPE_CHECK(r);
+  size_t chars_before = r->num_chars;
+  bool path_kept;
+
+  rope_node *e = cursor_node(c);
+  rope_result_t result = rope_insert_at_iter(r, e, &c->path, str, &path_kept);
+  if (result == ROPE_OK) {
+    if (path_kept)
+      c->edits = r->edits;
+    c->pos += r->num_chars - chars_before;
+  }
+
+  ROPE_CHECK(r);
+  return result;
+}
+
+void rope_cursor_del(rope_cursor *c, size_t num) {
+  rope *r = c->r;
+  ROPE_CHECK(r);
+  rope_node *e = cursor_node(c);
+  num = min(num, r->num_chars - c->pos);
+  if (num == 0)
+    return;
+
+  // The path only stays valid if this just trims e (in place)
+  size_t offset = c->path.s[0].skip_size, node_chars = e->nexts[0].skip_size;
+  bool path_kept = e->what == ROPE_NODE_STR && offset + num <= node_chars && (num < node_chars || e == &r->head);
+  rope_del_at_iter(r, e, &c->path, c->pos, num);
+  if (path_kept)
+    c->edits = r->edits;
+
+  ROPE_CHECK(r);
+}
+
+// The number of characters in len bytes of utf8 (which start on a character)
+static YU_PURE
+size_t count_chars(const uint8_t *str, size_t len) {
+  size_t chars = 0, i = 0;
+#ifdef __SSE2__
+  // Every byte but a continuation byte (0x80-0xbf, or less than -64 signed)
+  // starts a character; psadbw adds up 16 of them at a time
+  const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1), cont_max = _mm_set1_epi8((char)0xbf);
+  __m128i sums = zero;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&str[i]);
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_and_si128(_mm_cmpgt_epi8(v, cont_max), one), zero));
+  }
+  uint64_t halves[2];
+  _mm_storeu_si128((__m128i *)halves, sums);
+  chars = halves[0] + halves[1];
+#endif
+  for (; i < len; i++)
+    chars += (str[i] & 0xc0) != 0x80;
+  return chars;
+}
+
+// Whether the bytes from offset in e onwards start with needle, which may
+// carry on into the nodes after e
+static
+bool matches_at(const rope_node *e, size_t offset, const uint8_t *needle, size_t len) {
+  while (true) {
+    size_t n = min(len, e->num_bytes - offset);
+    if (memcmp(rope_node_data(e) + offset, needle, n) != 0)
+      return false;
+    needle += n;
+    len -= n;
+    if (len == 0)
+      return true;
+    if ((e = e->nexts[0].node) == NULL)
+      return false;
+    offset = 0;
+  }
+}
+
+// The byte offset of the first match of needle in e at or after offset
+// (which may carry on into the nodes after e), or SIZE_MAX if there isn't
+// one. needle's first byte starts a character, so anywhere it turns up is a
+// character boundary.
+static
+size_t find_in_node(const rope_node *e, size_t offset, const uint8_t *needle, size_t len) {
+  const uint8_t *bytes = rope_node_data(e);
+  size_t end = e->num_bytes;
+#ifdef __SSE2__
+  // Matches that fit in e are picked out by their first, second and last
+  // bytes, 16 places at a time, which rules out far more than the first byte
+  // alone (for two byte needles the second byte is the last)
+  if (len > 1) {
+    const __m128i first = _mm_set1_epi8(needle[0]), second = _mm_set1_epi8(needle[1]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    for (; offset + len - 1 + 16 <= end; offset += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i *)&bytes[offset]);
+      __m128i b = _mm_loadu_si128((const __m128i *)&bytes[offset + 1]);
+      __m128i c = _mm_loadu_si128((const __m128i *)&bytes[offset + len - 1]);
+      __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, second));
+      uint32_t mask = _mm_movemask_epi8(_mm_and_si128(eq, _mm_cmpeq_epi8(c, last)));
+      for (; mask; mask &= mask - 1) {
+        size_t hit = offset + __builtin_ctz(mask), i = 2;
+        // Needles are mostly short enough that calling memcmp costs more
+        while (i < len - 1 && bytes[hit + i] == needle[i])
+          i++;
+        if (i >= len - 1)
+          return hit;
+      }
+    }
+  }
+#endif
+  // The rest, including those that cross into the next node
+  while (offset < end) {
+    const uint8_t *hit = memchr(&bytes[offset], needle[0], end - offset);
+    if (hit == NULL)
+      break;
+    offset = hit - bytes;
+    if (len == 1 || matches_at(e, offset, needle, len))
+      return offset;
+    offset++;
+  }
+  return SIZE_MAX;
+}
+
+// Searches for len bytes of needle from character pos start, calling cb (if
+// there is one) for each match until it returns nonzero. Returns the number of
+// matches cb was called for.
+static
+size_t find_from(rope *r, const uint8_t *needle, size_t len, size_t start, rope_find_fn cb, void *data) {
+  rope_iter iter;
+  size_t found = 0;
+  const rope_node *e = iter_at_char_pos(r, start, &iter);
+  // The search is up to byte offset of e, which is chars_in characters past
+  // node_pos, the position e starts at
+  size_t chars_in = iter.s[0].skip_size, node_pos = start - chars_in;
+  size_t offset = count_bytes_in_utf8(rope_node_data(e), e->num_bytes, chars_in);
+
+  while (e != NULL) {
+    size_t hit = find_in_node(e, offset, needle, len);
+    if (hit == SIZE_MAX) {
+      node_pos += e->nexts[0].skip_size;
+      chars_in = offset = 0;
+      e = e->nexts[0].node;
+      continue;
+    }
+
+    // Characters are only counted up to actual matches
+    chars_in += count_chars(&rope_node_data(e)[offset], hit - offset);
+    offset = hit;
+    found++;
+    if (cb != NULL && cb(node_pos + chars_in, data))
+      break;
+
+    // Carry on after the match, which may end in a later node
+    size_t skip = len;
+    while (skip > e->num_bytes - offset) {
+      skip -= e->num_bytes - offset;
+      node_pos += e->nexts[0].skip_size;
+      chars_in = offset = 0;
+      e = e->nexts[0].node;
+    }
+    chars_in += count_chars(&rope_node_data(e)[offset], skip);
+    offset += skip;
+  }
+  return found;
+}
+
+static
+uint32_t stop_at_first(size_t pos, void *data) {
+  *(size_t *)data = pos;
+  return 1;
+}
+
+size_t rope_find(rope *r, const uint8_t * restrict needle, size_t start) {
+  assert(r);
+  assert(needle);
+  start = min(start, r->num_chars);
+  ssize_t len = bytelen_and_check_utf8(needle);
+  if (len <= 0)
+    return len == 0 ? start : SIZE_MAX;
+
+  size_t pos = SIZE_MAX;
+  find_from(r, needle, len, start, stop_at_first, &pos);
+  return pos;
+}
+
+size_t rope_find_all(rope *r, const uint8_t * restrict needle, rope_find_fn cb, void *data) {
+  assert(r);
+  assert(needle);
+  ssize_t len = bytelen_and_check_utf8(needle);
+  if (len <= 0)
+    return 0;
+  return find_from(r, needle, len, 0, cb, data);
+}
+
 void _rope_check(rope *r) {
   assert(r->head.height); // Even empty ropes have a height of 1.
   assert(r->num_bytes >= r->num_chars);
@@ -534,7 +1067,7 @@ void _rope_check(rope *r) {
   for (rope_node *n = &r->head; n != NULL; n = n->nexts[0].node) {
     assert(n == &r->head || n->num_bytes);
     assert(n->height <= ROPE_MAX_HEIGHT);
-    assert(count_bytes_in_utf8(n->val.str, n->nexts[0].skip_size) == n->num_bytes);
+    assert(count_bytes_in_utf8(rope_node_data(n), n->num_bytes, n->nexts[0].skip_size) == n->num_bytes);
     for (int i = 0; i < n->height; i++) {
       assert(iter.s[i].node == n);
       assert(iter.s[i].skip_size == num_chars);
@@ -572,7 +1105,7 @@ void _rope_print(rope *r) {
       printf(" |%3zd ", n->nexts[i].skip_size);
     }
     printf("        : \"");
-    fwrite(n->val.str, n->num_bytes, 1, stdout);
+    fwrite(rope_node_data(n), n->num_bytes, 1, stdout);
     printf("\"\n");
   }
 }
@@ -35,7 +35,25 @@
 #define ROPE_MAX_HEIGHT 60
 #endif
 
+// Nodes are carved out of slabs, which belong to the rope and are only given
+// back by rope_free. The first slab is ROPE_MIN_SLAB_SIZE bytes and each one
+// after is twice the last, up to ROPE_SLAB_SIZE.
+#ifndef ROPE_MIN_SLAB_SIZE
+#define ROPE_MIN_SLAB_SIZE 1024
+#endif
+#ifndef ROPE_SLAB_SIZE
+#define ROPE_SLAB_SIZE 16384
+#endif
+
+// rope_new_from_file splits the file into nodes of about this many bytes,
+// which are left in the mapping until they're edited. Must be < UINT16_MAX.
+#ifndef ROPE_MAPPED_CHUNK
+#define ROPE_MAPPED_CHUNK 32768
+#endif
+
 struct rope_node_t;
+struct rope_slab;
+struct rope_mapping;
 
 // The number of characters in str can be read out of nexts[0].skip_size.
 typedef struct {
@@ -48,12 +66,16 @@ typedef struct {
   struct rope_node_t *node;
 } rope_skip_node;
 
-typedef enum { ROPE_NODE_STR, ROPE_NODE_STREAM, ROPE_NODE_FUNC } rope_node_type;
+// Mapped nodes point into the file a rope was made from instead of holding
+// their bytes. They can be cut short at either end, but anything else turns
+// the edited part into str nodes.
+typedef enum { ROPE_NODE_STR, ROPE_NODE_STREAM, ROPE_NODE_FUNC, ROPE_NODE_MAPPED } rope_node_type;
 typedef size_t (* rope_fn)(uint8_t *out, size_t start, size_t end, void *data);
 
 typedef struct rope_node_t {
   union {
     uint8_t str[ROPE_NODE_STR_SIZE];
+    const uint8_t *mapped;
     FILE *stream;
     struct {
       rope_fn func;
@@ -63,7 +85,7 @@ typedef struct rope_node_t {
 
   rope_node_type what;
 
-  // The number of bytes in str in use
+  // The number of bytes in str (or at mapped) in use
   uint16_t num_bytes;
 
   // This is the number of elements allocated in nexts.
@@ -83,6 +105,25 @@ typedef struct {
   yu_allocator *mem_ctx;
   sfmt_t *rng;
 
+  // Bumped by every insert and delete, so rope_cursors can tell whether
+  // their path is still good
+  uint64_t edits;
+
+  // Random bits for node heights, drawn from rng SFMT_N64 words at a time
+  // (NULL until the first node is made). rand_pos counts the 16-bit chunks
+  // used so far.
+  uint64_t *rand_buf;
+  uint32_t rand_pos;
+
+  struct rope_slab *slabs;
+  // Deleted nodes of each height, linked through nexts[0].node, which are
+  // reused before any more are carved out of a slab
+  struct rope_node_t *free_nodes[ROPE_MAX_HEIGHT];
+
+  // The file mapped nodes point into, shared with copies of the rope (NULL
+  // if there isn't one)
+  struct rope_mapping *mapping;
+
   // The first node exists inline in the rope structure itself.
   rope_node head;
 } rope;
@@ -94,6 +135,14 @@ rope *rope_new(yu_allocator *mctx, sfmt_t *rng);
 // r = rope_new(); rope_insert(r, 0, str);
 rope *rope_new_with_utf8(yu_allocator *mctx, sfmt_t *rng, const uint8_t * restrict str);
 
+// Create a new rope with the contents of the file at path, which is mapped
+// rather than read. Only the parts of it that are edited are ever copied, but
+// it's still scanned once up front to count (and check) its characters.
+// Returns NULL if the file can't be mapped or isn't valid UTF-8 (NUL bytes
+// aren't allowed either). The file mustn't change while the rope (or any
+// copy of it) is around.
+rope *rope_new_from_file(yu_allocator *mctx, sfmt_t *rng, const char *path);
+
 // Make a copy of an existing rope
 rope *rope_copy(const rope *r);
 
@@ -130,6 +179,53 @@ ROPE_RESULT rope_insert(rope *r, size_t pos, const uint8_t * restrict str);
 // has no effect.
 void rope_del(rope *r, size_t pos, size_t num);
 
+typedef struct {
+  // This stores the previous node at each height, and the number of characters from the start of
+  // the previous node to the current iterator position.
+  rope_skip_node s[ROPE_MAX_HEIGHT];
+} rope_iter;
+
+// A position in a rope that remembers the path to it. rope_insert and
+// rope_del search from the head for every edit; edits made through a cursor
+// reuse its path as long as they stay within one node, which is what typing
+// (or deleting) a character at a time mostly does. Edits made any other way,
+// including through other cursors, just make it search again.
+typedef struct {
+  rope *r;
+  // In characters
+  size_t pos;
+
+  rope_iter path;
+  // Where path leads, which lags behind pos until the next edit
+  size_t path_pos;
+  // The rope's edits when path was last known to be good
+  uint64_t edits;
+} rope_cursor;
+
+void rope_cursor_init(rope_cursor *c, rope *r, size_t pos);
+// Moving past the end of the rope puts the cursor at the end. Edits made any
+// other way don't move the cursor, but it's pulled back to the end if they
+// leave the rope shorter than its position.
+void rope_cursor_seek(rope_cursor *c, size_t pos);
+// Inserts str at the cursor and moves it past str
+ROPE_RESULT rope_cursor_insert(rope_cursor *c, const uint8_t * restrict str);
+// Deletes num characters after the cursor, which stays put
+void rope_cursor_del(rope_cursor *c, size_t num);
+
+// Finds the first occurrence of the utf8 string needle at or after character
+// pos start, and returns its position in characters. Returns SIZE_MAX if there
+// isn't one (or needle isn't valid utf8). An empty needle is found at start.
+size_t rope_find(rope *r, const uint8_t * restrict needle, size_t start);
+
+// Called with the character position of each match. Returning nonzero stops
+// the search.
+typedef uint32_t (* rope_find_fn)(size_t pos, void *data);
+
+// Calls cb for each occurrence of needle in the rope, in order. Matches don't
+// overlap; the search carries on after the end of each one. Returns the number
+// of matches cb was called for (none for an empty needle).
+size_t rope_find_all(rope *r, const uint8_t * restrict needle, rope_find_fn cb, void *data);
+
 // This macro expands to a for() loop header which loops over the segments in a
 // rope.
 //
@@ -143,8 +239,8 @@ void rope_del(rope *r, size_t pos, size_t num);
 
 // Get the actual data inside a rope node.
 YU_INLINE
-uint8_t *rope_node_data(rope_node *n) {
-  return n->val.str;
+const uint8_t *rope_node_data(const rope_node *n) {
+  return n->what == ROPE_NODE_MAPPED ? n->val.mapped : n->val.str;
 }
 
 // Get the number of bytes inside a rope node. This is useful when you're
@@ -160,6 +256,26 @@ size_t rope_node_chars(const rope_node *n) {
   return n->nexts[0].skip_size;
 }
 
+// Iterates over the bytes, code points or grapheme clusters of a rope in
+// place, a node at a time, rather than copying it out with rope_create_cstr.
+// Kinds can be mixed as long as the iterator is at a cluster (or code point)
+// boundary when asking for one. The rope mustn't be changed while iterating.
+typedef struct {
+  const rope_node *node;
+  // Position of the next byte within node
+  size_t offset;
+  // Position of the next byte within the whole rope
+  size_t pos;
+  // Bytes of node before this are plain ASCII (see yu_str_plain_ascii_prefix)
+  size_t ascii_end;
+} rope_text_iter;
+
+void rope_text_iter_init(rope_text_iter *it, const rope *r);
+// Each returns false at the end of the rope
+bool rope_next_byte(rope_text_iter *it, uint8_t *out);
+bool rope_next_cp(rope_text_iter *it, uint32_t *out);
+// The cluster is bytes [*start, *start + *len) of the rope; it may span nodes
+bool rope_next_grapheme(rope_text_iter *it, size_t *start, size_t *len);
 
 // For debugging.
 void _rope_check(rope *r);
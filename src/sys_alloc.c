@@ -7,8 +7,17 @@
 #include "internal_alloc.h"
 #include "sys_alloc.h"
 
-#define addrhash_1(x) ((uintptr_t)(x))
-#define addrhash_2(x) (~(uintptr_t)(x))
+// Blocks and especially arenas are aligned to big powers of 2, so the low
+// bits of an address (the ones the table indexes by) tend to be the same for
+// every key. Fold the high half of a multiply back down to spread them.
+YU_INLINE
+u64 addrhash(uintptr_t p, u64 k) {
+  u64 x = (u64)p * k;
+  return x ^ (x >> 32);
+}
+
+#define addrhash_1(x) addrhash((uintptr_t)(x), UINT64_C(0x9E3779B97F4A7C15))
+#define addrhash_2(x) addrhash((uintptr_t)(x), UINT64_C(0xC2B2AE3D27D4EB4F))
 #define addr_eq(x,y) ((x)==(y))
 
 YU_HASHTABLE_IMPL(sysmem_tbl, void *, size_t, addrhash_1, addrhash_2, addr_eq)
@@ -36,6 +45,7 @@ yu_err sys_alloc_ctx_init(sys_allocator *ctx) {
   ctx->base.release = (yu_release_fn)sys_release;
   ctx->base.commit = (yu_commit_fn)sys_commit;
   ctx->base.decommit = (yu_decommit_fn)sys_decommit;
+  ctx->base.limits = NULL;
 
   return YU_OK;
 }
@@ -0,0 +1,361 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "tl_alloc.h"
+
+// Sits directly in front of every block handed out. 32 bytes, so blocks
+// carved from a 16-byte aligned slab stay 16-byte aligned.
+struct tl_block {
+  struct tl_pool *pool;
+  // Magazine or remote-free queue link while the block is free
+  struct tl_block *next;
+  u64 size;    // requested size
+  u32 cls;     // size class, or TL_LARGE_CLASS
+  u32 offset;  // large blocks: distance from the start of the backing allocation
+};
+
+struct tl_slab {
+  struct tl_slab *next;
+  u64 _pad;
+};
+
+// Large blocks are linked together so the context can free them en masse.
+struct tl_large {
+  struct tl_large *prev, *next;
+};
+
+#define HDR(ptr) ((struct tl_block *)(ptr) - 1)
+
+static
+void heap_lock(tl_heap *heap) {
+  while (__atomic_test_and_set(&heap->lock, __ATOMIC_ACQUIRE)) { }
+}
+
+static
+void heap_unlock(tl_heap *heap) {
+  __atomic_clear(&heap->lock, __ATOMIC_RELEASE);
+}
+
+void tl_heap_init(tl_heap *heap, yu_allocator *backing) {
+  heap->backing = backing;
+  heap->lock = false;
+  heap->orphans = NULL;
+}
+
+yu_err tl_alloc_ctx_init(tl_allocator *ctx, tl_heap *heap) {
+  memset(ctx, 0, sizeof(tl_allocator));
+
+  ctx->base.alloc = (yu_alloc_fn)tl_alloc;
+  ctx->base.realloc = (yu_realloc_fn)tl_realloc;
+  ctx->base.free = (yu_free_fn)tl_free;
+  ctx->base.free_ctx = (yu_ctx_free_fn)tl_alloc_ctx_free;
+  ctx->base.allocated_size = (yu_allocated_size_fn)tl_allocated_size;
+  ctx->base.usable_size = (yu_usable_size_fn)tl_usable_size;
+  ctx->base.reserve = (yu_reserve_fn)tl_reserve;
+  ctx->base.release = (yu_release_fn)tl_release;
+  ctx->base.commit = (yu_commit_fn)tl_commit;
+  ctx->base.decommit = (yu_decommit_fn)tl_decommit;
+
+  ctx->heap = heap;
+
+  heap_lock(heap);
+  if ((ctx->pool = heap->orphans) != NULL)
+    heap->orphans = ctx->pool->next;
+  else if (yu_alloc(heap->backing, (void **)&ctx->pool, 1, sizeof(struct tl_pool), 0) != YU_OK)
+    ctx->pool = NULL;
+  heap_unlock(heap);
+  if (ctx->pool == NULL)
+    return YU_ERR_ALLOC_FAIL;
+  ctx->pool->ctx = ctx;
+  ctx->pool->next = NULL;
+
+  if (internal_alloc_ctx_init(&ctx->tbl_mctx) != YU_OK)
+    return YU_ERR_ALLOC_FAIL;
+  sysmem_pgtbl_init(&ctx->pgs, 20, &ctx->tbl_mctx);
+
+  return YU_OK;
+}
+
+static
+u32 release_ctx_all(void *page, size_t YU_UNUSED(sz), void *data) {
+  // Not yu_release: that leaves the backing allocator's own record of the
+  // pages behind, and it would release them again when it's freed itself.
+  yu_free(((tl_allocator *)data)->heap->backing, page);
+  return 0;
+}
+
+void tl_alloc_ctx_free(tl_allocator *ctx) {
+  yu_allocator *backing = ctx->heap->backing;
+  struct tl_pool *pool = ctx->pool;
+  struct tl_slab *s = pool->slabs, *snext;
+  struct tl_large *l = pool->large, *lnext;
+
+  // Anything pushed after this is still counted as live, so it ends up on the
+  // orphan's queue rather than in a freed slab.
+  tl_drain_remote(ctx);
+
+  heap_lock(ctx->heap);
+  sysmem_pgtbl_iter(&ctx->pgs, release_ctx_all, ctx);
+  if (pool->live != 0) {
+    pool->ctx = NULL;
+    pool->next = ctx->heap->orphans;
+    ctx->heap->orphans = pool;
+  }
+  else {
+    while (s) {
+      snext = s->next;
+      yu_free(backing, s);
+      s = snext;
+    }
+    while (l) {
+      lnext = l->next;
+      yu_free(backing, l);
+      l = lnext;
+    }
+    yu_free(backing, pool);
+  }
+  heap_unlock(ctx->heap);
+
+  sysmem_pgtbl_free(&ctx->pgs);
+  yu_alloc_ctx_free(&ctx->tbl_mctx);
+}
+
+static
+u32 size_class(size_t sz) {
+  // yu_ceil_log2(0) is undefined; zero-byte requests share the smallest class
+  u32 k = sz ? yu_ceil_log2(sz) : 0;
+  return k < TL_MIN_CLASS_SHIFT ? 0 : k - TL_MIN_CLASS_SHIFT;
+}
+
+static YU_CONST
+size_t class_size(u32 cls) {
+  return (size_t)1 << (cls + TL_MIN_CLASS_SHIFT);
+}
+
+static
+void release_block(tl_allocator *ctx, struct tl_block *b) {
+  struct tl_pool *pool = ctx->pool;
+  pool->live--;
+  if (b->cls == TL_LARGE_CLASS) {
+    struct tl_large *l = (struct tl_large *)((u8 *)b - b->offset);
+    if (l->prev)
+      l->prev->next = l->next;
+    else
+      pool->large = l->next;
+    if (l->next)
+      l->next->prev = l->prev;
+    heap_lock(ctx->heap);
+    yu_free(ctx->heap->backing, l);
+    heap_unlock(ctx->heap);
+  }
+  else {
+    b->next = pool->magazines[b->cls];
+    pool->magazines[b->cls] = b;
+  }
+}
+
+void tl_drain_remote(tl_allocator *ctx) {
+  struct tl_block *b = __atomic_exchange_n(&ctx->pool->remote, NULL, __ATOMIC_ACQUIRE), *next;
+  while (b) {
+    next = b->next;
+    release_block(ctx, b);
+    b = next;
+  }
+}
+
+static
+struct tl_block *carve_block(tl_allocator *ctx, u32 cls) {
+  struct tl_pool *pool = ctx->pool;
+  size_t need = sizeof(struct tl_block) + class_size(cls);
+  struct tl_slab *s;
+
+  if (pool->bump == NULL || (size_t)(pool->bump_end - pool->bump) < need) {
+    yu_err err;
+    heap_lock(ctx->heap);
+    err = yu_alloc(ctx->heap->backing, (void **)&s, 1, TL_SLAB_SIZE, TL_DEFAULT_ALIGNMENT);
+    heap_unlock(ctx->heap);
+    if (err != YU_OK)
+      return NULL;
+    // Whatever was left of the previous slab is too small to be worth keeping
+    // track of; it gets freed with the slab when the pool goes away.
+    s->next = pool->slabs;
+    pool->slabs = s;
+    pool->bump = (u8 *)(s + 1);
+    pool->bump_end = (u8 *)s + TL_SLAB_SIZE;
+  }
+
+  struct tl_block *b = (struct tl_block *)pool->bump;
+  pool->bump += need;
+  b->pool = pool;
+  b->cls = cls;
+  b->offset = 0;
+  return b;
+}
+
+static
+yu_err alloc_large(tl_allocator *ctx, void **out, size_t sz, size_t alignment) {
+  yu_err err;
+  u8 *raw, *user;
+  size_t extra = alignment > TL_DEFAULT_ALIGNMENT ? alignment : 0;
+
+  heap_lock(ctx->heap);
+  err = yu_alloc(ctx->heap->backing, (void **)&raw, 1,
+                 sizeof(struct tl_large) + sizeof(struct tl_block) + sz + extra, TL_DEFAULT_ALIGNMENT);
+  heap_unlock(ctx->heap);
+  if (err != YU_OK)
+    return err;
+
+  user = raw + sizeof(struct tl_large) + sizeof(struct tl_block);
+  if (extra)
+    user = (u8 *)(((uintptr_t)user + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+  struct tl_pool *pool = ctx->pool;
+  struct tl_large *l = (struct tl_large *)raw;
+  l->prev = NULL;
+  l->next = pool->large;
+  if (pool->large)
+    pool->large->prev = l;
+  pool->large = l;
+  pool->live++;
+
+  struct tl_block *b = HDR(user);
+  b->pool = pool;
+  b->size = sz;
+  b->cls = TL_LARGE_CLASS;
+  b->offset = (u32)((u8 *)b - raw);
+  *out = user;
+  return YU_OK;
+}
+
+yu_err tl_alloc(tl_allocator *ctx, void **out, size_t num, size_t elem_size, size_t alignment) {
+  size_t sz = num * elem_size;
+  u32 cls;
+  struct tl_block *b;
+
+  assert(alignment == 0 || (alignment & (alignment - 1)) == 0);
+  if (alignment > TL_DEFAULT_ALIGNMENT || sz > class_size(TL_NUM_CLASSES - 1))
+    return alloc_large(ctx, out, sz, alignment);
+
+  struct tl_pool *pool = ctx->pool;
+  cls = size_class(sz);
+  if (pool->magazines[cls] == NULL && __atomic_load_n(&pool->remote, __ATOMIC_RELAXED) != NULL)
+    tl_drain_remote(ctx);
+
+  if ((b = pool->magazines[cls]) != NULL) {
+    pool->magazines[cls] = b->next;
+    memset(b + 1, 0, sz);
+  }
+  else if ((b = carve_block(ctx, cls)) == NULL)
+    return YU_ERR_ALLOC_FAIL;
+
+  // Slab memory is zeroed by the backing allocator and recycled blocks were
+  // cleared above, but bytes past `sz` may still hold old data. tl_realloc
+  // takes care of that if the block grows in place.
+  b->size = sz;
+  pool->live++;
+  *out = b + 1;
+  return YU_OK;
+}
+
+yu_err tl_realloc(tl_allocator *ctx, void **ptr, size_t num, size_t elem_size, size_t alignment) {
+  struct tl_block *b = HDR(*ptr);
+  size_t sz = num * elem_size;
+  void *fresh;
+  yu_err err;
+
+  if (b->pool == ctx->pool && b->cls != TL_LARGE_CLASS &&
+      alignment <= TL_DEFAULT_ALIGNMENT && sz <= class_size(b->cls)) {
+    if (sz > b->size)
+      memset((u8 *)*ptr + b->size, 0, sz - b->size);
+    b->size = sz;
+    return YU_OK;
+  }
+
+  if ((err = tl_alloc(ctx, &fresh, 1, sz, alignment)) != YU_OK)
+    return err;
+  memcpy(fresh, *ptr, min(sz, (size_t)b->size));
+  tl_free(ctx, *ptr);
+  *ptr = fresh;
+  return YU_OK;
+}
+
+void tl_free(tl_allocator *ctx, void *ptr) {
+  size_t pgsz = yu_virtual_pagesize(0)-1;
+  if (((uintptr_t)ptr & pgsz) == 0 && sysmem_pgtbl_remove(&ctx->pgs, ptr, NULL)) {
+    heap_lock(ctx->heap);
+    yu_free(ctx->heap->backing, ptr);
+    heap_unlock(ctx->heap);
+    return;
+  }
+
+  struct tl_block *b = HDR(ptr);
+  struct tl_pool *pool = b->pool;
+  if (pool == ctx->pool) {
+    release_block(ctx, b);
+    return;
+  }
+
+  // Somebody else's block: hand it back to them. Only the owner ever pops
+  // from this stack (and it takes the whole thing at once), so a plain CAS
+  // push doesn't suffer from ABA. The pool can't go away under us even if its
+  // context does, since this block still counts as live until it's drained.
+  struct tl_block *head = __atomic_load_n(&pool->remote, __ATOMIC_RELAXED);
+  do {
+    b->next = head;
+  } while (!__atomic_compare_exchange_n(&pool->remote, &head, b, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+size_t tl_allocated_size(tl_allocator *ctx, void *ptr) {
+  size_t sz;
+  if (((uintptr_t)ptr & (yu_virtual_pagesize(0)-1)) == 0 && sysmem_pgtbl_get(&ctx->pgs, ptr, &sz))
+    return sz;
+  return HDR(ptr)->size;
+}
+
+size_t tl_usable_size(tl_allocator *ctx, void *ptr) {
+  if (((uintptr_t)ptr & (yu_virtual_pagesize(0)-1)) == 0 && sysmem_pgtbl_get(&ctx->pgs, ptr, NULL))
+    return yu_usable_size(ctx->heap->backing, ptr);
+  struct tl_block *b = HDR(ptr);
+  return b->cls == TL_LARGE_CLASS ? b->size : class_size(b->cls);
+}
+
+tl_allocator *tl_block_owner(void *ptr) {
+  return HDR(ptr)->pool->ctx;
+}
+
+yu_err tl_reserve(tl_allocator *ctx, void **out, size_t num, size_t elem_size) {
+  yu_err err;
+  heap_lock(ctx->heap);
+  err = yu_reserve(ctx->heap->backing, out, num, elem_size);
+  heap_unlock(ctx->heap);
+  if (err == YU_OK)
+    sysmem_pgtbl_put(&ctx->pgs, *out, num * elem_size, NULL);
+  return err;
+}
+
+yu_err tl_commit(tl_allocator *ctx, void *ptr, size_t num, size_t elem_size) {
+  yu_err err;
+  heap_lock(ctx->heap);
+  err = yu_commit(ctx->heap->backing, ptr, num, elem_size);
+  heap_unlock(ctx->heap);
+  return err;
+}
+
+yu_err tl_release(tl_allocator *ctx, void *ptr) {
+  if (!sysmem_pgtbl_remove(&ctx->pgs, ptr, NULL))
+    return YU_ERR_ALLOC_FAIL;
+  heap_lock(ctx->heap);
+  yu_free(ctx->heap->backing, ptr);
+  heap_unlock(ctx->heap);
+  return YU_OK;
+}
+
+yu_err tl_decommit(tl_allocator *ctx, void *ptr, size_t num, size_t elem_size) {
+  yu_err err;
+  heap_lock(ctx->heap);
+  err = yu_decommit(ctx->heap->backing, ptr, num, elem_size);
+  heap_unlock(ctx->heap);
+  return err;
+}
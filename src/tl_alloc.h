@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#pragma once
+
+#include "yu_common.h"
+#include "internal_alloc.h"
+#include "sys_alloc.h"
+
+/**
+ * Thread-local allocator front end.
+ *
+ * The allocator contract says contexts must not be shared between threads, and
+ * tl_alloc doesn't change that: every thread still gets its own tl_allocator.
+ * What it adds is a way for those contexts to share one backing allocator (a
+ * tl_heap) and to hand blocks to each other.
+ *
+ *   • Small allocations (up to 2^TL_MAX_CLASS_SHIFT bytes) are rounded up to a
+ *     power-of-2 size class and carved out of slabs taken from the backing
+ *     allocator. Each context keeps a free list (‘magazine’) per size class, so
+ *     the common alloc/free path never touches the backing allocator or a lock.
+ *   • Larger or over-aligned allocations go straight to the backing allocator.
+ *   • Every block carries a small header pointing at the pool (the slabs,
+ *     magazines and large blocks) of the context that owns it. Freeing a block
+ *     through a context that does not own it pushes the block onto the owning
+ *     pool's remote-free queue, a lock-free stack that the owner drains the next
+ *     time one of its magazines runs dry. This is the *only* operation that may
+ *     be performed on another thread's context.
+ *   • Pools live in backing memory rather than in the context, so that they can
+ *     outlive it: freeing a context whose blocks have all come back gives the
+ *     pool back to the heap, but one with blocks still out is orphaned to the
+ *     heap instead. Remote frees keep landing on the orphan's queue, and the
+ *     next context initialized on the heap adopts it (and so owns its blocks).
+ *     An orphan nobody adopts lives until the backing allocator is freed.
+ *
+ * The backing allocator is only touched with the heap's spinlock held, so it
+ * does not need to be thread-safe itself.
+ * Reserved pages are not blocks: they must be released or freed through the
+ * context that reserved them.
+ */
+
+#ifndef TL_SLAB_SIZE
+#define TL_SLAB_SIZE (64*1024)
+#endif
+
+#define TL_MIN_CLASS_SHIFT 4
+#define TL_MAX_CLASS_SHIFT 12
+#define TL_NUM_CLASSES (TL_MAX_CLASS_SHIFT - TL_MIN_CLASS_SHIFT + 1)
+#define TL_LARGE_CLASS UINT32_MAX
+#define TL_DEFAULT_ALIGNMENT 16
+
+struct tl_block;
+struct tl_slab;
+struct tl_large;
+struct tl_allocator;
+
+struct tl_pool {
+  // NULL while orphaned
+  struct tl_allocator *ctx;
+  // Next orphan on the heap
+  struct tl_pool *next;
+
+  struct tl_block *magazines[TL_NUM_CLASSES];
+  // Blocks freed by other contexts. Pushed with CAS, drained with an exchange.
+  struct tl_block *remote;
+
+  struct tl_slab *slabs;
+  u8 *bump, *bump_end;
+  struct tl_large *large;
+  // Blocks handed out and not yet returned to a magazine (or freed, if large)
+  u64 live;
+};
+
+typedef struct {
+  yu_allocator *backing;
+  bool lock;
+  struct tl_pool *orphans;
+} tl_heap;
+
+typedef struct tl_allocator {
+  struct yu_mem_funcs base;
+  tl_heap *heap;
+  struct tl_pool *pool;
+
+  sysmem_pgtbl pgs;
+  internal_allocator tbl_mctx;
+} tl_allocator;
+
+void tl_heap_init(tl_heap *heap, yu_allocator *backing);
+
+// Adopts an orphaned pool if the heap has one.
+yu_err tl_alloc_ctx_init(tl_allocator *ctx, tl_heap *heap);
+// Orphans ctx's pool if any of its blocks are still out.
+void tl_alloc_ctx_free(tl_allocator *ctx);
+
+yu_err tl_alloc(tl_allocator *ctx, void **out, size_t num, size_t elem_size, size_t alignment);
+yu_err tl_realloc(tl_allocator *ctx, void **ptr, size_t num, size_t elem_size, size_t alignment);
+void tl_free(tl_allocator *ctx, void *ptr);
+
+size_t tl_allocated_size(tl_allocator *ctx, void *ptr);
+size_t tl_usable_size(tl_allocator *ctx, void *ptr);
+
+yu_err tl_reserve(tl_allocator *ctx, void **out, size_t num, size_t elem_size);
+yu_err tl_commit(tl_allocator *ctx, void *ptr, size_t num, size_t elem_size);
+yu_err tl_release(tl_allocator *ctx, void *ptr);
+yu_err tl_decommit(tl_allocator *ctx, void *ptr, size_t num, size_t elem_size);
+
+// The context that owns a block returned from tl_alloc/tl_realloc, or NULL if
+// it's orphaned.
+tl_allocator *tl_block_owner(void *ptr);
+
+// Move every block freed by other contexts back into ctx's magazines.
+// Happens automatically on allocation, but long-idle owners may want to
+// call this themselves.
+void tl_drain_remote(tl_allocator *ctx);
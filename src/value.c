@@ -6,6 +6,8 @@
 #include "arena.h"
 #include "value.h"
 
+#include "shoco/shoco.h"
+
 YU_HASHTABLE_IMPL(value_table, value_t, value_t, value_hash1, value_hash2, value_eq)
 
 value_type value_what(value_t val) {
@@ -17,9 +19,93 @@ value_type value_what(value_t val) {
         return VALUE_FIXNUM;
     if (value_is_double(val))
         return VALUE_DOUBLE;
+    if (value_is_short_str(val))
+        return VALUE_STR;
     return VALUE_ERR;
 }
 
+/**
+ * The raw short string form keeps its bytes in the payload, first byte lowest,
+ * padded with zeros (hence no NULs). Strings too long for that are run through
+ * shoco, whose packs can contain zero bytes, so the compressed length goes in
+ * the tag instead. Since a string only packs one way (raw whenever it fits),
+ * two short strings are equal exactly when their bits are.
+ */
+#define SHORT_STR_BYTES 6
+#define SHORT_STR_SHOCO_MIN 4
+
+bool value_short_str_pack(const u8 *bytes, u64 len, value_t *out) {
+#if YU_32BIT
+    (void)bytes, (void)len, (void)out;
+    return false;
+#else
+    // shoco reads one byte past the end of its input, so give it a terminator
+    char in[VALUE_SHORT_STR_MAX + 1], packed[SHORT_STR_BYTES];
+    u64 payload = 0;
+    size_t packed_len;
+
+    if (len > VALUE_SHORT_STR_MAX)
+        return false;
+    for (u64 i = 0; i < len; i++) {
+        if (bytes[i] == 0 || bytes[i] >= 0x80)
+            return false;
+    }
+
+    if (len <= SHORT_STR_BYTES) {
+        memcpy(&payload, bytes, len);
+        *out = value_from_aux(VALUE_SHORT_STR_RAW_TAG, payload);
+        return true;
+    }
+
+    memcpy(in, bytes, len);
+    in[len] = '\0';
+    packed_len = shoco_compress(in, len, packed, sizeof packed);
+    if (packed_len > SHORT_STR_BYTES)
+        return false;
+    // At most two characters per byte
+    assert(packed_len >= SHORT_STR_SHOCO_MIN);
+    memcpy(&payload, packed, packed_len);
+    *out = value_from_aux(VALUE_SHORT_STR_SHOCO_TAG + packed_len - SHORT_STR_SHOCO_MIN, payload);
+    return true;
+#endif
+}
+
+static
+u64 short_str_decode(value_t v, u8 *buf) {
+#if YU_32BIT
+    (void)v, (void)buf;
+    return 0;
+#else
+    u64 payload = value_aux_payload(v), len = 0;
+    char packed[SHORT_STR_BYTES];
+    u32 tag = value_aux_tag(v);
+
+    assert(value_is_short_str(v));
+    if (tag == VALUE_SHORT_STR_RAW_TAG) {
+        memcpy(buf, &payload, SHORT_STR_BYTES);
+        while (len < SHORT_STR_BYTES && buf[len])
+            len++;
+        return len;
+    }
+    memcpy(packed, &payload, SHORT_STR_BYTES);
+    len = shoco_decompress(packed, tag - VALUE_SHORT_STR_SHOCO_TAG + SHORT_STR_SHOCO_MIN,
+                           (char *)buf, VALUE_SHORT_STR_MAX);
+    assert(len <= VALUE_SHORT_STR_MAX);
+    return len;
+#endif
+}
+
+const u8 *value_str_bytes(value_t v, u8 *buf, u64 *len_out) {
+    assert(value_what(v) == VALUE_STR);
+    if (value_is_short_str(v)) {
+        *len_out = short_str_decode(v, buf);
+        return buf;
+    }
+    yu_str s = value_get_ptr(v)->v.s;
+    *len_out = yu_buf_len(s);
+    return s;
+}
+
 struct arena_handle *boxed_value_owner(struct boxed_value *val) {
     return ((struct arena *)((uintptr_t)val & ~((1 << yu_ceil_log2(sizeof(struct arena))) - 1)))->meta;
 }
@@ -31,19 +117,165 @@ static const u64 type_hashes[] = {
 };
 #undef BUILD_TYPE_TABLE
 
-// TODO hashing cyclic tuples overflows the stack
+/**
+ * Bignums are hashed from their binary representation. mpz limbs are already
+ * canonical (no high zero limbs), so equal integers have equal limbs. An mpfr
+ * mantissa has as many limbs as its precision calls for, with the value
+ * left-aligned in them; skipping the low zero limbs makes equal reals hash the
+ * same whatever their precision. Signs and exponents are mixed in afterwards.
+ * Both hashes are computed together and cached in the boxed value.
+ */
+#define BIG_SIGN_MIX UINT64_C(0x9e3779b97f4a7c15)
+#define REAL_EXP_MIX UINT64_C(0xc2b2ae3d27d4eb4f)
+
 static
-s32 tuple_hash1(value_t v, void *data) {
-    u64 *h = data;
-    *h ^= value_hash1(v);
-    return 0;
+void hash_limbs(const mp_limb_t *limbs, size_t n, u64 hash[2]) {
+    hash[0] = yu_fnv1a((const u8 *)limbs, n * sizeof(mp_limb_t));
+    hash[1] = yu_murmur2((const u8 *)limbs, n * sizeof(mp_limb_t));
 }
 
 static
-s32 tuple_hash2(value_t v, void *data) {
-    u64 *h = data;
-    *h ^= value_hash2(v);
-    return 0;
+void hash_mpz(mpz_t z, u64 hash[2]) {
+    hash_limbs(mpz_limbs_read(z), mpz_size(z), hash);
+    if (mpz_sgn(z) < 0) {
+        hash[0] ^= BIG_SIGN_MIX;
+        hash[1] = ~hash[1];
+    }
+}
+
+static
+void hash_mpfr(mpfr_t r, u64 hash[2]) {
+    if (mpfr_nan_p(r)) {
+        hash[0] = UINT64_C(0x7ff8dead7ff8dead);
+        hash[1] = UINT64_C(0x5a17ed7a5a17ed7a);
+        return;
+    }
+    // mpfr_equal_p says -0 == +0
+    if (mpfr_zero_p(r)) {
+        hash[0] = hash[1] = 0;
+        return;
+    }
+    if (mpfr_inf_p(r)) {
+        hash[0] = UINT64_C(0x1af1af1af1af1af1);
+        hash[1] = UINT64_C(0xf1a1f1a1f1a1f1a1);
+    }
+    else {
+        const mp_limb_t *limbs = mpfr_custom_get_significand(r);
+        size_t n = (mpfr_get_prec(r) + mp_bits_per_limb - 1) / mp_bits_per_limb, lo = 0;
+        while (lo < n && limbs[lo] == 0)
+            ++lo;
+        hash_limbs(limbs + lo, n - lo, hash);
+        hash[0] ^= (u64)mpfr_get_exp(r) * REAL_EXP_MIX;
+        hash[1] += (u64)mpfr_get_exp(r) * REAL_EXP_MIX;
+    }
+    if (mpfr_signbit(r)) {
+        hash[0] ^= BIG_SIGN_MIX;
+        hash[1] = ~hash[1];
+    }
+}
+
+static
+const u64 *big_hash(struct boxed_value *v) {
+    u64 *hash = v->v.big.hash;
+    if (hash[0] == 0 && hash[1] == 0) {
+        if (boxed_value_get_type(v) == VALUE_INT)
+            hash_mpz(*v->v.i, hash);
+        else
+            hash_mpfr(*v->v.r, hash);
+    }
+    return hash;
+}
+
+/**
+ * Tuples are finished before they're used as values, so like bignums their
+ * hashes are computed once and cached in the first chunk. The two hashes are
+ * accumulated separately, hash1 from the elements' hash1s and hash2 from their
+ * hash2s, so tuples that collide in one table still scatter in the other.
+ * Elements are mixed in order, so (a, b) and (b, a) (or (a, a) and (b, b))
+ * don't collide. Only the chunk's padding is free to cache them in, so each
+ * is kept to 27 bits and mixed back out to 64 when asked for; that's still
+ * far more than any table's index. The cache's flags say whether it's filled
+ * in, and whether the tuple reaches a cycle.
+ *
+ * A tuple can contain itself, directly or not, so the walk keeps the path of
+ * tuples being hashed and treats reaching one of them again as a back edge. A
+ * tuple that reaches a cycle is hashed from its own non-tuple elements only,
+ * which doesn't depend on where the walk started; that keeps it cacheable, and
+ * tuple_eq never equates a cyclic tuple with an acyclic one.
+ */
+#define TUPLE_HASH_DONE 1
+#define TUPLE_HASH_CYCLIC 2
+
+struct tuple_path {
+    struct boxed_value *tup;
+    struct tuple_path *up;
+};
+
+YU_INLINE
+u64 mix64(u64 x) {
+    x ^= x >> 30;
+    x *= UINT64_C(0xbf58476d1ce4e5b9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94d049bb133111eb);
+    x ^= x >> 31;
+    return x;
+}
+
+YU_INLINE
+u64 tuple_hash_step(u64 h, u64 x) {
+    return ((h << 23 | h >> 41) ^ x) * UINT64_C(0x100000001b3);
+}
+
+// Fills in t's cached hashes if they aren't yet. Returns t's cache flags, or
+// 0 if t is on the path (a back edge).
+static
+u8 tuple_hash_fill(struct boxed_value *t, struct tuple_path *up) {
+    if (t->tuple_cache.flags)
+        return t->tuple_cache.flags;
+    for (struct tuple_path *p = up; p; p = p->up) {
+        if (p->tup == t)
+            return 0;
+    }
+
+    struct tuple_path path = {t, up};
+    u64 full[2] = {0, 0}, shallow[2] = {0, 0};
+    bool cyclic = false;
+    for (struct boxed_value *c = t; ; c = value_get_ptr(c->v.tup[2])) {
+        for (u32 i = 0; i < 2 && !value_is_empty(c->v.tup[i]); i++) {
+            value_t v = c->v.tup[i];
+            if (value_is_ptr(v) && value_what(v) == VALUE_TUPLE) {
+                u8 sub = tuple_hash_fill(value_get_ptr(v), &path);
+                cyclic |= !sub || (sub & TUPLE_HASH_CYCLIC);
+                // Once cyclic the full hashes aren't used, and v may be
+                // cyclic itself
+                if (!cyclic) {
+                    full[0] = tuple_hash_step(full[0], value_hash1(v));
+                    full[1] = tuple_hash_step(full[1], value_hash2(v));
+                }
+                shallow[0] = tuple_hash_step(shallow[0], type_hashes[VALUE_TUPLE]);
+                shallow[1] = tuple_hash_step(shallow[1], type_hashes[VALUE_TUPLE]);
+            } else {
+                u64 h1 = value_hash1(v), h2 = value_hash2(v);
+                full[0] = tuple_hash_step(full[0], h1);
+                full[1] = tuple_hash_step(full[1], h2);
+                shallow[0] = tuple_hash_step(shallow[0], h1);
+                shallow[1] = tuple_hash_step(shallow[1], h2);
+            }
+        }
+        if (value_is_empty(c->v.tup[2]))
+            break;
+    }
+
+    u64 *h = cyclic ? shallow : full;
+    t->tuple_cache.h1 = mix64(h[0]) >> 37;
+    t->tuple_cache.h2 = mix64(h[1] ^ UINT64_C(0x9e3779b97f4a7c15)) >> 37;
+    return t->tuple_cache.flags = TUPLE_HASH_DONE | (cyclic ? TUPLE_HASH_CYCLIC : 0);
+}
+
+static
+u64 tuple_hash(struct boxed_value *t, u32 which) {
+    tuple_hash_fill(t, NULL);
+    return mix64(which ? t->tuple_cache.h2 | UINT64_C(1) << 32 : t->tuple_cache.h1);
 }
 
 static
@@ -66,34 +298,18 @@ u64 raw_value_hash1(value_t v) {
         return h;
     }
     case VALUE_STR:
+        // The same as a boxed string with these contents would hash to
+        if (value_is_short_str(v)) {
+            u8 buf[VALUE_SHORT_STR_MAX];
+            u64 len = short_str_decode(v, buf);
+            return yu_fnv1a(buf, len);
+        }
         return YU_BUF_DAT(value_get_ptr(v)->v.s)->hash[0];
-    case VALUE_INT: {
-        mpz_t *z = value_get_ptr(v)->v.i;
-        char *s = alloca(mpz_sizeinbase(*z, 62) + 2);
-        mpz_get_str(s, 62, *z);
-        return yu_fnv1a((const u8 *)s, strlen(s));
-    }
-    case VALUE_REAL: {
-        mpfr_t *r = value_get_ptr(v)->v.r;
-        mpfr_exp_t exp;
-        char *s = mpfr_get_str(NULL, &exp, 62, 0, *r, MPFR_RNDN);
-        int slen = strlen(s);
-        // Reuse the \0 for the exponent, so that 3.14 and 31.4 don't
-        // hash the same.
-        s[slen] = (char)exp;
-        u64 h = yu_fnv1a((const u8 *)s, slen + 1);
-        // Probably unnecessary, but restore the string to normal before freeing it.
-        s[slen] = '\0';
-        mpfr_free_str(s);
-        return h;
-    }
-    case VALUE_TUPLE: {
-        if (value_tuple_len(value_get_ptr(v)) == 0)
-            return UINT64_C(0xB16B00B5);
-        u64 h = 0;
-        value_tuple_foreach(value_get_ptr(v), tuple_hash1, &h);
-        return h;
-    }
+    case VALUE_INT:
+    case VALUE_REAL:
+        return big_hash(value_get_ptr(v))[0];
+    case VALUE_TUPLE:
+        return tuple_hash(value_get_ptr(v), 0);
     case VALUE_TABLE:  // hash by address
     case VALUE_QUOT:
         return (uintptr_t)value_get_ptr(v);
@@ -120,31 +336,17 @@ u64 raw_value_hash2(value_t v) {
         return yu_murmur2((const u8 *)&x, sizeof(double));
     }
     case VALUE_STR:
+        if (value_is_short_str(v)) {
+            u8 buf[VALUE_SHORT_STR_MAX];
+            u64 len = short_str_decode(v, buf);
+            return yu_murmur2(buf, len);
+        }
         return YU_BUF_DAT(value_get_ptr(v)->v.s)->hash[1];
-    case VALUE_INT: {
-        mpz_t *z = value_get_ptr(v)->v.i;
-        char *s = alloca(mpz_sizeinbase(*z, 62) + 2);
-        mpz_get_str(s, 62, *z);
-        return yu_murmur2((const u8 *)s, strlen(s));
-    }
-    case VALUE_REAL: {
-        mpfr_t *r = value_get_ptr(v)->v.r;
-        mpfr_exp_t exp;
-        char *s = mpfr_get_str(NULL, &exp, 62, 0, *r, MPFR_RNDN);
-        int slen = strlen(s);
-        s[slen] = (char)exp;
-        u64 h = yu_murmur2((const u8 *)s, slen + 1);
-        s[slen] = '\0';
-        mpfr_free_str(s);
-        return h;
-    }
-    case VALUE_TUPLE: {
-        u64 h = 0;
-        if (value_tuple_len(value_get_ptr(v)) == 0)
-            return UINT64_C(0xCAFEBABE);
-        value_tuple_foreach(value_get_ptr(v), tuple_hash2, &h);
-        return h;
-    }
+    case VALUE_INT:
+    case VALUE_REAL:
+        return big_hash(value_get_ptr(v))[1];
+    case VALUE_TUPLE:
+        return tuple_hash(value_get_ptr(v), 1);
     case VALUE_TABLE:
     case VALUE_QUOT:
         return ~(uintptr_t)value_get_ptr(v) * UINT64_C(0x7ffffffffffffe29);
@@ -157,14 +359,21 @@ u64 raw_value_hash2(value_t v) {
     }
 }
 
+static
+bool has_tag(struct boxed_value *v) {
+    return v->tag && yu_str_len(v->tag) > 0;
+}
+
+// Values that can be unboxed are hashed (and compared, see value_eq) as their
+// unboxed selves, which have no tag.
 #define WRAP_HASH(hname, strhidx) \
     u64 value_ ## hname (value_t v) { \
         u64 h; \
         struct boxed_value *ptr = value_is_ptr(v) ? value_get_ptr(v) : NULL; \
-        if (ptr && value_can_unbox_untagged(ptr)) \
-            v = value_unbox(ptr); \
+        if (ptr && value_can_unbox_untagged(ptr, &v)) \
+            ptr = NULL; \
         h = raw_value_ ## hname (v); \
-        if (ptr && ptr->tag && yu_str_len(ptr->tag) > 0) \
+        if (ptr && has_tag(ptr)) \
             h ^= YU_BUF_DAT(ptr->tag)->hash[strhidx]; \
         return h ^ type_hashes[value_what(v)]; \
     }
@@ -174,20 +383,124 @@ WRAP_HASH(hash2, 1)
 
 #undef WRAP_HASH
 
+static
+bool str_eq(yu_str a, yu_str b) {
+    struct yu_buf_dat *da = YU_BUF_DAT(a), *db = YU_BUF_DAT(b);
+    if (a == b)
+        return true;
+    if (da->is_frozen && db->is_frozen) {
+        // Frozen strings are interned per context, so equal contents would
+        // have been the same buffer.
+        if (da->ctx == db->ctx)
+            return false;
+        // Otherwise their hashes are already there to rule out most mismatches
+        if (da->hash[0] != db->hash[0] || da->hash[1] != db->hash[1])
+            return false;
+    }
+    return da->len == db->len && memcmp(a, b, da->len) == 0;
+}
+
+static
+bool tag_eq(struct boxed_value *a, struct boxed_value *b) {
+    bool a_tagged = has_tag(a), b_tagged = has_tag(b);
+    if (!a_tagged || !b_tagged)
+        return a_tagged == b_tagged;
+    return str_eq(a->tag, b->tag);
+}
+
+// The pairs of tuples being compared, innermost first
+struct eq_path {
+    struct boxed_value *a, *b;
+    struct eq_path *up;
+};
+
+static bool values_eq(value_t a, value_t b, struct eq_path *up);
+
+// Cyclic tuples are compared the way they're hashed: reaching a tuple that's
+// already being compared is a back edge, and two tuples are only equal if
+// they take back edges in the same places.
+static
+bool tuple_eq(struct boxed_value *a, struct boxed_value *b, struct eq_path *up) {
+    bool a_back = false, b_back = false;
+    for (struct eq_path *p = up; p; p = p->up) {
+        a_back |= p->a == a;
+        b_back |= p->b == b;
+    }
+    if (a_back || b_back)
+        return a_back && b_back;
+    // Cached hashes rule out most mismatches without a walk
+    if (a->tuple_cache.flags && b->tuple_cache.flags &&
+        (a->tuple_cache.flags != b->tuple_cache.flags ||
+         a->tuple_cache.h1 != b->tuple_cache.h1 || a->tuple_cache.h2 != b->tuple_cache.h2))
+        return false;
+
+    struct eq_path path = {a, b, up};
+    while (true) {
+        // Tuples can share tails
+        if (a == b)
+            return true;
+        if (!values_eq(a->v.tup[0], b->v.tup[0], &path) ||
+            !values_eq(a->v.tup[1], b->v.tup[1], &path))
+            return false;
+        if (value_is_empty(a->v.tup[2]) || value_is_empty(b->v.tup[2]))
+            return value_is_empty(a->v.tup[2]) && value_is_empty(b->v.tup[2]);
+        a = value_get_ptr(a->v.tup[2]);
+        b = value_get_ptr(b->v.tup[2]);
+    }
+}
+
+static
+bool values_eq(value_t a, value_t b, struct eq_path *up) {
+    struct boxed_value *pa, *pb;
+
+    // The same immediate, or the same handle
+    if (a.as_int64 == b.as_int64)
+        return true;
+    // Two immediates are only equal if their bits are (so -0.0 != 0.0, as
+    // far as hashing is concerned)
+    if (!value_is_ptr(a) && !value_is_ptr(b))
+        return false;
+
+    if (value_is_ptr(a))
+        value_can_unbox_untagged(value_get_ptr(a), &a);
+    if (value_is_ptr(b))
+        value_can_unbox_untagged(value_get_ptr(b), &b);
+    // Anything that's still boxed can't be represented as an immediate
+    if (!value_is_ptr(a) || !value_is_ptr(b))
+        return a.as_int64 == b.as_int64;
+
+    pa = value_get_ptr(a);
+    pb = value_get_ptr(b);
+    if (pa == pb)
+        return true;
+    if (boxed_value_get_type(pa) != boxed_value_get_type(pb) || !tag_eq(pa, pb))
+        return false;
+
+    switch (boxed_value_get_type(pa)) {
+    case VALUE_STR:
+        return str_eq(pa->v.s, pb->v.s);
+    case VALUE_INT:
+        return mpz_cmp(*pa->v.i, *pb->v.i) == 0;
+    case VALUE_REAL:
+        return mpfr_equal_p(*pa->v.r, *pb->v.r) != 0;
+    case VALUE_TUPLE:
+        return tuple_eq(pa, pb, up);
+    default:
+        // Tables and quotations are compared (and hashed) by identity
+        return false;
+    }
+}
+
+
 bool value_eq(value_t a, value_t b) {
-    if (value_is_ptr(a) && value_can_unbox_untagged(value_get_ptr(a)))
-        a = value_unbox(value_get_ptr(a));
-    if (value_is_ptr(b) && value_can_unbox_untagged(value_get_ptr(b)))
-        b = value_unbox(value_get_ptr(b));
-    return value_hash1(a) == value_hash1(b) &&
-           value_hash2(a) == value_hash2(b);
+    return values_eq(a, b, NULL);
 }
 
 bool value_is_truthy(value_t val) {
   if (value_is_bool(val))
     return value_to_bool(val);
-  if (value_is_ptr(val) && value_what(val) == VALUE_BOOL && value_can_unbox_untagged(value_get_ptr(val)))
-    return value_to_bool(value_unbox(value_get_ptr(val)));
+  if (value_is_ptr(val) && value_what(val) == VALUE_BOOL && value_can_unbox_untagged(value_get_ptr(val), &val))
+    return value_to_bool(val);
   return true;
 }
 
@@ -228,34 +541,46 @@ u64 value_tuple_len(struct boxed_value *v) {
     return len;
 }
 
-bool value_can_unbox_untagged(struct boxed_value* v) {
-    value_type what = boxed_value_get_type(v);
-    if (what == VALUE_FIXNUM || what == VALUE_DOUBLE || what == VALUE_BOOL)
-        return true;
-    if (what == VALUE_INT && mpz_fits_sint_p(*v->v.i))
-        return true;
-    if (what == VALUE_REAL && mpfr_cmp_d(*v->v.r, DBL_MAX) < 1)
-        return true;
-    return false;
-}
-
-value_t value_unbox(struct boxed_value *v) {
-    assert(value_can_unbox_untagged(v));
+bool value_can_unbox_untagged(struct boxed_value *v, value_t *out) {
+    value_t u;
     switch (boxed_value_get_type(v)) {
     case VALUE_FIXNUM:
-        return value_from_int(v->v.fx);
+        u = value_from_int(v->v.fx);
+        break;
     case VALUE_DOUBLE:
-        return value_from_double(v->v.d);
+        u = value_from_double(v->v.d);
+        break;
     case VALUE_BOOL:
-        return value_from_bool(v->v.b);
+        u = value_from_bool(v->v.b);
+        break;
     case VALUE_INT:
-        return value_from_int((s32)mpz_get_si(*v->v.i));
+        if (!mpz_fits_sint_p(*v->v.i))
+            return false;
+        u = value_from_int((s32)mpz_get_si(*v->v.i));
+        break;
     case VALUE_REAL:
-        return value_from_double(mpfr_get_d(*v->v.r, MPFR_RNDN));
+        if (mpfr_cmp_d(*v->v.r, DBL_MAX) >= 1)
+            return false;
+        u = value_from_double(mpfr_get_d(*v->v.r, MPFR_RNDN));
+        break;
+    case VALUE_STR:
+        // Packing is the only way to find out whether it fits, so keep the result
+        if (yu_buf_len(v->v.s) > VALUE_SHORT_STR_MAX ||
+            !value_short_str_pack(v->v.s, yu_buf_len(v->v.s), &u))
+            return false;
+        break;
     default:
-#ifdef __GNUC__
-        __builtin_unreachable();
-#endif
-        return value_undefined();
+        return false;
     }
+    if (out)
+        *out = u;
+    return true;
+}
+
+value_t value_unbox(struct boxed_value *v) {
+    value_t u = value_undefined();
+    bool ok = value_can_unbox_untagged(v, &u);
+    assert(ok);
+    (void)ok;
+    return u;
 }
@@ -44,6 +44,13 @@ struct boxed_value {
         // open the possibility of pooling them in the future.
         mpz_t *i;
         mpfr_t *r;
+        // Bignums are immutable once boxed, so their hashes are cached in
+        // the otherwise unused part of the union. num aliases i and r.
+        // All-zero means not computed yet.
+        struct {
+            void *num;
+            u64 hash[2];
+        } big;
         yu_str s;
         value_table *tbl;
         int fx;
@@ -52,10 +59,19 @@ struct boxed_value {
     } v;
     yu_str tag;
 
-    struct {
+    // Packed, or the bitfields' int-sized unit would eat the room below
+    struct __attribute__((packed)) {
         value_type what : 7;
         bool gray : 1;
     } bits;
+    // For the first chunk of a tuple: its cached hashes, squeezed into what
+    // would otherwise be padding (see value.c). flags is 0 until they're
+    // computed.
+    struct __attribute__((packed)) {
+        u64 flags : 2;
+        u64 h1 : 27;
+        u64 h2 : 27;
+    } tuple_cache;
 };
 
 YU_INLINE
@@ -76,7 +92,41 @@ typedef s32 (* value_tuple_iter_fn)(value_t val, void *data);
 s32 value_tuple_foreach(struct boxed_value *v, value_tuple_iter_fn iter, void *data);
 u64 value_tuple_len(struct boxed_value *v);
 
-bool value_can_unbox_untagged(struct boxed_value *v);
+/**
+ * Short ASCII strings are immediates in the nanbox aux space rather than boxed
+ * yu_strs: up to 6 bytes as they are, or up to VALUE_SHORT_STR_MAX characters
+ * that shoco compresses into 4–6 bytes (see value.c). value_what() reports
+ * them as VALUE_STR, and boxed strings that would fit unbox to them, so they
+ * hash and compare like any other string.
+ */
+#define VALUE_SHORT_STR_MAX 12
+#define VALUE_SHORT_STR_RAW_TAG 1
+// Tags 2..4 are shoco-compressed strings of 4..6 bytes
+#define VALUE_SHORT_STR_SHOCO_TAG 2
+#define VALUE_SHORT_STR_LAST_TAG 4
+
+YU_INLINE
+bool value_is_short_str(value_t v) {
+#if YU_32BIT
+    (void)v;
+    return false;
+#else
+    return value_is_aux(v) && value_aux_tag(v) <= VALUE_SHORT_STR_LAST_TAG;
+#endif
+}
+
+// Packs bytes into a short string immediate if they're ASCII without NULs and
+// short (or compressible) enough. Returns false and leaves out alone otherwise.
+bool value_short_str_pack(const u8 *bytes, u64 len, value_t *out);
+
+// The bytes of an untagged string value of either kind. Short strings are
+// decoded into buf, which must hold VALUE_SHORT_STR_MAX bytes; boxed strings
+// return their own buffer.
+const u8 *value_str_bytes(value_t v, u8 *buf, u64 *len_out);
+
+// If v can be represented as an immediate, stores that in *out (when out
+// isn't NULL) and returns true.
+bool value_can_unbox_untagged(struct boxed_value *v, value_t *out);
 value_t value_unbox(struct boxed_value *v);
 
 YU_INLINE
@@ -88,6 +138,9 @@ YU_INLINE
 void boxed_value_set_type(struct boxed_value *val, value_type type) {
     assert((u8)type < 128);
     val->bits.what = type;
+    val->tuple_cache.flags = 0;
+    if (type == VALUE_INT || type == VALUE_REAL)
+        val->v.big.hash[0] = val->v.big.hash[1] = 0;
 }
 
 YU_INLINE
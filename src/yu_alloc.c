@@ -18,3 +18,156 @@ void *yu_xrealloc(void *ctx, void *ptr, size_t num, size_t elem_size) {
     }
     return ptr;
 }
+
+void yu_mem_limits_init(struct yu_mem_limits *limits, size_t soft, size_t hard) {
+    memset(limits, 0, sizeof(struct yu_mem_limits));
+    limits->soft = soft;
+    limits->hard = hard;
+}
+
+yu_err yu_alloc_set_limits(void *ctx, struct yu_mem_limits *limits) {
+    yu_allocator *a = ctx;
+    if (limits != NULL && a->usable_size == NULL)
+        return YU_ERR_UNKNOWN;
+    a->limits = limits;
+    return YU_OK;
+}
+
+bool yu_alloc_add_pressure_hook(void *ctx, yu_pressure_fn fn, void *data) {
+    struct yu_mem_limits *l = ((yu_allocator *)ctx)->limits;
+    if (l == NULL || l->num_hooks == YU_MEM_MAX_PRESSURE_HOOKS)
+        return false;
+    l->hooks[l->num_hooks].fn = fn;
+    l->hooks[l->num_hooks].data = data;
+    l->num_hooks++;
+    return true;
+}
+
+bool yu_alloc_remove_pressure_hook(void *ctx, yu_pressure_fn fn, void *data) {
+    struct yu_mem_limits *l = ((yu_allocator *)ctx)->limits;
+    if (l == NULL)
+        return false;
+    for (u32 i = 0; i < l->num_hooks; i++) {
+        if (l->hooks[i].fn == fn && l->hooks[i].data == data) {
+            memmove(l->hooks + i, l->hooks + i + 1, (l->num_hooks - i - 1) * sizeof(l->hooks[0]));
+            l->num_hooks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool over_limit(struct yu_mem_limits *l, size_t limit, size_t req) {
+    return limit != 0 && l->used + req > limit;
+}
+
+static void apply_pressure(struct yu_mem_limits *l, yu_mem_pressure level, size_t req) {
+    // Hooks are free to allocate, and that mustn't set them off again
+    if (l->in_hook)
+        return;
+    l->in_hook = true;
+    for (u32 i = 0; i < l->num_hooks; i++)
+        l->hooks[i].fn(level, req, l->hooks[i].data);
+    l->in_hook = false;
+}
+
+// Returns false if `req` more bytes still won't fit under the hard limit
+// after the hooks have had their chance.
+static bool make_room(struct yu_mem_limits *l, size_t req) {
+    // Reclaiming memory can take some (the GC compacts into a fresh arena),
+    // and failing that would be worse than going over the limit for a while
+    if (l->in_hook)
+        return true;
+    if (!l->soft_signalled && over_limit(l, l->soft, req)) {
+        l->soft_signalled = true;
+        apply_pressure(l, YU_MEM_PRESSURE_SOFT, req);
+    }
+    if (over_limit(l, l->hard, req)) {
+        apply_pressure(l, YU_MEM_PRESSURE_HARD, req);
+        return !over_limit(l, l->hard, req);
+    }
+    return true;
+}
+
+static void account_alloc(struct yu_mem_limits *l, size_t sz) {
+    l->used += sz;
+    if (l->used > l->peak)
+        l->peak = l->used;
+}
+
+static void account_free(struct yu_mem_limits *l, size_t sz) {
+    l->used = sz > l->used ? 0 : l->used - sz;
+    if (l->soft == 0 || l->used < l->soft)
+        l->soft_signalled = false;
+}
+
+yu_err yu__limited_alloc(yu_allocator *ctx, void **out, size_t num, size_t elem_size, size_t alignment) {
+    struct yu_mem_limits *l = ctx->limits;
+    size_t req = num * elem_size;
+    yu_err err;
+
+    if (!make_room(l, req))
+        return YU_ERR_ALLOC_FAIL;
+    if ((err = ctx->alloc(ctx, out, num, elem_size, alignment)) != YU_OK) {
+        // The allocator itself is out of memory; reclaim what we can and try once more
+        apply_pressure(l, YU_MEM_PRESSURE_HARD, req);
+        if ((err = ctx->alloc(ctx, out, num, elem_size, alignment)) != YU_OK)
+            return err;
+    }
+    account_alloc(l, ctx->usable_size(ctx, *out));
+    return YU_OK;
+}
+
+yu_err yu__limited_realloc(yu_allocator *ctx, void **ptr, size_t num, size_t elem_size, size_t alignment) {
+    struct yu_mem_limits *l = ctx->limits;
+    size_t old_sz = ctx->usable_size(ctx, *ptr), req = num * elem_size;
+    yu_err err;
+
+    if (req > old_sz && !make_room(l, req - old_sz))
+        return YU_ERR_ALLOC_FAIL;
+    if ((err = ctx->realloc(ctx, ptr, num, elem_size, alignment)) != YU_OK) {
+        apply_pressure(l, YU_MEM_PRESSURE_HARD, req);
+        if ((err = ctx->realloc(ctx, ptr, num, elem_size, alignment)) != YU_OK)
+            return err;
+    }
+    account_free(l, old_sz);
+    account_alloc(l, ctx->usable_size(ctx, *ptr));
+    return YU_OK;
+}
+
+void yu__limited_free(yu_allocator *ctx, void *ptr) {
+    if (ptr == NULL)
+        return;
+    account_free(ctx->limits, ctx->usable_size(ctx, ptr));
+    ctx->free(ctx, ptr);
+}
+
+// The pages commit/decommit actually touch
+static size_t page_span(void *ptr, size_t sz) {
+    uintptr_t pgsz = yu_virtual_pagesize(0)-1;
+    uintptr_t start = (uintptr_t)ptr & ~pgsz, end = ((uintptr_t)ptr + sz + pgsz) & ~pgsz;
+    return end - start;
+}
+
+yu_err yu__limited_commit(yu_allocator *ctx, void *ptr, size_t num, size_t elem_size) {
+    struct yu_mem_limits *l = ctx->limits;
+    size_t req = page_span(ptr, num * elem_size);
+    yu_err err;
+
+    if (!make_room(l, req))
+        return YU_ERR_ALLOC_FAIL;
+    if ((err = ctx->commit(ctx, ptr, num, elem_size)) != YU_OK) {
+        apply_pressure(l, YU_MEM_PRESSURE_HARD, req);
+        if ((err = ctx->commit(ctx, ptr, num, elem_size)) != YU_OK)
+            return err;
+    }
+    account_alloc(l, req);
+    return YU_OK;
+}
+
+yu_err yu__limited_decommit(yu_allocator *ctx, void *ptr, size_t num, size_t elem_size) {
+    yu_err err = ctx->decommit(ctx, ptr, num, elem_size);
+    if (err == YU_OK)
+        account_free(ctx->limits, page_span(ptr, num * elem_size));
+    return err;
+}
@@ -111,9 +111,46 @@
  * To subclass yu_mem_funcs, a struct should be declared with `yu_mem_funcs base;` as the
  * _first_ member. (The name does not matter, but it is possible macros in the future could
  * rely on it being ‘base’).
+ *
+ *
+ * LIMITS AND MEMORY PRESSURE
+ * --------------------------
+ *
+ * Any context can be given a soft and a hard byte limit with yu_alloc_set_limits().
+ * Allocations made through yu_alloc() and yu_realloc() are then accounted (by
+ * usable_size, so the context must implement it) against a struct yu_mem_limits owned
+ * by the caller. Reserved pages cost nothing until they're committed: yu_commit() and
+ * yu_decommit() account the whole pages they touch, so committing the same page twice
+ * counts it twice. Releasing a reservation can't tell how much of it is committed, so
+ * decommit what you committed first, and release it with yu_release() rather than
+ * yu_free() (which would take the whole reservation off the usage counter).
+ *
+ * Subsystems that can give memory back (the GC, yu_buf free lists, …) register a
+ * pressure hook with yu_alloc_add_pressure_hook(). Hooks run:
+ *   • with YU_MEM_PRESSURE_SOFT the first time a request would cross the soft limit.
+ *     The allocation goes ahead regardless. Soft pressure is signalled again only
+ *     after usage has dropped back below the soft limit.
+ *   • with YU_MEM_PRESSURE_HARD whenever a request would cross the hard limit. If
+ *     the hooks can't free enough the allocation fails with YU_ERR_ALLOC_FAIL.
+ *   • with YU_MEM_PRESSURE_HARD when the allocator itself fails, after which the
+ *     allocation is retried once.
+ * Only after all that does an error reach yu_xalloc's fatal handler. Hooks may free
+ * and allocate from the context; they are never re-entered while one is running, and
+ * what they allocate isn't held to either limit.
+ * A hook runs inside whatever allocation tripped the limit, so whatever it frees is
+ * there for that allocation to use. But that may be an allocation its own subsystem
+ * made halfway through updating itself. Hooks that can't reclaim safely at that point
+ * should record the pressure and act on it later (a busy GC collects at its next
+ * gc_alloc_val, a busy yu_buf_ctx purges at its next yu_buf_new).
+ *
+ * A limit of 0 means ‘no limit’, so limits of 0/0 just get the hooks run when the
+ * allocator fails. Limits should be set before the first allocation;
+ * blocks allocated earlier are not accounted for and freeing them won't bring the
+ * usage counter below 0.
  */
 
 struct yu_mem_funcs;
+struct yu_mem_limits;
 
 typedef yu_err (* yu_reserve_fn)(struct yu_mem_funcs *ctx, void **out, size_t num, size_t elem_size);
 typedef yu_err (* yu_release_fn)(struct yu_mem_funcs *ctx, void *ptr);
@@ -144,29 +181,83 @@ typedef struct yu_mem_funcs {
     yu_decommit_fn decommit;
 
     yu_ctx_free_fn free_ctx;
+
+    // NULL unless yu_alloc_set_limits() was called
+    struct yu_mem_limits *limits;
 } yu_allocator;
 
+#define YU_MEM_PRESSURE_LIST(X) \
+    X(YU_MEM_PRESSURE_SOFT, "Soft limit reached") \
+    X(YU_MEM_PRESSURE_HARD, "Hard limit reached or allocator out of memory")
+
+DEF_ENUM(yu_mem_pressure, YU_MEM_PRESSURE_LIST)
+
+// `requested` is the number of bytes the triggering request needs.
+typedef void (* yu_pressure_fn)(yu_mem_pressure level, size_t requested, void *data);
+
+#ifndef YU_MEM_MAX_PRESSURE_HOOKS
+#define YU_MEM_MAX_PRESSURE_HOOKS 8
+#endif
+
+struct yu_mem_limits {
+    size_t soft, hard;
+    size_t used, peak;
+
+    bool in_hook;
+    bool soft_signalled;
+
+    u32 num_hooks;
+    struct {
+        yu_pressure_fn fn;
+        void *data;
+    } hooks[YU_MEM_MAX_PRESSURE_HOOKS];
+};
+
+void yu_mem_limits_init(struct yu_mem_limits *limits, size_t soft, size_t hard);
+// Fails if ctx does not implement usable_size.
+yu_err yu_alloc_set_limits(void *ctx, struct yu_mem_limits *limits);
+
+// Both return false if ctx has no limits (or, for add, if there's no room for the hook).
+// Registering on an unlimited context is harmless, so callers can do it unconditionally.
+bool yu_alloc_add_pressure_hook(void *ctx, yu_pressure_fn fn, void *data);
+bool yu_alloc_remove_pressure_hook(void *ctx, yu_pressure_fn fn, void *data);
+
+yu_err yu__limited_alloc(yu_allocator *ctx, void **out, size_t num, size_t elem_size, size_t alignment);
+yu_err yu__limited_realloc(yu_allocator *ctx, void **ptr, size_t num, size_t elem_size, size_t alignment);
+void yu__limited_free(yu_allocator *ctx, void *ptr);
+yu_err yu__limited_commit(yu_allocator *ctx, void *ptr, size_t num, size_t elem_size);
+yu_err yu__limited_decommit(yu_allocator *ctx, void *ptr, size_t num, size_t elem_size);
+
 // These all take void *ctx to avoid warnings about imcompatible pointer types —
 // they'll always be passed a subclass of yu_allocator.
 
 YU_INLINE
 yu_err yu_alloc(void *ctx, void **out, size_t num, size_t elem_size, size_t alignment) {
+  if (YU_UNLIKELY(((yu_allocator *)ctx)->limits != NULL))
+    return yu__limited_alloc(ctx, out, num, elem_size, alignment);
   return ((yu_allocator *)ctx)->alloc(ctx, out, num, elem_size, alignment);
 }
 YU_INLINE
+void yu_free(void *ctx, void *ptr) {
+    if (YU_UNLIKELY(((yu_allocator *)ctx)->limits != NULL))
+        yu__limited_free(ctx, ptr);
+    else
+        ((yu_allocator *)ctx)->free(ctx, ptr);
+}
+YU_INLINE
 yu_err yu_realloc(void *ctx, void **ptr, size_t num, size_t elem_size, size_t alignment) {
     assert(ptr != NULL);
     assert(elem_size > 0);
     if (*ptr == NULL)
-        return ((yu_allocator *)ctx)->alloc(ctx, ptr, num, elem_size, alignment);
+        return yu_alloc(ctx, ptr, num, elem_size, alignment);
     if (num == 0) {
-        ((yu_allocator *)ctx)->free(ctx, *ptr);
+        yu_free(ctx, *ptr);
         return YU_OK;
     }
+    if (YU_UNLIKELY(((yu_allocator *)ctx)->limits != NULL))
+        return yu__limited_realloc(ctx, ptr, num, elem_size, alignment);
     return ((yu_allocator *)ctx)->realloc(ctx, ptr, num, elem_size, alignment);
 }
-YU_INLINE
-void yu_free(void *ctx, void *ptr) { ((yu_allocator *)ctx)->free(ctx, ptr); }
 
 YU_INLINE
 size_t yu_allocated_size(void *ctx, void *ptr) { return ((yu_allocator *)ctx)->allocated_size(ctx, ptr); }
@@ -185,11 +276,15 @@ yu_err yu_release(void *ctx, void *ptr) {
 
 YU_INLINE
 yu_err yu_commit(void *ctx, void *ptr, size_t num, size_t elem_size) {
+    if (YU_UNLIKELY(((yu_allocator *)ctx)->limits != NULL))
+        return yu__limited_commit(ctx, ptr, num, elem_size);
     return ((yu_allocator *)ctx)->commit(ctx, ptr, num, elem_size);
 }
 
 YU_INLINE
 yu_err yu_decommit(void *ctx, void *ptr, size_t num, size_t elem_size) {
+    if (YU_UNLIKELY(((yu_allocator *)ctx)->limits != NULL))
+        return yu__limited_decommit(ctx, ptr, num, elem_size);
     return ((yu_allocator *)ctx)->decommit(ctx, ptr, num, elem_size);
 }
 
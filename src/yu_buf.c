@@ -2,37 +2,149 @@
 
 YU_HASHTABLE_IMPL(yu_buf_table, u64 *, yu_buf, yu__u64hashfnv, yu__u64hashm2, yu__u64eq)
 
-u64 yu_fnv1a(const u8 *bytes, u64 len) {
-    u64 hash = 0xcbf29ce484222325ull;
-    // Hope the compiler vectorizes this
-    for (u64 i = 0; i < len; i++) {
-        hash ^= bytes[i];
-        hash *= 0x100000001b3ull;
+/**
+ * Both hashes read their input 8 bytes at a time (as little-endian words, like
+ * the rest of Yu assumes).
+ *
+ * yu_fnv1a is FNV-1a over words instead of bytes. Inputs of a stripe or more
+ * are spread over FNV_LANES independent lanes so the multiplies don't wait on
+ * each other. The FNV prime is 2^40 + 0x1b3, so a lane step is cheap in AVX2
+ * too, and that version is picked at runtime if the CPU has it. Lanes, whole
+ * words and the tail are folded together with the length and then avalanched,
+ * since word-wise FNV alone keeps the top of each word out of the low bits.
+ *
+ * yu_murmur2 is MurmurHash64A. Its multiply chain is serial, so a vector
+ * version wouldn't be any faster.
+ */
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+#define FNV_LANES 16
+#define FNV_STRIPE (FNV_LANES * 8)
+
+YU_INLINE
+u64 load_word(const u8 *p) {
+    u64 x;
+    memcpy(&x, p, sizeof x);
+    return x;
+}
+
+// The first n < 8 bytes at p, zero-extended, without a byte loop or reading
+// past p + n
+YU_INLINE
+u64 load_tail(const u8 *p, u64 n) {
+    if (n >= 4) {
+        u32 lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + n - 4, 4);
+        return lo | (u64)hi << (8 * (n - 4));
     }
-    return hash;
+    if (n > 0)
+        return p[0] | (u64)p[n / 2] << (8 * (n / 2)) | (u64)p[n - 1] << (8 * (n - 1));
+    return 0;
+}
+
+// MurmurHash3's finalizer
+YU_INLINE
+u64 fmix64(u64 h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+typedef void (*fnv1a_stripes_fn)(u64 *lanes, const u8 *bytes, u64 nstripes);
+
+static void fnv1a_stripes_portable(u64 *lanes, const u8 *bytes, u64 nstripes) {
+    for (; nstripes; nstripes--, bytes += FNV_STRIPE) {
+        for (u32 i = 0; i < FNV_LANES; i++)
+            lanes[i] = (lanes[i] ^ load_word(bytes + 8 * i)) * FNV_PRIME;
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_FNV1A_AVX2
+
+__attribute__((target("avx2")))
+static void fnv1a_stripes_avx2(u64 *lanes, const u8 *bytes, u64 nstripes) {
+    const __m256i prime_lo = _mm256_set1_epi64x(0x1b3);
+    __m256i acc[FNV_LANES / 4];
+    for (u32 i = 0; i < FNV_LANES / 4; i++)
+        acc[i] = _mm256_loadu_si256((const __m256i *)lanes + i);
+    for (; nstripes; nstripes--, bytes += FNV_STRIPE) {
+        for (u32 i = 0; i < FNV_LANES / 4; i++) {
+            __m256i x = _mm256_xor_si256(acc[i], _mm256_loadu_si256((const __m256i *)bytes + i));
+            // x * (2^40 + 0x1b3) out of 32×32→64-bit multiplies
+            __m256i lo = _mm256_mul_epu32(x, prime_lo),
+                    hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime_lo);
+            acc[i] = _mm256_add_epi64(_mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)),
+                                      _mm256_slli_epi64(x, 40));
+        }
+    }
+    for (u32 i = 0; i < FNV_LANES / 4; i++)
+        _mm256_storeu_si256((__m256i *)lanes + i, acc[i]);
+}
+#endif
+
+static void fnv1a_stripes_resolve(u64 *lanes, const u8 *bytes, u64 nstripes);
+static fnv1a_stripes_fn fnv1a_stripes = fnv1a_stripes_resolve;
+
+// Picks an implementation on first use. Threads racing here all pick the same.
+static void fnv1a_stripes_resolve(u64 *lanes, const u8 *bytes, u64 nstripes) {
+    fnv1a_stripes_fn impl = fnv1a_stripes_portable;
+#ifdef HAVE_FNV1A_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        impl = fnv1a_stripes_avx2;
+#endif
+    fnv1a_stripes = impl;
+    impl(lanes, bytes, nstripes);
+}
+
+YU_INLINE
+u64 fnv1a_with(fnv1a_stripes_fn stripes, const u8 *bytes, u64 len) {
+    u64 hash = FNV_OFFSET, n = len;
+    if (n >= FNV_STRIPE) {
+        u64 lanes[FNV_LANES];
+        for (u32 i = 0; i < FNV_LANES; i++)
+            lanes[i] = FNV_OFFSET + i;
+        stripes(lanes, bytes, n / FNV_STRIPE);
+        bytes += n - n % FNV_STRIPE;
+        n %= FNV_STRIPE;
+        for (u32 i = 0; i < FNV_LANES; i++)
+            hash = (hash ^ lanes[i]) * FNV_PRIME;
+    }
+    for (; n >= 8; n -= 8, bytes += 8)
+        hash = (hash ^ load_word(bytes)) * FNV_PRIME;
+    if (n)
+        hash = (hash ^ load_tail(bytes, n)) * FNV_PRIME;
+    return fmix64(hash ^ len);
+}
+
+u64 yu_fnv1a(const u8 *bytes, u64 len) {
+    return fnv1a_with(fnv1a_stripes, bytes, len);
+}
+
+u64 yu__fnv1a_portable(const u8 *bytes, u64 len) {
+    return fnv1a_with(fnv1a_stripes_portable, bytes, len);
 }
 
 u64 yu_murmur2(const u8 *bytes, u64 len) {
     const u64 m = 0xc6a4a7935bd1e995ull;
     u64 hash = 0x1fffffffffffffffull ^ len * m;
-    for (u64 i = 0; i < len; i++) {
-        u64 b = bytes[i];
-        b *= m;
-        b ^= b >> 47;
-        b *= m;
-        hash ^= b;
+    for (u64 n = len / 8; n; n--, bytes += 8) {
+        u64 k = load_word(bytes);
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        hash ^= k;
         hash *= m;
     }
-
-    // Fallthrough
-    switch (len & 7) {
-    case 7: hash ^= (u64)bytes[6] << 48;
-    case 6: hash ^= (u64)bytes[5] << 40;
-    case 5: hash ^= (u64)bytes[4] << 32;
-    case 4: hash ^= (u64)bytes[3] << 24;
-    case 3: hash ^= (u64)bytes[2] << 16;
-    case 2: hash ^= (u64)bytes[1] <<  8;
-    case 1: hash ^= (u64)bytes[0]; hash *= m;
+    if (len & 7) {
+        hash ^= load_tail(bytes, len & 7);
+        hash *= m;
     }
 
     hash ^= hash >> 47;
@@ -84,59 +196,86 @@ static void yu_hash_buf(yu_buf buf) {
     d->hash[1] = yu_murmur2(buf, d->len);
 }
 
-static void yu_buf_ctx_clean_free_list(yu_buf_ctx *ctx) {
-    /* Assume that bigger buffers are reused less frequently,
-       and thus clean the top 1/5 biggest. To avoid scanning the
-       whole free list, we only scan the first 1/e of it, then
-       free the biggest in that section and then any in the rest
-       that are bigger than the largest from the sample until
-       we get to the target count. */
-    if (ctx->num_free > YU_BUF_CTX_FREE_THRESHOLD) {
-        u64 sample_sz = (u64)floor(1.0/M_E * ctx->num_free),
-            free_cnt = (u64)ceil(ctx->num_free / 3.0);
-        u8 purged = 0;
-        struct yu_buf_dat *big = NULL, *big_prev = NULL, *curr = ctx->free, *prev = NULL, *next;
-        for (u64 i = 0; i < sample_sz; ++i) {
-            if (big == NULL)
-                big = curr;
-            else if (curr->capacity > big->capacity ||
-                     (curr->capacity == big->capacity && curr->len > big->len)) {
-                big = curr;
-                big_prev = prev;
-            }
-            prev = curr;
-            curr = curr->next;
-        }
-        while (curr) {
-            next = curr->next;
-            if (big == NULL || curr->capacity > big->capacity ||
-                (curr->capacity == big->capacity && curr->len > big->len)) {
-                    if (prev)
-                        prev->next = curr->next;
-                    else
-                        ctx->free = curr->next;
-                    if (curr->udata != NULL)
-                        ctx->udata_free(curr->udata);
-                    yu_free(ctx->memctx, curr);
-                    --ctx->num_free;
-                    if (++purged == free_cnt)
-                        break;
-            }
-            else
-                prev = curr;
-            curr = next;
-        }
-        if (big) {
-            if (big_prev)
-                big_prev->next = big->next;
-            else
-                ctx->free = big->next;
-            if (big->udata != NULL)
-                ctx->udata_free(big->udata);
-            yu_free(ctx->memctx, big);
-            --ctx->num_free;
-        }
+/* Dead frozen buffers (refs == 0) stay interned in case they're asked for
+   again, on a most-recently-freed-first list per capacity. A list longer than
+   YU_BUF_CTX_FREE_PER_CLASS loses its least recently freed buffer, and
+   yu_buf_alloc recycles buffers from the same end. */
+
+static void free_list_unlink(yu_buf_ctx *ctx, struct yu_buf_dat *d) {
+    struct yu_buf_free_list *l = &ctx->free[d->capacity];
+    if (d->prev)
+        d->prev->next = d->next;
+    else
+        l->head = d->next;
+    if (d->next)
+        d->next->prev = d->prev;
+    else
+        l->tail = d->prev;
+    d->next = d->prev = NULL;
+    --l->len;
+    --ctx->num_free;
+}
+
+// Takes a dead frozen buffer out of the interning table, so a later
+// yu_buf_new won't hand it out, and lets go of its user data. What's left
+// can be freed or reused.
+static void unintern(yu_buf_ctx *ctx, struct yu_buf_dat *d) {
+    ++ctx->busy;
+    yu_buf_table_remove(&ctx->frozen_bufs, d->hash, NULL);
+    --ctx->busy;
+    if (d->udata != NULL)
+        ctx->udata_free(d->udata);
+}
+
+static void release_frozen(yu_buf_ctx *ctx, struct yu_buf_dat *d) {
+    free_list_unlink(ctx, d);
+    unintern(ctx, d);
+    yu_free(ctx->memctx, d);
+}
+
+static void free_list_push(yu_buf_ctx *ctx, struct yu_buf_dat *d) {
+    if (d->capacity >= YU_BUF_SIZE_CLASSES) {
+        // Too big to be worth keeping around
+        unintern(ctx, d);
+        yu_free(ctx->memctx, d);
+        return;
+    }
+    struct yu_buf_free_list *l = &ctx->free[d->capacity];
+    d->prev = NULL;
+    d->next = l->head;
+    if (l->head)
+        l->head->prev = d;
+    else
+        l->tail = d;
+    l->head = d;
+    ++l->len;
+    ++ctx->num_free;
+    if (l->len > YU_BUF_CTX_FREE_PER_CLASS)
+        release_frozen(ctx, l->tail);
+}
+
+void yu_buf_ctx_purge(yu_buf_ctx *ctx) {
+    ++ctx->busy;
+    ctx->purge_pending = false;
+    for (u32 k = 0; k < YU_BUF_SIZE_CLASSES; k++) {
+        while (ctx->free[k].tail)
+            release_frozen(ctx, ctx->free[k].tail);
     }
+    // Allocates the smaller table first, so under a hard limit this may not
+    // manage to; that's fine, it leaves the table as it was.
+    yu_buf_table_compact(&ctx->frozen_bufs);
+    --ctx->busy;
+}
+
+// Any allocation from memctx can get here, including the ones frozen_bufs
+// makes in the middle of a put or resize. Purging then would pull entries out
+// from under the table, so wait for the next yu_buf_new/yu_buf_alloc instead.
+static void purge_on_pressure(yu_mem_pressure YU_UNUSED(level), size_t YU_UNUSED(requested), void *data) {
+    yu_buf_ctx *ctx = data;
+    if (ctx->busy)
+        ctx->purge_pending = true;
+    else
+        yu_buf_ctx_purge(ctx);
 }
 
 static void null_free(void * YU_UNUSED(_)) { }
@@ -144,17 +283,22 @@ static void null_free(void * YU_UNUSED(_)) { }
 void yu_buf_ctx_init(yu_buf_ctx *ctx, yu_allocator *memctx) {
     yu_buf_table_init(&ctx->frozen_bufs, 10, memctx);
     ctx->memctx = memctx;
-    ctx->free = NULL;
+    memset(ctx->free, 0, sizeof(ctx->free));
     ctx->num_free = 0;
     ctx->udata_free = null_free;
+    ctx->busy = 0;
+    ctx->purge_pending = false;
+    yu_alloc_add_pressure_hook(memctx, purge_on_pressure, ctx);
 }
 
 void yu_buf_ctx_free(yu_buf_ctx *ctx) {
-    struct yu_buf_dat *curr = ctx->free, *next;
-    while (curr) {
-        next = curr->next;
-        yu_free(ctx->memctx, curr);
-        curr = next;
+    yu_alloc_remove_pressure_hook(ctx->memctx, purge_on_pressure, ctx);
+    struct yu_buf_dat *curr, *next;
+    for (u32 k = 0; k < YU_BUF_SIZE_CLASSES; k++) {
+        for (curr = ctx->free[k].head; curr; curr = next) {
+            next = curr->next;
+            yu_free(ctx->memctx, curr);
+        }
     }
     yu_buf_table_free(&ctx->frozen_bufs);
 }
@@ -163,15 +307,26 @@ void yu_buf_ctx_free(yu_buf_ctx *ctx) {
 yu_buf yu_buf_alloc(yu_buf_ctx *ctx, u64 size) {
     u32 k = yu_ceil_log2(size);
     void *base;
-    if (yu_alloc(ctx->memctx, &base, 1, sizeof(struct yu_buf_dat) + (1 << k), 16) != YU_OK)
-        return NULL;
-    struct yu_buf_dat *d = (struct yu_buf_dat *)base;
+    struct yu_buf_dat *d;
+    if (ctx->purge_pending)
+        yu_buf_ctx_purge(ctx);
+    if (k < YU_BUF_SIZE_CLASSES && (d = ctx->free[k].tail) != NULL) {
+        // Recycle the dead buffer of this size that's least likely to be
+        // asked for again
+        free_list_unlink(ctx, d);
+        unintern(ctx, d);
+    }
+    else {
+        if (yu_alloc(ctx->memctx, &base, 1, sizeof(struct yu_buf_dat) + (1 << k), 16) != YU_OK)
+            return NULL;
+        d = (struct yu_buf_dat *)base;
+    }
     d->ctx = ctx;
     d->capacity = k;
     d->len = 0;
     d->udata = NULL;
     d->refs = 1;
-    d->next = NULL;
+    d->next = d->prev = NULL;
     d->is_frozen = false;
     d->hash[0] = d->hash[1] = 0;
     return (yu_buf)(d + 1);
@@ -182,12 +337,16 @@ yu_buf yu_buf_new(yu_buf_ctx *ctx, const u8 *contents, u64 size, bool frozen) {
     u64 check_hash[2];
     yu_buf buf;
 
+    if (ctx->purge_pending)
+        yu_buf_ctx_purge(ctx);
     if (frozen) {
         check_hash[0] = yu_fnv1a(contents, size);
         check_hash[1] = yu_murmur2(contents, size);
         if (yu_buf_table_get(&ctx->frozen_bufs, check_hash, &buf)) {
+            // A dead buffer came back to life; it mustn't be freed or
+            // recycled out from under its new owner
             if (YU_BUF_DAT(buf)->refs++ == 0)
-                --ctx->num_free;
+                free_list_unlink(ctx, YU_BUF_DAT(buf));
             return buf;
         }
     }
@@ -206,12 +365,8 @@ yu_buf yu_buf_new(yu_buf_ctx *ctx, const u8 *contents, u64 size, bool frozen) {
 void yu_buf_free(yu_buf buf) {
     struct yu_buf_dat *d = YU_BUF_DAT(buf);
     if (--d->refs == 0) {
-        if (d->is_frozen) {
-            d->next = d->ctx->free;
-            d->ctx->free = d;
-            ++d->ctx->num_free;
-            yu_buf_ctx_clean_free_list(d->ctx);
-        }
+        if (d->is_frozen)
+            free_list_push(d->ctx, d);
         else {
             if (d->udata != NULL)
                 d->ctx->udata_free(d->udata);
@@ -231,11 +386,20 @@ yu_buf yu_buf_freeze(yu_buf buf) {
         /* Free buf instead of old, because we're returning the new, interned
            buffer here. This means we can free and replace it without the caller
            ‘noticing’, so to speak, while freeing `old` would invalidate any
-           existing references to it. */
+           existing references to it.
+           `buf` never made it into the interning table, so it mustn't go on
+           the free list either (recycling it would unintern `old`). */
+        d->is_frozen = false;
         yu_buf_free(buf);
+        // The caller's reference to buf becomes one to old, which may have
+        // been dead until now
+        if (YU_BUF_DAT(old)->refs++ == 0)
+            free_list_unlink(YU_BUF_DAT(old)->ctx, YU_BUF_DAT(old));
         return old;
     }
+    ++d->ctx->busy;
     yu_buf_table_put(&d->ctx->frozen_bufs, d->hash, buf, &old);
+    --d->ctx->busy;
     return buf;
 }
 
@@ -262,3 +426,21 @@ yu_buf yu_buf_cat(yu_buf a, yu_buf b, bool frozen) {
     }
     return c;
 }
+
+yu_buf yu_buf_append(yu_buf buf, const u8 *bytes, u64 len) {
+    struct yu_buf_dat *d = YU_BUF_DAT(buf);
+    // Anyone else holding this would be left with a dangling pointer if it moved
+    assert(!d->is_frozen && d->refs == 1);
+    if (d->len + len > (UINT64_C(1) << d->capacity)) {
+        u32 k = yu_ceil_log2(d->len + len);
+        void *base = d;
+        if (yu_realloc(d->ctx->memctx, &base, 1, sizeof(struct yu_buf_dat) + (UINT64_C(1) << k), 16) != YU_OK)
+            return NULL;
+        d = (struct yu_buf_dat *)base;
+        d->capacity = k;
+        buf = (yu_buf)(d + 1);
+    }
+    memcpy(buf + d->len, bytes, len);
+    d->len += len;
+    return buf;
+}
@@ -2,7 +2,12 @@
 #error "Don't include yu_buf.h directly! Include yu_common.h instead."
 #endif
 
-#define YU_BUF_CTX_FREE_THRESHOLD 1
+// Frozen buffers nobody uses any more are kept around (still interned) on one
+// LRU list per power-of-two capacity, at most this many per list. New
+// buffers are carved out of them before going to the allocator.
+#define YU_BUF_CTX_FREE_PER_CLASS 8
+// Buffers of 2^YU_BUF_SIZE_CLASSES bytes and up are freed straight away
+#define YU_BUF_SIZE_CLASSES 24
 // Modern stacks are very very large, so 1MB should be fine.
 #define YU_BUF_STACK_ALLOC_THRESHOLD (1024*1024)
 
@@ -12,6 +17,8 @@
    Which normalization form doesn't matter as long as it's consistent. */
 u64 yu_fnv1a(const u8 *bytes, u64 len);
 u64 yu_murmur2(const u8 *bytes, u64 len);
+// yu_fnv1a without the vector code, which it must agree with
+u64 yu__fnv1a_portable(const u8 *bytes, u64 len);
 
 
 u64 yu__u64hashfnv(u64 *key);
@@ -33,12 +40,21 @@ struct yu_buf_dat;
 
 typedef void (* yu_buf_udata_cleanup_func)(void *);
 
+struct yu_buf_free_list {
+    struct yu_buf_dat *head, *tail;  // Most and least recently freed
+    u32 len;
+};
+
 typedef struct {
     yu_buf_table frozen_bufs;
     yu_buf_udata_cleanup_func udata_free;
     yu_allocator *memctx;
-    struct yu_buf_dat *free;
+    struct yu_buf_free_list free[YU_BUF_SIZE_CLASSES];
     u64 num_free;
+    // Nonzero while frozen_bufs is being modified; memory pressure in the
+    // meantime only sets purge_pending
+    u32 busy;
+    bool purge_pending;
 } yu_buf_ctx;
 
 struct yu_buf_dat {
@@ -54,11 +70,14 @@ struct yu_buf_dat {
 
     u32 refs;
 
-    struct yu_buf_dat *next;
+    struct yu_buf_dat *next, *prev;
 };
 
 void yu_buf_ctx_init(yu_buf_ctx *ctx, yu_allocator *memctx);
 void yu_buf_ctx_free(yu_buf_ctx *ctx);
+// Free every frozen buffer that's only being kept around for reuse and shrink
+// the interning table to fit what's left. Runs automatically under memory pressure.
+void yu_buf_ctx_purge(yu_buf_ctx *ctx);
 
 yu_buf yu_buf_alloc(yu_buf_ctx *ctx, u64 size);
 
@@ -82,3 +101,7 @@ void yu_buf_set_udata(yu_buf buf, void *udata) {
 }
 
 yu_buf yu_buf_cat(yu_buf a, yu_buf b, bool frozen);
+// Appends to an unfrozen buffer in place, growing it (to the next power of
+// two) if needed. Growing may move it; returns the buffer to use from now on,
+// or NULL (leaving `buf` as it was) if it couldn't grow.
+yu_buf yu_buf_append(yu_buf buf, const u8 *bytes, u64 len);
@@ -203,6 +203,7 @@ u32 yu_ceil_log2(u64 n);
  */
 
 #include "yu_hashtable.h"
+#include "yu_flattable.h"
 #include "yu_splaytree.h"
 #include "yu_quickheap.h"
 
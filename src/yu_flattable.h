@@ -0,0 +1,260 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#ifndef YU_INTERNAL_INCLUDES
+#error "Don't include yu_flattable.h directly! Include yu_common.h instead."
+#endif
+
+/**
+ * Open-addressing hash table in the style of Abseil's ‘Swiss tables’, as an
+ * alternative to the cuckoo YU_HASHTABLE. It takes the same template arguments
+ * and provides the same API (init/free/iter/get/try_get/put/remove, plus the
+ * `size`, `capacity` and `memctx` fields), so switching a table over is just a
+ * matter of changing YU_HASHTABLE to YU_FLATTABLE.
+ *
+ * Instead of is_set bits inside the buckets, every slot has one control byte in
+ * a separate array:
+ *   • 0x80 — empty
+ *   • 0xfe — deleted (a tombstone; probing continues past it)
+ *   • 0b0hhhhhhh — full, where h are the low 7 bits of hash2(key)
+ * Lookups start at hash1(key) and look at control bytes 16 at a time, comparing
+ * all of them against the 7-bit tag at once (with SSE2 when available). Only
+ * slots whose tag matches get an `eq` call, so a miss usually touches a single
+ * cache line of metadata and no keys at all. Probing stops at the first group
+ * with an empty slot.
+ *
+ * The control array has 16 extra bytes at the end mirroring the first 16, so a
+ * group can be loaded starting at any slot without wrapping.
+ *
+ * The table grows (or, if it is mostly tombstones, is rebuilt in place) when it
+ * would exceed a 7/8 load factor.
+ *
+ * keywords: swiss table, open addressing, hash table
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define YU_FLAT_GROUP_WIDTH 16
+#define YU_FLAT_EMPTY ((u8)0x80)
+#define YU_FLAT_DELETED ((u8)0xfe)
+#define YU_FLAT_MIN_CAPACITY 4  /* log2; one group */
+
+/* Bitmasks with bit i set if control byte i of the group at `ctrl` matches */
+YU_INLINE
+u32 yu__flat_match(const u8 *ctrl, u8 tag) {
+#ifdef __SSE2__
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)tag)));
+#else
+    u32 m = 0;
+    for (u32 i = 0; i < YU_FLAT_GROUP_WIDTH; i++)
+        m |= (u32)(ctrl[i] == tag) << i;
+    return m;
+#endif
+}
+
+YU_INLINE
+u32 yu__flat_match_empty(const u8 *ctrl) {
+    return yu__flat_match(ctrl, YU_FLAT_EMPTY);
+}
+
+/* Empty or deleted — both have the high bit set */
+YU_INLINE
+u32 yu__flat_match_free(const u8 *ctrl) {
+#ifdef __SSE2__
+    return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    u32 m = 0;
+    for (u32 i = 0; i < YU_FLAT_GROUP_WIDTH; i++)
+        m |= (u32)(ctrl[i] >> 7) << i;
+    return m;
+#endif
+}
+
+#define YU_FLATTABLE(tbl, key_t, val_t, hash1, hash2, eq) \
+typedef u32 (* YU_NAME(tbl, iter_cb))(key_t, val_t, void *); \
+\
+struct YU_NAME(tbl, slot) { \
+    key_t key; \
+    val_t val; \
+}; \
+\
+typedef struct { \
+    yu_allocator *memctx; \
+    u8 *ctrl;  /* 2^capacity + YU_FLAT_GROUP_WIDTH control bytes */ \
+    struct YU_NAME(tbl, slot) *slots; \
+    u64 size; \
+    u64 growth_left;  /* insertions into empty slots before we have to grow */ \
+    u8 capacity;  /* number of slots is 2^capacity */ \
+} tbl; \
+\
+void YU_NAME(tbl, init)(tbl *t, u64 init_capacity, yu_allocator *mctx); \
+void YU_NAME(tbl, free)(tbl *t); \
+u32 YU_NAME(tbl, iter)(tbl *t, YU_NAME(tbl, iter_cb) cb, void *data); \
+bool YU_NAME(tbl, get)(tbl *t, key_t k, val_t *v_out); \
+val_t YU_NAME(tbl, try_get)(tbl *t, key_t k, val_t default_val); \
+bool YU_NAME(tbl, put)(tbl *t, key_t k, val_t v, val_t *v_out); \
+bool YU_NAME(tbl, remove)(tbl *t, key_t k, val_t *v_out);
+
+#define YU_FLATTABLE_IMPL(tbl, key_t, val_t, hash1, hash2, eq) \
+static void YU_NAME(tbl, _alloc_)(tbl *t, u8 k) { \
+    u64 cap = (u64)1 << k; \
+    t->ctrl = yu_xalloc(t->memctx, cap + YU_FLAT_GROUP_WIDTH, 1); \
+    memset(t->ctrl, YU_FLAT_EMPTY, cap + YU_FLAT_GROUP_WIDTH); \
+    t->slots = yu_xalloc(t->memctx, cap, sizeof(struct YU_NAME(tbl, slot))); \
+    t->capacity = k; \
+    t->growth_left = cap - cap / 8; \
+} \
+\
+void YU_NAME(tbl, init)(tbl *t, u64 init_capacity, yu_allocator *mctx) { \
+    /* Leave room for init_capacity entries under the maximum load factor */ \
+    u8 k = yu_ceil_log2(init_capacity + init_capacity / 7 + 1); \
+    t->memctx = mctx; \
+    t->size = 0; \
+    YU_NAME(tbl, _alloc_)(t, k < YU_FLAT_MIN_CAPACITY ? YU_FLAT_MIN_CAPACITY : k); \
+} \
+\
+void YU_NAME(tbl, free)(tbl *t) { \
+    yu_free(t->memctx, t->ctrl); \
+    yu_free(t->memctx, t->slots); \
+} \
+\
+u32 YU_NAME(tbl, iter)(tbl *t, YU_NAME(tbl, iter_cb) cb, void *data) { \
+    u32 stop_code; \
+    u64 cap = (u64)1 << t->capacity, seen = 0; \
+    for (u64 i = 0; i < cap && seen < t->size; i += YU_FLAT_GROUP_WIDTH) { \
+        u32 full = ~yu__flat_match_free(t->ctrl + i) & 0xffff; \
+        while (full) { \
+            u32 j = __builtin_ctz(full); \
+            full &= full - 1; \
+            ++seen; \
+            if ((stop_code = cb(t->slots[i+j].key, t->slots[i+j].val, data))) \
+                return stop_code; \
+        } \
+    } \
+    return 0; \
+} \
+\
+static void YU_NAME(tbl, _setctrl_)(tbl *t, u64 i, u8 c) { \
+    t->ctrl[i] = c; \
+    if (i < YU_FLAT_GROUP_WIDTH) \
+        t->ctrl[((u64)1 << t->capacity) + i] = c; \
+} \
+\
+/* Index of the slot holding k, or UINT64_MAX */ \
+static u64 YU_NAME(tbl, _find_)(tbl *t, key_t k, u64 h1, u8 tag) { \
+    u64 mask = ((u64)1 << t->capacity) - 1, pos = h1 & mask; \
+    for (u64 stride = 0; ; ) { \
+        const u8 *g = t->ctrl + pos; \
+        u32 m = yu__flat_match(g, tag); \
+        while (m) { \
+            u64 i = (pos + __builtin_ctz(m)) & mask; \
+            if (eq(k, t->slots[i].key)) \
+                return i; \
+            m &= m - 1; \
+        } \
+        if (YU_LIKELY(yu__flat_match_empty(g))) \
+            return UINT64_MAX; \
+        /* Triangular probing visits every group exactly once when the \
+           number of slots is a power of 2. */ \
+        stride += YU_FLAT_GROUP_WIDTH; \
+        pos = (pos + stride) & mask; \
+    } \
+} \
+\
+/* First empty or deleted slot on k's probe sequence */ \
+static u64 YU_NAME(tbl, _find_free_)(tbl *t, u64 h1) { \
+    u64 mask = ((u64)1 << t->capacity) - 1, pos = h1 & mask; \
+    for (u64 stride = 0; ; ) { \
+        u32 m = yu__flat_match_free(t->ctrl + pos); \
+        if (m) \
+            return (pos + __builtin_ctz(m)) & mask; \
+        stride += YU_FLAT_GROUP_WIDTH; \
+        pos = (pos + stride) & mask; \
+    } \
+} \
+\
+static void YU_NAME(tbl, _resize_)(tbl *t, u8 k) { \
+    u8 *old_ctrl = t->ctrl; \
+    struct YU_NAME(tbl, slot) *old_slots = t->slots; \
+    u64 old_cap = (u64)1 << t->capacity; \
+    YU_NAME(tbl, _alloc_)(t, k); \
+    for (u64 i = 0; i < old_cap; i++) { \
+        if (old_ctrl[i] & 0x80) \
+            continue; \
+        key_t key = old_slots[i].key; \
+        u64 j = YU_NAME(tbl, _find_free_)(t, hash1(key)); \
+        YU_NAME(tbl, _setctrl_)(t, j, old_ctrl[i]); \
+        t->slots[j] = old_slots[i]; \
+    } \
+    t->growth_left -= t->size; \
+    yu_free(t->memctx, old_ctrl); \
+    yu_free(t->memctx, old_slots); \
+} \
+\
+bool YU_NAME(tbl, get)(tbl *t, key_t k, val_t *v_out) { \
+    u64 i = YU_NAME(tbl, _find_)(t, k, hash1(k), hash2(k) & 0x7f); \
+    if (i == UINT64_MAX) \
+        return false; \
+    if (v_out) *v_out = t->slots[i].val; \
+    return true; \
+} \
+\
+val_t YU_NAME(tbl, try_get)(tbl *t, key_t k, val_t default_val) { \
+    val_t v; \
+    if (YU_NAME(tbl, get)(t, k, &v)) \
+        return v; \
+    return default_val; \
+} \
+\
+bool YU_NAME(tbl, put)(tbl *t, key_t k, val_t v, val_t *v_out) { \
+    u64 h1 = hash1(k), i; \
+    u8 tag = hash2(k) & 0x7f; \
+    if ((i = YU_NAME(tbl, _find_)(t, k, h1, tag)) != UINT64_MAX) { \
+        if (v_out) *v_out = t->slots[i].val; \
+        t->slots[i].val = v; \
+        return true; \
+    } \
+    i = YU_NAME(tbl, _find_free_)(t, h1); \
+    /* Reusing a tombstone doesn't use up any growth */ \
+    if (t->ctrl[i] == YU_FLAT_EMPTY && t->growth_left == 0) { \
+        u64 cap = (u64)1 << t->capacity; \
+        /* Lots of tombstones: rebuilding at the same size frees them up */ \
+        YU_NAME(tbl, _resize_)(t, t->size < cap * 7 / 16 ? t->capacity : t->capacity + 1); \
+        i = YU_NAME(tbl, _find_free_)(t, h1); \
+    } \
+    t->growth_left -= t->ctrl[i] == YU_FLAT_EMPTY; \
+    YU_NAME(tbl, _setctrl_)(t, i, tag); \
+    t->slots[i].key = k; \
+    t->slots[i].val = v; \
+    ++t->size; \
+    return false; \
+} \
+\
+bool YU_NAME(tbl, remove)(tbl *t, key_t k, val_t *v_out) { \
+    u64 i = YU_NAME(tbl, _find_)(t, k, hash1(k), hash2(k) & 0x7f), mask, before; \
+    u32 empty_before, empty_after; \
+    if (i == UINT64_MAX) \
+        return false; \
+    if (v_out) *v_out = t->slots[i].val; \
+    --t->size; \
+    /* If there's an empty slot within a group's width on both sides, no probe \
+       sequence can have passed through here while looking for something else, \
+       so the slot can go straight back to empty instead of being a tombstone. */ \
+    mask = ((u64)1 << t->capacity) - 1; \
+    before = (i - YU_FLAT_GROUP_WIDTH) & mask; \
+    empty_before = yu__flat_match_empty(t->ctrl + before); \
+    empty_after = yu__flat_match_empty(t->ctrl + i); \
+    if (empty_before && empty_after && \
+        (__builtin_clz(empty_before << 16) + __builtin_ctz(empty_after)) < YU_FLAT_GROUP_WIDTH) { \
+        YU_NAME(tbl, _setctrl_)(t, i, YU_FLAT_EMPTY); \
+        ++t->growth_left; \
+    } \
+    else \
+        YU_NAME(tbl, _setctrl_)(t, i, YU_FLAT_DELETED); \
+    return true; \
+}
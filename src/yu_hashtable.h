@@ -28,9 +28,50 @@
  * This would fit more buckets into cache (potentially many more), though
  * locality with is_set bits would be lost. I'm sure something could be worked out.
  *
+ * Growing is incremental. When the table fills up, new left/right arrays of
+ * twice the size are allocated and the old ones are kept alongside them.
+ * Every put/remove then moves YU_HASHTABLE_MIGRATE_STEP old bucket indices
+ * into the new arrays before doing its own work, so no single operation pays
+ * for reinserting the whole table. Until the migration finishes, lookups
+ * check the new arrays first and then the old ones. Lookups never migrate
+ * themselves, so get/get_many/try_get don't allocate or move entries and
+ * are safe to call from inside the table's own iter callback (put/remove
+ * aren't).
+ *
+ * get_many looks up a whole array of keys. It hashes YU_HASHTABLE_BATCH keys
+ * at a time and prefetches both of their candidate buckets before comparing
+ * any keys, so the (usually two) cache misses per lookup overlap instead of
+ * being paid one after the other.
+ *
+ * Tables shrink too: once a remove leaves the table less than min_load percent
+ * full (YU_HASHTABLE_MIN_LOAD by default, 0 disables it), it starts an
+ * incremental resize down to a capacity that fits the remaining entries at
+ * 50% load. It never shrinks below the capacity asked for by init or reserve.
+ * compact() does the same synchronously, ignoring that floor. Allocators
+ * round requests up, so whenever the memory handed back (by usable_size) has
+ * room for twice as many buckets, the table uses the larger power of 2.
+ *
  * keywords: cuckoo hash, hash table
  */
 
+#ifndef YU_HASHTABLE_MIGRATE_STEP
+#define YU_HASHTABLE_MIGRATE_STEP 4
+#endif
+
+#ifndef YU_HASHTABLE_BATCH
+#define YU_HASHTABLE_BATCH 16
+#endif
+
+#ifndef YU_HASHTABLE_MIN_LOAD
+#define YU_HASHTABLE_MIN_LOAD 10
+#endif
+
+// Smallest capacity (as used in the table struct) holding n entries at <= 50% load
+YU_INLINE
+u8 yu__hashtable_fit(u64 n) {
+    return yu_ceil_log2(n > 2 ? (n + 1) / 2 : 1);
+}
+
 #define YU_HASHTABLE(tbl, key_t, val_t, hash1, hash2, eq) \
 typedef u32 (* YU_NAME(tbl, iter_cb))(key_t, val_t, void *); \
 \
@@ -46,63 +87,113 @@ typedef struct { \
     yu_allocator *memctx; \
     struct YU_NAME(tbl, bucket) *left; \
     struct YU_NAME(tbl, bucket) *right; \
-    u64 size; \
+    /* Arrays being migrated away from; NULL unless a resize is in progress */ \
+    struct YU_NAME(tbl, bucket) *old_left; \
+    struct YU_NAME(tbl, bucket) *old_right; \
+    u64 size;  /* counts entries in both the old and new arrays */ \
+    u64 migrate_pos;  /* next index in old_left/old_right to migrate */ \
     u8 capacity;  /* size of left and right is 2^capacity */ \
+    u8 old_capacity; \
+    u8 min_capacity;  /* never shrink below this; set by init and reserve */ \
+    u8 min_load;  /* shrink once less than this % full; 0 disables shrinking */ \
 } tbl; \
 \
 void YU_NAME(tbl, init)(tbl *t, u64 init_capacity, yu_allocator *mctx); \
+void YU_NAME(tbl, free)(tbl *t); \
+void YU_NAME(tbl, reserve)(tbl *t, u64 n); \
+bool YU_NAME(tbl, compact)(tbl *t); \
 u32 YU_NAME(tbl, iter)(tbl *t, YU_NAME(tbl, iter_cb) cb, void *data); \
+u8 YU_NAME(tbl, _lookup_)(struct YU_NAME(tbl, bucket) *left, struct YU_NAME(tbl, bucket) *right, u8 capacity, \
+                          key_t k, u64 h1, u64 h2, struct YU_NAME(tbl, bucket) **b_out); \
+u8 YU_NAME(tbl, _findhashed_)(tbl *t, key_t k, u64 h1, u64 h2, struct YU_NAME(tbl, bucket) **b_out); \
 u8 YU_NAME(tbl, _findbucket_)(tbl *t, key_t k, struct YU_NAME(tbl, bucket) **b_out); \
 bool YU_NAME(tbl, get)(tbl *t, key_t k, val_t *v_out); \
+u64 YU_NAME(tbl, get_many)(tbl *t, key_t *keys, u64 n, val_t *vals_out, bool *found_out); \
 val_t YU_NAME(tbl, try_get)(tbl *t, key_t k, val_t default_val); \
-void YU_NAME(tbl, _rehash_)(tbl *t, struct YU_NAME(tbl, bucket) *left, struct YU_NAME(tbl, bucket) *right, u64 cap); \
+void YU_NAME(tbl, _migrate_)(tbl *t, u64 steps); \
+bool YU_NAME(tbl, _resize_)(tbl *t, u8 capacity, bool must_succeed); \
+void YU_NAME(tbl, _grow_)(tbl *t); \
 bool YU_NAME(tbl, _insert_)(tbl *t, bool left_insert, key_t k, val_t v, val_t *v_out, u8 iter_count); \
 bool YU_NAME(tbl, put)(tbl *t, key_t k, val_t v, val_t *v_out); \
 bool YU_NAME(tbl, remove)(tbl *t, key_t k, val_t *v_out);
 
 #define YU_HASHTABLE_IMPL(tbl, key_t, val_t, hash1, hash2, eq) \
+/* Allocates zeroed left/right arrays of 2^*capacity buckets, raising \
+   *capacity if the allocator handed back enough memory for more. */ \
+static bool YU_NAME(tbl, _alloc_buckets_)(tbl *t, u8 *capacity, struct YU_NAME(tbl, bucket) **left, \
+                                          struct YU_NAME(tbl, bucket) **right) { \
+    size_t bsz = sizeof(struct YU_NAME(tbl, bucket)), n = (size_t)1 << *capacity, usable; \
+    if (yu_alloc(t->memctx, (void **)left, n, bsz, 0) != YU_OK) \
+        return false; \
+    if (yu_alloc(t->memctx, (void **)right, n, bsz, 0) != YU_OK) { \
+        yu_free(t->memctx, *left); \
+        return false; \
+    } \
+    if (t->memctx->usable_size) { \
+        usable = min(yu_usable_size(t->memctx, *left), yu_usable_size(t->memctx, *right)); \
+        if (usable >= 2 * n * bsz) { \
+            size_t grown = n; \
+            while (usable >= 2 * grown * bsz) { \
+                grown *= 2; \
+                ++*capacity; \
+            } \
+            memset(*left + n, 0, (grown - n) * bsz); \
+            memset(*right + n, 0, (grown - n) * bsz); \
+        } \
+    } \
+    return true; \
+} \
+\
 void YU_NAME(tbl, init)(tbl *t, u64 init_capacity, yu_allocator *mctx) { \
     /* Since we store 2 keys per bucket and have 2 bucket arrays, \
        if we were to use init_capacity as-passed the actual number of \
        storable key-value pairs would exceed the requested capacity \
        by quite a bit. Do a ceiling division to fix that. */ \
     u8 k = yu_ceil_log2(1 + (init_capacity - 1) / 4); \
-    init_capacity = 1 << k; \
-    t->left = yu_xalloc(mctx, init_capacity, sizeof(struct YU_NAME(tbl, bucket))); \
-    t->right = yu_xalloc(mctx, init_capacity, sizeof(struct YU_NAME(tbl, bucket))); \
     t->memctx = mctx; \
+    if (!YU_NAME(tbl, _alloc_buckets_)(t, &k, &t->left, &t->right)) \
+        yu_global_fatal_handler(YU_ERR_ALLOC_FAIL); \
+    t->old_left = t->old_right = NULL; \
     t->size = 0; \
+    t->migrate_pos = 0; \
     t->capacity = k; \
+    t->old_capacity = 0; \
+    t->min_capacity = k; \
+    t->min_load = YU_HASHTABLE_MIN_LOAD; \
 } \
 void YU_NAME(tbl, free)(tbl *t) { \
     yu_free(t->memctx, t->left); \
     yu_free(t->memctx, t->right); \
+    if (t->old_left) { \
+        yu_free(t->memctx, t->old_left); \
+        yu_free(t->memctx, t->old_right); \
+    } \
 }\
 \
-u32 YU_NAME(tbl, iter)(tbl *t, YU_NAME(tbl, iter_cb) cb, void *data) { \
+static u32 YU_NAME(tbl, _iterbuckets_)(struct YU_NAME(tbl, bucket) *left, struct YU_NAME(tbl, bucket) *right, \
+                                        u64 start, u64 cap, u64 *remaining, YU_NAME(tbl, iter_cb) cb, void *data) { \
     u32 stop_code; \
-    u64 cap = 1 << t->capacity, sz = t->size; \
     struct YU_NAME(tbl, bucket) *b; \
-    for (u64 i = 0, j = 0; i < cap && j < sz; i++) { \
-        b = t->left + i; \
+    for (u64 i = start; i < cap && *remaining; i++) { \
+        b = left + i; \
         if (b->is_set & 1) { \
-            ++j; \
+            --*remaining; \
             if ((stop_code = cb(b->key1, b->val1, data))) \
                 return stop_code; \
         } \
         if (b->is_set & 2) { \
-            ++j; \
+            --*remaining; \
             if ((stop_code = cb(b->key2, b->val2, data))) \
                 return stop_code; \
         } \
-        b = t->right + i; \
+        b = right + i; \
         if (b->is_set & 1) { \
-            ++j; \
+            --*remaining; \
             if ((stop_code = cb(b->key1, b->val1, data))) \
                 return stop_code; \
         } \
         if (b->is_set & 2) { \
-            ++j; \
+            --*remaining; \
             if ((stop_code = cb(b->key2, b->val2, data))) \
                 return stop_code; \
         } \
@@ -110,15 +201,27 @@ u32 YU_NAME(tbl, iter)(tbl *t, YU_NAME(tbl, iter_cb) cb, void *data) { \
     return 0; \
 } \
 \
-u8 YU_NAME(tbl, _findbucket_)(tbl *t, key_t k, struct YU_NAME(tbl, bucket) **b_out) { \
+u32 YU_NAME(tbl, iter)(tbl *t, YU_NAME(tbl, iter_cb) cb, void *data) { \
+    u32 stop_code; \
+    u64 remaining = t->size; \
+    /* Buckets before migrate_pos have already been emptied */ \
+    if (t->old_left && (stop_code = YU_NAME(tbl, _iterbuckets_)(t->old_left, t->old_right, t->migrate_pos, \
+                                                              1 << t->old_capacity, &remaining, cb, data))) \
+        return stop_code; \
+    return YU_NAME(tbl, _iterbuckets_)(t->left, t->right, 0, 1 << t->capacity, &remaining, cb, data); \
+} \
+\
+u8 YU_NAME(tbl, _lookup_)(struct YU_NAME(tbl, bucket) *left, struct YU_NAME(tbl, bucket) *right, u8 capacity, \
+                          key_t k, u64 h1, u64 h2, struct YU_NAME(tbl, bucket) **b_out) { \
     u64 cap, idx1, idx2; \
     struct YU_NAME(tbl, bucket) *b1, *b2; \
 \
-    cap = 1 << t->capacity; \
-    idx1 = hash1(k) & (cap - 1); \
-    idx2 = hash2(k) & (cap - 1); \
-    b1 = t->left + idx1; \
-    b2 = t->right + idx2; \
+    cap = 1 << capacity; \
+    idx1 = h1 & (cap - 1); \
+    idx2 = h2 & (cap - 1); \
+    b1 = left + idx1; \
+    b2 = right + idx2; \
+    __builtin_prefetch(b2); \
     if ((b1->is_set & 1) && eq(k, b1->key1)) { \
         *b_out = b1; \
         return 1; \
@@ -143,6 +246,21 @@ u8 YU_NAME(tbl, _findbucket_)(tbl *t, key_t k, struct YU_NAME(tbl, bucket) **b_o
     } \
 } \
 \
+u8 YU_NAME(tbl, _findhashed_)(tbl *t, key_t k, u64 h1, u64 h2, struct YU_NAME(tbl, bucket) **b_out) { \
+    struct YU_NAME(tbl, bucket) *b_old; \
+    u8 b_idx = YU_NAME(tbl, _lookup_)(t->left, t->right, t->capacity, k, h1, h2, b_out); \
+    if (b_idx || !t->old_left) \
+        return b_idx; \
+    /* Not migrated yet? On a miss b_out keeps pointing into the new arrays. */ \
+    if ((b_idx = YU_NAME(tbl, _lookup_)(t->old_left, t->old_right, t->old_capacity, k, h1, h2, &b_old))) \
+        *b_out = b_old; \
+    return b_idx; \
+} \
+\
+u8 YU_NAME(tbl, _findbucket_)(tbl *t, key_t k, struct YU_NAME(tbl, bucket) **b_out) { \
+    return YU_NAME(tbl, _findhashed_)(t, k, hash1(k), hash2(k), b_out); \
+} \
+\
 bool YU_NAME(tbl, get)(tbl *t, key_t k, val_t *v_out) { \
     struct YU_NAME(tbl, bucket) *b; \
     u8 b_idx = YU_NAME(tbl, _findbucket_)(t, k, &b); \
@@ -153,6 +271,36 @@ bool YU_NAME(tbl, get)(tbl *t, key_t k, val_t *v_out) { \
     return false; \
 } \
 \
+/* Looks up keys[0..n), setting vals_out[i] (if vals_out isn't NULL) when \
+   found and found_out[i] (if found_out isn't NULL) either way. Returns how \
+   many keys were found. */ \
+u64 YU_NAME(tbl, get_many)(tbl *t, key_t *keys, u64 n, val_t *vals_out, bool *found_out) { \
+    u64 h1[YU_HASHTABLE_BATCH], h2[YU_HASHTABLE_BATCH], found = 0, mask; \
+    struct YU_NAME(tbl, bucket) *b; \
+    u8 b_idx; \
+    for (u64 base = 0; base < n; base += YU_HASHTABLE_BATCH) { \
+        u64 cnt = min(n - base, (u64)YU_HASHTABLE_BATCH); \
+        /* Mid-resize, keys not found in the new arrays fall back to the \
+           old ones; those aren't prefetched. */ \
+        mask = (1 << t->capacity) - 1; \
+        for (u64 i = 0; i < cnt; i++) { \
+            h1[i] = hash1(keys[base + i]); \
+            h2[i] = hash2(keys[base + i]); \
+            __builtin_prefetch(t->left + (h1[i] & mask)); \
+            __builtin_prefetch(t->right + (h2[i] & mask)); \
+        } \
+        for (u64 i = 0; i < cnt; i++) { \
+            b_idx = YU_NAME(tbl, _findhashed_)(t, keys[base + i], h1[i], h2[i], &b); \
+            if (b_idx) { \
+                if (vals_out) vals_out[base + i] = b_idx == 1 ? b->val1 : b->val2; \
+                ++found; \
+            } \
+            if (found_out) found_out[base + i] = b_idx != 0; \
+        } \
+    } \
+    return found; \
+} \
+\
 val_t YU_NAME(tbl, try_get)(tbl *t, key_t k, val_t default_val) { \
     val_t v; \
     if (YU_NAME(tbl, get)(t, k, &v)) \
@@ -160,31 +308,100 @@ val_t YU_NAME(tbl, try_get)(tbl *t, key_t k, val_t default_val) { \
     return default_val; \
 } \
 \
-bool YU_NAME(tbl, _insert_)(tbl *t, bool left_insert, key_t k, val_t v, val_t *v_out, u8 iter_count); \
+void YU_NAME(tbl, _migrate_)(tbl *t, u64 steps) { \
+    struct YU_NAME(tbl, bucket) l, r; \
+    /* Re-check old_left every time around: an insert below can grow the \
+       table again, which finishes this migration before starting the next. */ \
+    while (t->old_left && steps--) { \
+        u64 i = t->migrate_pos++; \
+        l = t->old_left[i]; \
+        r = t->old_right[i]; \
+        t->old_left[i].is_set = t->old_right[i].is_set = 0; \
+        /* Let go of the old arrays before the last inserts so a nested \
+           grow never sees a half-finished migration pointing at them. */ \
+        if (t->migrate_pos == (u64)1 << t->old_capacity) { \
+            yu_free(t->memctx, t->old_left); \
+            yu_free(t->memctx, t->old_right); \
+            t->old_left = t->old_right = NULL; \
+        } \
+        if (l.is_set & 1) \
+            YU_NAME(tbl, _insert_)(t, true, l.key1, l.val1, NULL, 0); \
+        if (l.is_set & 2) \
+            YU_NAME(tbl, _insert_)(t, true, l.key2, l.val2, NULL, 0); \
+        /* Insert both old buckets into the left new bucket and let insert resolve collisions. */ \
+        if (r.is_set & 1) \
+            YU_NAME(tbl, _insert_)(t, true, r.key1, r.val1, NULL, 0); \
+        if (r.is_set & 2) \
+            YU_NAME(tbl, _insert_)(t, true, r.key2, r.val2, NULL, 0); \
+    } \
+} \
 \
-void YU_NAME(tbl, _rehash_)(tbl *t, struct YU_NAME(tbl, bucket) *left, struct YU_NAME(tbl, bucket) *right, u64 cap) { \
-    struct YU_NAME(tbl, bucket) *b; \
-    for (u64 i = 0; i < cap; i++) { \
-        b = left + i; \
-        /* No need to unset the buckets; they are old and get freed after the rehash anyway. */ \
-        if (b->is_set & 1) \
-            YU_NAME(tbl, _insert_)(t, true, b->key1, b->val1, NULL, 0); \
-        if (b->is_set & 2) \
-            YU_NAME(tbl, _insert_)(t, true, b->key2, b->val2, NULL, 0); \
-        b = right + i; \
-        /* Also, insert both old buckets into the left new bucket and let insert resolve collisions. */ \
-        if (b->is_set & 1) \
-            YU_NAME(tbl, _insert_)(t, true, b->key1, b->val1, NULL, 0); \
-        if (b->is_set & 2) \
-            YU_NAME(tbl, _insert_)(t, true, b->key2, b->val2, NULL, 0); \
+/* Starts an incremental resize to 2^capacity buckets per side. Returns false \
+   (leaving the table as it was) if allocating fails, if a grow finds the table \
+   already that big, or if a shrink would end up with no fewer buckets after all. */ \
+bool YU_NAME(tbl, _resize_)(tbl *t, u8 capacity, bool must_succeed) { \
+    struct YU_NAME(tbl, bucket) *left, *right; \
+    bool shrinking = capacity < t->capacity; \
+    /* Resizing again before the last migration finished is rare (growing \
+       doubles the size, shrinking leaves at least 50% free); just finish \
+       it synchronously. That can grow the table itself, so only compare \
+       against t->capacity afterwards: installing a grow that isn't one \
+       would shrink the table back and set off the same grows again. */ \
+    YU_NAME(tbl, _migrate_)(t, UINT64_MAX); \
+    if (!shrinking && capacity <= t->capacity) \
+        return false; \
+    if (!YU_NAME(tbl, _alloc_buckets_)(t, &capacity, &left, &right)) { \
+        if (must_succeed) \
+            yu_global_fatal_handler(YU_ERR_ALLOC_FAIL); \
+        return false; \
+    } \
+    if (shrinking && capacity >= t->capacity) { \
+        yu_free(t->memctx, left); \
+        yu_free(t->memctx, right); \
+        return false; \
+    } \
+    t->old_left = t->left; \
+    t->old_right = t->right; \
+    t->old_capacity = t->capacity; \
+    t->migrate_pos = 0; \
+    t->left = left; \
+    t->right = right; \
+    t->capacity = capacity; \
+    return true; \
+} \
+\
+void YU_NAME(tbl, _grow_)(tbl *t) { \
+    /* Whatever capacity the pending migration ends up with, it's too small */ \
+    YU_NAME(tbl, _migrate_)(t, UINT64_MAX); \
+    YU_NAME(tbl, _resize_)(t, t->capacity + 1, true); \
+} \
+\
+void YU_NAME(tbl, reserve)(tbl *t, u64 n) { \
+    u8 k = yu__hashtable_fit(n); \
+    t->min_capacity = max(t->min_capacity, k); \
+    if (k > t->capacity) { \
+        /* The caller asked for the cost up front, so pay it all now */ \
+        YU_NAME(tbl, _resize_)(t, k, true); \
+        YU_NAME(tbl, _migrate_)(t, UINT64_MAX); \
     } \
 } \
 \
+bool YU_NAME(tbl, compact)(tbl *t) { \
+    u8 k = yu__hashtable_fit(t->size); \
+    YU_NAME(tbl, _migrate_)(t, UINT64_MAX); \
+    t->min_capacity = k; \
+    if (k >= t->capacity) \
+        return false; \
+    if (!YU_NAME(tbl, _resize_)(t, k, false)) \
+        return false; \
+    YU_NAME(tbl, _migrate_)(t, UINT64_MAX); \
+    return true; \
+} \
+\
 bool YU_NAME(tbl, _insert_)(tbl *t, bool left_insert, key_t k, val_t v, val_t *v_out, u8 iter_count) { \
-    u64 cap = 1 << t->capacity, new_cap; \
+    u64 cap = 1 << t->capacity; \
     u64 idx = (left_insert ? hash1(k) : hash2(k)) & (cap - 1); \
-    struct YU_NAME(tbl, bucket) *left = t->left, *right = t->right, \
-      *b = left_insert ? left + idx : right + idx; \
+    struct YU_NAME(tbl, bucket) *b = left_insert ? t->left + idx : t->right + idx; \
     key_t move_k; \
     val_t move_v; \
 \
@@ -234,12 +451,7 @@ bool YU_NAME(tbl, _insert_)(tbl *t, bool left_insert, key_t k, val_t v, val_t *v
         else { \
             /* If we've been shuffling for a while assume the table is pretty full */ \
             if (iter_count == 32) { \
-                new_cap = 1 << ++t->capacity; \
-                t->left = yu_xalloc(t->memctx, new_cap, sizeof(struct YU_NAME(tbl, bucket))); \
-                t->right = yu_xalloc(t->memctx, new_cap, sizeof(struct YU_NAME(tbl, bucket))); \
-                YU_NAME(tbl, _rehash_)(t, left, right, cap); \
-                yu_free(t->memctx, left); \
-                yu_free(t->memctx, right); \
+                YU_NAME(tbl, _grow_)(t); \
                 return YU_NAME(tbl, _insert_)(t, true, k, v, v_out, 0); \
             } \
             else { \
@@ -255,18 +467,42 @@ bool YU_NAME(tbl, _insert_)(tbl *t, bool left_insert, key_t k, val_t v, val_t *v
 } \
 \
 bool YU_NAME(tbl, put)(tbl *t, key_t k, val_t v, val_t *v_out) { \
-    bool exists = YU_NAME(tbl, _insert_)(t, true, k, v, v_out, 0); \
-    t->size += !exists; \
-    return exists; \
+    struct YU_NAME(tbl, bucket) *b; \
+    u8 b_idx; \
+    if (t->old_left) \
+        YU_NAME(tbl, _migrate_)(t, YU_HASHTABLE_MIGRATE_STEP); \
+    /* The key may be in the right bucket or still in the old arrays, \
+       neither of which _insert_ looks at. */ \
+    b_idx = YU_NAME(tbl, _findbucket_)(t, k, &b); \
+    if (b_idx) { \
+        if (b_idx == 1) { \
+            if (v_out) *v_out = b->val1; \
+            b->val1 = v; \
+        } \
+        else { \
+            if (v_out) *v_out = b->val2; \
+            b->val2 = v; \
+        } \
+        return true; \
+    } \
+    YU_NAME(tbl, _insert_)(t, true, k, v, NULL, 0); \
+    ++t->size; \
+    return false; \
 } \
 \
 bool YU_NAME(tbl, remove)(tbl *t, key_t k, val_t *v_out) { \
     struct YU_NAME(tbl, bucket) *b; \
-    u8 b_idx = YU_NAME(tbl, _findbucket_)(t, k, &b); \
+    u8 b_idx; \
+    if (t->old_left) \
+        YU_NAME(tbl, _migrate_)(t, YU_HASHTABLE_MIGRATE_STEP); \
+    b_idx = YU_NAME(tbl, _findbucket_)(t, k, &b); \
     if (b_idx) { \
         if (v_out) *v_out = b_idx == 1 ? b->val1 : b->val2; \
         b->is_set &= ~b_idx; \
         --t->size; \
+        if (t->min_load && !t->old_left && t->capacity > t->min_capacity && \
+            t->size * 100 < (u64)t->min_load * (4 << t->capacity)) \
+            YU_NAME(tbl, _resize_)(t, max(yu__hashtable_fit(t->size), t->min_capacity), false); \
         return true; \
     } \
     return false; \
@@ -1,89 +1,261 @@
 #include "yu_common.h"
 
+// Lets go of a freed string's buffer and grapheme index before its slot is
+// reused
+static
+void release_strdat(yu_str_ctx *ctx, struct yu_str_dat *d) {
+    if (d->str != NULL) {
+        // The buffer is refcounted and may outlive this; don't leave it
+        // pointing at a slot that's about to describe another string
+        yu_buf_set_udata(d->str, NULL);
+        yu_buf_free(d->str);
+        d->str = NULL;
+    }
+    if (d->egc_marks != NULL) {
+        yu_free(ctx->bufctx.memctx, d->egc_marks);
+        d->egc_marks = NULL;
+    }
+}
+
 static
 struct yu_str_dat *get_strlist_node(yu_str_ctx *ctx) {
     YU_ERR_DEFVAR
-    for (size_t i = 0; i < ctx->strdatpool_len; i++) {
-        if (!ctx->strdatpool[i].is_used) {
-            if (ctx->strdatpool[i].str != NULL) {
-                yu_buf_free(ctx->strdatpool[i].str);
-                ctx->strdatpool[i].str = NULL;
-            }
-            return ctx->strdatpool + i;
+    struct yu_str_dat *d;
+    struct yu_str_dat_chunk *chunk;
+
+    while ((d = ctx->strdat_free) != NULL) {
+        if ((ctx->strdat_free = d->next_free) == NULL)
+            ctx->strdat_free_tail = NULL;
+        d->is_queued = false;
+        if (!d->is_used && d->slices == 0) {
+            release_strdat(ctx, d);
+            return d;
         }
     }
-    size_t old_sz = ctx->strdatpool_len;
-    ctx->strdatpool_len *= 2;
-    YU_CHECK(yu_realloc(ctx->bufctx.memctx, (void **)&ctx->strdatpool,
-                ctx->strdatpool_len, sizeof(struct yu_str_dat), 0));
-    memset(ctx->strdatpool + old_sz, 0, old_sz * sizeof(struct yu_str_dat));
 
-    return ctx->strdatpool + old_sz;
+    if (ctx->strdat_chunks == NULL || ctx->strdat_chunk_used == YU_STR_DAT_CHUNK) {
+        YU_CHECK(yu_alloc(ctx->bufctx.memctx, (void **)&chunk, 1, sizeof(struct yu_str_dat_chunk), 0));
+        chunk->next = ctx->strdat_chunks;
+        ctx->strdat_chunks = chunk;
+        ctx->strdat_chunk_used = 0;
+    }
+    d = &ctx->strdat_chunks->dats[ctx->strdat_chunk_used++];
+    memset(d, 0, sizeof(*d));
+    return d;
 
     YU_ERR_DEFAULT_HANDLER(NULL)
 }
 
+// Such bytes come out of normalization unchanged (CR and LF don't; NLF2LS
+// turns them into U+2028)
+u64 yu_str_plain_ascii_prefix(const u8 *s, u64 len) {
+    u64 i = 0;
+#ifdef __SSE2__
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        u32 stop = (u32)_mm_movemask_epi8(
+            _mm_or_si128(v, _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr))));
+        if (stop)
+            return i + __builtin_ctz(stop);
+    }
+#else
+#define ONES UINT64_C(0x0101010101010101)
+#define HIGHS UINT64_C(0x8080808080808080)
+// High bit set in some byte if x has a zero byte (never a false negative)
+#define HAS_ZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+    for (; i + 8 <= len; i += 8) {
+        u64 x;
+        memcpy(&x, s + i, sizeof x);
+        if ((x & HIGHS) || HAS_ZERO(x ^ ('\n' * ONES)) || HAS_ZERO(x ^ ('\r' * ONES)))
+            break;
+    }
+#undef HAS_ZERO
+#undef HIGHS
+#undef ONES
+#endif
+    for (; i < len; i++) {
+        if (s[i] >= 0x80 || s[i] == '\n' || s[i] == '\r')
+            break;
+    }
+    return i;
+}
+
+// Whether normalization (NFC with NLF2LS, as yu_str_new does it) would leave
+// `s` unchanged. Conservative in the style of the NFC_QC property: any
+// codepoint that could be reordered, composed with its neighbour, or
+// decomposed into something that doesn't compose back sends the string down
+// the slow path, as does invalid UTF-8 (so the slow path can report it).
+static
+bool is_stable_nfc(const u8 *s, u64 len) {
+    utf8proc_int32_t cp;
+    utf8proc_ssize_t incr;
+    for (u64 i = 0; i < len; i += incr) {
+        if (s[i] < 0x80) {
+            if (s[i] == '\n' || s[i] == '\r')
+                return false;
+            incr = 1;
+            continue;
+        }
+        incr = utf8proc_iterate(s + i, len - i, &cp);
+        if (incr < 0 || cp == 0x85)
+            return false;
+        // Hangul vowel and trailing consonant jamo compose algorithmically
+        if (cp >= 0x1161 && cp <= 0x11c2)
+            return false;
+        const utf8proc_property_t *prop = utf8proc_get_property(cp);
+        if (prop->combining_class != 0 || prop->comb2nd_index >= 0)
+            return false;
+        // Precomposed characters (é, ü, ñ, …) compose right back, except for
+        // the full composition exclusions: the listed ones, singletons, and
+        // ones that decompose to a combining mark first
+        if (prop->decomp_mapping != NULL && prop->decomp_type == 0 &&
+                (prop->comp_exclusion || prop->decomp_mapping[1] < 0 ||
+                 utf8proc_get_property(prop->decomp_mapping[0])->combining_class != 0))
+            return false;
+    }
+    return true;
+}
+
+// Moves *i from the start of a grapheme cluster to the start of the next one
+static
+YU_ERR_RET next_grapheme(const u8 *s, u64 len, u64 *i) {
+    YU_ERR_DEFVAR
+    utf8proc_int32_t cp1, cp2;
+    utf8proc_ssize_t incr;
+    u64 pos = *i;
+
+    // Two ASCII characters in a row always have a break between them, unless
+    // they're CR LF
+    if (s[pos] < 0x80 && (pos + 1 == len || (s[pos + 1] < 0x80 && s[pos] != '\r'))) {
+        *i = pos + 1;
+        return 0;
+    }
+
+    incr = utf8proc_iterate(s + pos, len - pos, &cp1);
+    YU_THROWIF(incr < 0, YU_ERR_UNKNOWN);
+    for (pos += incr; pos < len; pos += incr, cp1 = cp2) {
+        incr = utf8proc_iterate(s + pos, len - pos, &cp2);
+        YU_THROWIF(incr < 0, YU_ERR_UNKNOWN);
+        if (utf8proc_grapheme_break(cp1, cp2))
+            break;
+    }
+    *i = pos;
+    return 0;
+
+    YU_ERR_DEFAULT_HANDLER(yu_local_err)
+}
+
+// Whether s[start..end), the last cluster of a string, is a lone format
+// character, which isn't counted as a cluster
+static
+bool is_lone_trailing_format(const u8 *s, u64 start, u64 end) {
+    utf8proc_int32_t cp;
+    return utf8proc_iterate(s + start, end - start, &cp) == (utf8proc_ssize_t)(end - start) &&
+        utf8proc_category(cp) == UTF8PROC_CATEGORY_CF;
+}
+
+YU_INLINE
+u64 get_mark(struct yu_str_dat *d, u64 n) {
+    return d->egc_wide_marks ? ((u64 *)d->egc_marks)[n - 1] : ((u32 *)d->egc_marks)[n - 1];
+}
+
 static
 YU_ERR_RET find_grapheme_clusters(yu_str s) {
     YU_ERR_DEFVAR
-    u64 buflen = yu_buf_len(s), cnt = 0, gcstart, *idxs;
+    u64 buflen = yu_buf_len(s), cnt = 0, gcstart, nmarks = 0;
     struct yu_str_dat *d = YU_STR_DAT(s);
+    yu_allocator *mctx = d->ctx->bufctx.memctx;
+    bool wide = buflen > UINT32_MAX;
+    u8 mark_size = wide ? sizeof(u64) : sizeof(u32);
+    u8 *marks = NULL;
+
+    // Every byte of plain ASCII is its own grapheme cluster, so there's no
+    // need to store (or compute) any marks
+    u64 ascii = yu_str_plain_ascii_prefix(s, buflen);
+    if (ascii == buflen) {
+        d->is_ascii = true;
+        d->egc_count = buflen;
+        d->egc_marks = NULL;
+        return 0;
+    }
+    // Recycled slots keep whatever the last string there was
+    d->is_ascii = false;
 
-    idxs = buflen < YU_STR_BIG_THRESHOLD ? yu_xalloc(d->ctx->bufctx.memctx, buflen, sizeof(u64)) : NULL;
+    // There can't be more clusters than bytes; trimmed below
+    if (buflen > YU_STR_EGC_STRIDE)
+        YU_CHECK(yu_alloc(mctx, (void **)&marks, buflen / YU_STR_EGC_STRIDE, mark_size, 0));
 
-    utf8proc_ssize_t incr;
-    utf8proc_int32_t cp1, cp2;
     for (u64 i = 0; i < buflen;) {
-        incr = utf8proc_iterate(s + i, buflen - i, &cp1);
-        YU_THROWIF(incr < 0, YU_ERR_UNKNOWN);
         gcstart = i;
-        i += incr;
-        if (i < buflen) {
-            incr = utf8proc_iterate(s + i, buflen - i, &cp2);
-            YU_THROWIF(incr < 0, YU_ERR_UNKNOWN);
-
-            while (!utf8proc_grapheme_break(cp1, cp2)) {
-                cp1 = cp2;
-                if (i < buflen) {
-                    i += incr;
-                    incr = utf8proc_iterate(s + i, buflen - i, &cp2);
-                    YU_THROWIF(incr < 0, YU_ERR_UNKNOWN);
-                }
-                else
-                    break;
-            }
-            ++cnt;
-        }
+        // The last byte of the prefix may be the base of a combining sequence
+        if (i + 1 < ascii)
+            ++i;
         else
-            cnt += utf8proc_category(cp1) != UTF8PROC_CATEGORY_CF;
-        if (idxs)
-            idxs[cnt - 1] = gcstart;
+            YU_CHECK(next_grapheme(s, buflen, &i));
+
+        // A lone format character at the very end isn't counted
+        if (i == buflen && is_lone_trailing_format(s, gcstart, i))
+            break;
+
+        if (cnt % YU_STR_EGC_STRIDE == 0 && cnt != 0) {
+            if (wide)
+                ((u64 *)marks)[nmarks++] = gcstart;
+            else
+                ((u32 *)marks)[nmarks++] = (u32)gcstart;
+        }
+        ++cnt;
     }
+
+    if (marks != NULL && nmarks < buflen / YU_STR_EGC_STRIDE) {
+        // Copy rather than realloc; not every allocator can shrink in place
+        u8 *fit = NULL;
+        if (nmarks != 0) {
+            YU_CHECK(yu_alloc(mctx, (void **)&fit, nmarks, mark_size, 0));
+            memcpy(fit, marks, nmarks * mark_size);
+        }
+        yu_free(mctx, marks);
+        marks = fit;
+    }
+
     d->egc_count = cnt;
-    d->egc_idx = idxs;
+    d->egc_marks = marks;
+    d->egc_wide_marks = wide;
     return 0;
 
-    YU_ERR_DEFAULT_HANDLER(yu_local_err)
+    YU_ERR_HANDLER_BEGIN
+    YU_HANDLE_FATALS
+    YU_CATCH_ALL
+      if (marks != NULL)
+          yu_free(mctx, marks);
+    YU_ERR_HANDLER_END
+    return yu_local_err;
 }
 
 void yu_str_ctx_init(yu_str_ctx *ctx, yu_allocator *mctx) {
-    YU_ERR_DEFVAR
-
     yu_buf_ctx_init(&ctx->bufctx, mctx);
-    ctx->strdatpool_len = 2000;
-    YU_CHECK_ALLOC(ctx->strdatpool = yu_xalloc(mctx, ctx->strdatpool_len, sizeof(struct yu_str_dat)));
-    return;
-
-    YU_ERR_DEFAULT_HANDLER(NOTHING())
+    ctx->strdat_chunks = NULL;
+    ctx->strdat_chunk_used = 0;
+    ctx->strdat_free = ctx->strdat_free_tail = NULL;
 }
 
 void yu_str_ctx_free(yu_str_ctx *ctx) {
-    for (size_t i = 0; i < ctx->strdatpool_len; i++) {
-        if (ctx->strdatpool[i].is_used)
-            yu_buf_free(ctx->strdatpool[i].str);
+    struct yu_str_dat_chunk *chunk, *next;
+    for (chunk = ctx->strdat_chunks; chunk != NULL; chunk = next) {
+        // Only the newest chunk can be partly handed out
+        u32 n = chunk == ctx->strdat_chunks ? ctx->strdat_chunk_used : YU_STR_DAT_CHUNK;
+        for (u32 i = 0; i < n; i++) {
+            struct yu_str_dat *d = &chunk->dats[i];
+            // Freed strings that were never recycled still hold their buffer
+            if (d->str != NULL)
+                yu_buf_free(d->str);
+            if (d->egc_marks != NULL)
+                yu_free(ctx->bufctx.memctx, d->egc_marks);
+        }
+        next = chunk->next;
+        yu_free(ctx->bufctx.memctx, chunk);
     }
 
-    yu_free(ctx->bufctx.memctx, ctx->strdatpool);
     yu_buf_ctx_free(&ctx->bufctx);
 }
 
@@ -102,13 +274,14 @@ void free_wrapper(void *mctx, void *ptr) {
     yu_free((yu_allocator *)mctx, ptr);
 }
 
-// We now get ownership of utf8_nfc
-YU_ERR_RET yu_str_adopt(yu_str_ctx *ctx, const u8 * restrict utf8_nfc, u64 byte_len, yu_str * restrict out) {
+// Finds or creates the interned string with these (normalized) contents
+static
+YU_ERR_RET intern(yu_str_ctx *ctx, const u8 * restrict utf8_nfc, u64 byte_len, yu_str * restrict out) {
     YU_ERR_DEFVAR
     struct yu_str_dat *sdat;
-    *out = yu_buf_new(&ctx->bufctx, utf8_nfc, byte_len, true);
+    YU_CHECK_ALLOC(*out = yu_buf_new(&ctx->bufctx, utf8_nfc, byte_len, true));
     if (yu_buf_get_udata(*out) == NULL) {  // Not interned yet
-        sdat = get_strlist_node(ctx);
+        YU_CHECK_ALLOC(sdat = get_strlist_node(ctx));
         sdat->str = *out;
         sdat->ctx = ctx;
         sdat->is_used = true;
@@ -116,22 +289,45 @@ YU_ERR_RET yu_str_adopt(yu_str_ctx *ctx, const u8 * restrict utf8_nfc, u64 byte_
         YU_CHECK(find_grapheme_clusters(*out));
     }
     else {
-        // This string already exists, which means we can (and should) free
-        // utf8_nfc (we own him now).
-        yu_free(ctx->bufctx.memctx, (void *)utf8_nfc);  // shut up clang
+        // The string holds the one reference to its buffer that it needs;
+        // don't count every lookup of it
+        yu_buf_free(*out);
         // In case the string has been ‘freed’ (i.e. set to unused, but still
         // holding on to allocated memory), say we're using it again.
-        ((struct yu_str_dat *)yu_buf_get_udata(*out))->is_used = true;
+        sdat = yu_buf_get_udata(*out);
+        sdat->is_used = true;
+        // The collector can't see C references, so count them
+        if (sdat->gc_weak)
+            ++sdat->gc_strong;
     }
     return 0;
     YU_ERR_DEFAULT_HANDLER(yu_local_err)
 }
 
+// We now get ownership of utf8_nfc
+YU_ERR_RET yu_str_adopt(yu_str_ctx *ctx, const u8 * restrict utf8_nfc, u64 byte_len, yu_str * restrict out) {
+    YU_ERR_DEFVAR
+    yu_local_err = intern(ctx, utf8_nfc, byte_len, out);
+    // The buffer has its own copy (or the string already existed), so we can
+    // (and should) free utf8_nfc (we own him now).
+    yu_free(ctx->bufctx.memctx, (void *)utf8_nfc);  // shut up clang
+    return yu_local_err;
+}
+
 YU_ERR_RET yu_str_new(yu_str_ctx *ctx, const u8 * restrict utf8, u64 len, yu_str * restrict out) {
     YU_ERR_DEFVAR
     u8 *nfc;
     ssize_t nfc_sz;
 
+    // Most strings are plain ASCII or otherwise already normalized; intern
+    // those straight from the caller's bytes rather than through a copy
+    // made by utf8proc
+    u64 ascii = yu_str_plain_ascii_prefix(utf8, len);
+    if (ascii == len || is_stable_nfc(utf8 + ascii, len - ascii)) {
+        YU_CHECK(intern(ctx, utf8, len, out));
+        return 0;
+    }
+
     nfc_sz = utf8proc_map(utf8, len, &nfc, UTF8PROC_COMPOSE | UTF8PROC_STABLE | UTF8PROC_NLF2LS,
             alloc_wrapper, free_wrapper, ctx->bufctx.memctx);
 
@@ -157,10 +353,97 @@ YU_ERR_RET yu_str_new_z(yu_str_ctx *ctx, const char * restrict cstr, yu_str * re
     return yu_str_new(ctx, (const u8 *)cstr, strlen(cstr), out);
 }
 
+// Queues a string that's no longer used (or viewed by slices) for reuse
+static
+void queue_strdat(struct yu_str_dat *d) {
+    yu_str_ctx *ctx = d->ctx;
+    if (!d->is_queued) {
+        d->is_queued = true;
+        d->next_free = NULL;
+        if (ctx->strdat_free_tail != NULL)
+            ctx->strdat_free_tail->next_free = d;
+        else
+            ctx->strdat_free = d;
+        ctx->strdat_free_tail = d;
+    }
+}
+
 void yu_str_free(yu_str s) {
     // Memory from `s` will be freed later if requested; until then keep it around
     // in case the same string is requested again.
-    YU_STR_DAT(s)->is_used = false;
+    struct yu_str_dat *d = YU_STR_DAT(s);
+    if (d->gc_weak) {  // The collector decides when this goes
+        if (d->gc_strong)
+            --d->gc_strong;
+        return;
+    }
+    d->is_used = false;
+    if (d->slices == 0)
+        queue_strdat(d);
+}
+
+void yu_str_gc_own(yu_str s) {
+    struct yu_str_dat *d = YU_STR_DAT(s);
+    if (d->gc_weak) {
+        // Already the collector's; the caller's reference was counted
+        if (d->gc_strong)
+            --d->gc_strong;
+        return;
+    }
+    d->gc_weak = true;
+    d->gc_reached = false;
+    d->gc_strong = 0;
+}
+
+void yu_str_ctx_sweep(yu_str_ctx *ctx) {
+    struct yu_str_dat_chunk *chunk;
+    for (chunk = ctx->strdat_chunks; chunk != NULL; chunk = chunk->next) {
+        u32 n = chunk == ctx->strdat_chunks ? ctx->strdat_chunk_used : YU_STR_DAT_CHUNK;
+        for (u32 i = 0; i < n; i++) {
+            struct yu_str_dat *d = &chunk->dats[i];
+            if (!d->gc_weak)
+                continue;
+            if (d->gc_reached) {
+                d->gc_reached = false;
+                continue;
+            }
+            if (d->gc_strong)
+                continue;
+            // Unlike yu_str_free, this doesn't keep the string interned in
+            // case it's asked for again: nothing references it anymore, and
+            // keeping it is what makes the table grow without bound.
+            d->gc_weak = false;
+            d->is_used = false;
+            if (d->slices == 0) {
+                release_strdat(ctx, d);
+                queue_strdat(d);
+            }
+        }
+    }
+}
+
+// Byte offset of grapheme cluster n of s, walking from the nearest mark at or
+// before it. The offset of cluster yu_str_len(s) is the end of the string.
+static
+YU_ERR_RET grapheme_offset(yu_str s, u64 n, u64 *out) {
+    YU_ERR_DEFVAR
+    struct yu_str_dat *d = YU_STR_DAT(s);
+    u64 buflen = yu_buf_len(s), m, pos;
+
+    if (d->is_ascii || n == 0)
+        *out = n;
+    else if (n >= d->egc_count)
+        *out = buflen;
+    else {
+        m = n / YU_STR_EGC_STRIDE;
+        pos = m == 0 ? 0 : get_mark(d, m);
+        for (u64 i = m * YU_STR_EGC_STRIDE; i < n; i++)
+            YU_CHECK(next_grapheme(s, buflen, &pos));
+        *out = pos;
+    }
+    return 0;
+
+    YU_ERR_DEFAULT_HANDLER(yu_local_err)
 }
 
 YU_ERR_RET yu_str_at(yu_str s, s64 idx, yu_str *char_out) {
@@ -173,16 +456,80 @@ YU_ERR_RET yu_str_at(yu_str s, s64 idx, yu_str *char_out) {
     u64 actual_idx = idx < 0 ? d->egc_count - (u64)llabs(idx) : (u64)idx, start, len,
         buflen = YU_BUF_DAT(s)->len;
 
-    if (YU_STR_DAT(s)->egc_idx != NULL) {
-        start = d->egc_idx[actual_idx];
-        len = actual_idx == d->egc_count - 1 ? buflen - start : d->egc_idx[actual_idx + 1] - start;
-        YU_CHECK(yu_str_new(d->ctx, s + start, len, char_out));
+    YU_CHECK(grapheme_offset(s, actual_idx, &start));
+    if (d->is_ascii)
+        len = 1;
+    else {
+        len = start;
+        YU_CHECK(next_grapheme(s, buflen, &len));
+        len -= start;
     }
+    YU_CHECK(yu_str_new(d->ctx, s + start, len, char_out));
     return 0;
 
     YU_ERR_DEFAULT_HANDLER(yu_local_err)
 }
 
+void yu_str_iter_init(yu_str_iter *it, yu_str s) {
+    it->s = s;
+    it->pos = 0;
+    it->len = yu_buf_len(s);
+    it->ascii_end = YU_STR_DAT(s)->is_ascii ? it->len : 0;
+    it->ends_str = true;
+}
+
+void yu_str_slice_iter_init(yu_str_iter *it, const yu_str_slice *sl) {
+    it->s = yu_str_slice_bytes(sl);
+    it->pos = 0;
+    it->len = sl->byte_len;
+    it->ascii_end = YU_STR_DAT(sl->parent)->is_ascii ? it->len : 0;
+    it->ends_str = sl->byte_start + sl->byte_len == yu_buf_len(sl->parent);
+}
+
+bool yu_str_next_byte(yu_str_iter *it, u8 *out) {
+    if (it->pos == it->len)
+        return false;
+    *out = it->s[it->pos++];
+    return true;
+}
+
+bool yu_str_next_cp(yu_str_iter *it, u32 *out) {
+    utf8proc_int32_t cp;
+    if (it->pos == it->len)
+        return false;
+    if (it->pos < it->ascii_end) {
+        *out = it->s[it->pos++];
+        return true;
+    }
+    utf8proc_ssize_t incr = utf8proc_iterate(it->s + it->pos, it->len - it->pos, &cp);
+    assert(incr > 0);  // Strings are always valid UTF-8
+    if (cp < 0x80)
+        it->ascii_end = yu_str_ascii_run_end(it->s, it->len, it->pos);
+    it->pos += incr;
+    *out = (u32)cp;
+    return true;
+}
+
+bool yu_str_next_grapheme(yu_str_iter *it, u64 *start, u64 *len) {
+    u64 pos = it->pos;
+    if (pos == it->len)
+        return false;
+    if (yu_str_ascii_cluster(pos, it->ascii_end))
+        ++it->pos;
+    else {
+        yu_err err = next_grapheme(it->s, it->len, &it->pos);
+        assert(err == YU_OK);  // Strings are always valid UTF-8
+        (void)err;
+        if (it->pos == it->len && it->ends_str && is_lone_trailing_format(it->s, pos, it->pos))
+            return false;  // Not counted by yu_str_len either
+        if (it->s[pos] < 0x80)
+            it->ascii_end = yu_str_ascii_run_end(it->s, it->len, pos);
+    }
+    *start = pos;
+    *len = it->pos - pos;
+    return true;
+}
+
 s32 yu_str_cmp(yu_str a, yu_str b) {
     // Use buf_len; it doesn't require any calculation and if str_len differs, buf_len will too.
     s32 len_diff = yu_buf_len(a) > yu_buf_len(b) - (yu_buf_len(a) < yu_buf_len(b));
@@ -217,3 +564,86 @@ YU_ERR_RET yu_str_cat_z(yu_str a, const char * restrict cstr, yu_str *out) {
 
     YU_ERR_DEFAULT_HANDLER(yu_local_err)
 }
+
+YU_ERR_RET yu_str_slice_new(yu_str s, u64 start, u64 len, yu_str_slice *out) {
+    YU_ERR_DEFVAR
+    struct yu_str_dat *d = YU_STR_DAT(s);
+    u64 end;
+
+    YU_THROWIF(start > d->egc_count || len > d->egc_count - start, YU_ERR_STRING_INDEX_OUT_OF_BOUNDS);
+    YU_CHECK(grapheme_offset(s, start, &out->byte_start));
+    YU_CHECK(grapheme_offset(s, start + len, &end));
+    out->parent = s;
+    out->byte_len = end - out->byte_start;
+    out->egc_start = start;
+    out->egc_len = len;
+    ++d->slices;
+    return 0;
+
+    YU_ERR_DEFAULT_HANDLER(yu_local_err)
+}
+
+YU_ERR_RET yu_str_slice_sub(const yu_str_slice *sl, u64 start, u64 len, yu_str_slice *out) {
+    YU_ERR_DEFVAR
+    YU_THROWIF(start > sl->egc_len || len > sl->egc_len - start, YU_ERR_STRING_INDEX_OUT_OF_BOUNDS);
+    YU_CHECK(yu_str_slice_new(sl->parent, sl->egc_start + start, len, out));
+    return 0;
+
+    YU_ERR_DEFAULT_HANDLER(yu_local_err)
+}
+
+void yu_str_slice_free(yu_str_slice *sl) {
+    struct yu_str_dat *d = YU_STR_DAT(sl->parent);
+    if (--d->slices == 0 && !d->is_used)
+        queue_strdat(d);
+}
+
+bool yu_str_slice_eq(const yu_str_slice *a, const yu_str_slice *b) {
+    // Same normalization, so equal text means equal bytes
+    return a->byte_len == b->byte_len &&
+        memcmp(yu_str_slice_bytes(a), yu_str_slice_bytes(b), a->byte_len) == 0;
+}
+
+YU_ERR_RET yu_str_slice_intern(const yu_str_slice *sl, yu_str *out) {
+    // Both ends fall on grapheme cluster boundaries of text that's already
+    // normalized, so the slice is too
+    return intern(YU_STR_DAT(sl->parent)->ctx, yu_str_slice_bytes(sl), sl->byte_len, out);
+}
+
+YU_ERR_RET yu_str_builder_init(yu_str_builder *b, yu_str_ctx *ctx, u64 size_hint) {
+    YU_ERR_DEFVAR
+    b->ctx = ctx;
+    // Some room to start with saves the first few regrowths
+    YU_CHECK_ALLOC(b->buf = yu_buf_new(&ctx->bufctx, NULL, size_hint < 16 ? 16 : size_hint, false));
+    return 0;
+
+    YU_ERR_DEFAULT_HANDLER(yu_local_err)
+}
+
+YU_ERR_RET yu_str_builder_append(yu_str_builder *b, const u8 *utf8, u64 len) {
+    YU_ERR_DEFVAR
+    yu_buf grown;
+    YU_CHECK_ALLOC(grown = yu_buf_append(b->buf, utf8, len));
+    b->buf = grown;
+    return 0;
+
+    YU_ERR_DEFAULT_HANDLER(yu_local_err)
+}
+
+YU_ERR_RET yu_str_builder_append_str(yu_str_builder *b, yu_str s) {
+    return yu_str_builder_append(b, s, yu_buf_len(s));
+}
+
+YU_ERR_RET yu_str_builder_finish(yu_str_builder *b, yu_str *out) {
+    // Pieces weren't necessarily normalized (and normalizing them one by one
+    // wouldn't make the whole normalized), so this goes through yu_str_new;
+    // it's cheap for text that turns out to be normalized already.
+    yu_err err = yu_str_new(b->ctx, b->buf, yu_buf_len(b->buf), out);
+    yu_str_builder_free(b);
+    return err;
+}
+
+void yu_str_builder_free(yu_str_builder *b) {
+    yu_buf_free(b->buf);
+    b->buf = NULL;
+}
@@ -4,39 +4,67 @@
 
 #include "utf8proc/utf8proc.h"
 
-#define YU_STR_BIG_THRESHOLD 1024
+// Every string remembers where each YU_STR_EGC_STRIDEth grapheme cluster
+// starts; see struct yu_str_dat
+#define YU_STR_EGC_STRIDE 16
+
+#define YU_STR_DAT_CHUNK 256
 
 typedef yu_buf yu_str;
 
 struct yu_str_dat;
+struct yu_str_dat_chunk;
 
 typedef struct {
     yu_buf_ctx bufctx;
-    struct yu_str_dat * restrict strdatpool;
-    size_t strdatpool_len;
+    // yu_str_dats are handed out from fixed-size chunks, so their addresses
+    // (which buffers hold as udata) never change. Freed ones are queued on
+    // strdat_free and reused oldest first, which keeps recently freed strings
+    // around the longest in case they're asked for again.
+    struct yu_str_dat_chunk *strdat_chunks;
+    u32 strdat_chunk_used;
+    struct yu_str_dat *strdat_free, *strdat_free_tail;
 } yu_str_ctx;
 
 struct yu_str_dat {
     bool is_used;
-
-    // Extended Grapheme Cluster indexes in this string.
-    // Only store this for small strings, so random access is fast
-    // (O(1), just a couple of pointer dereferences) but uses more
-    // memory (up to 2x more, which is actually the common case on
-    // English text).
-    // Big strings are stored without grapheme cluster data, so random
-    // access is slower (O(n)) but uses much less memory.
-    // We consider strings over YU_STR_BIG_THRESHOLD to be big; 1kibibyte
-    // by default.
-    //
-    // TODO there's gotta be an efficient way to do this
-    // It _really_ seems like the sort of thing that's possible to have
-    // O(lg n) access time with O(n lg n) or better memory overhead.
-    u64 *egc_idx;
+    // Still queued on ctx->strdat_free. A string that's used again after
+    // being freed stays queued and is skipped when it comes up.
+    bool is_queued;
+    // Number of live yu_str_slices of this string, which keep it from being
+    // reused even once it's freed
+    u32 slices;
+
+    // Byte offsets of every YU_STR_EGC_STRIDEth extended grapheme cluster
+    // (the first one, at 0, isn't stored), so getting to any cluster means
+    // walking at most YU_STR_EGC_STRIDE - 1 clusters from the nearest mark.
+    // That's O(1) access (for a fixed stride) at a cost of 4 bytes per
+    // stride: ~1/4 byte per grapheme, where a full u64 offset per grapheme
+    // used to take 8.
+    // Strings with no more than YU_STR_EGC_STRIDE clusters have no marks.
+    // Offsets are u32, or u64 when egc_wide_marks is set (strings of 4GiB
+    // and up).
+    void *egc_marks;
+    bool egc_wide_marks;
     u64 egc_count;
+    // Plain ASCII, so grapheme cluster i is byte i and there are no marks
+    bool is_ascii;
+    // Owned by the garbage collector (see yu_str_gc_own): the intern table
+    // only holds it weakly, and yu_str_ctx_sweep clears it unless gc_reached
+    // was set since the previous sweep
+    bool gc_weak, gc_reached;
+    // While gc_weak: lookups of it from C (yu_str_new & co.) not yet given
+    // back with yu_str_free. The sweep leaves it alone until these are gone.
+    u32 gc_strong;
 
     yu_str str;
     yu_str_ctx *ctx;
+    struct yu_str_dat *next_free;
+};
+
+struct yu_str_dat_chunk {
+    struct yu_str_dat_chunk *next;
+    struct yu_str_dat dats[YU_STR_DAT_CHUNK];
 };
 
 #define YU_STR_DAT(s) ((struct yu_str_dat *)(yu_buf_get_udata((s))))
@@ -52,6 +80,20 @@ YU_ERR_RET yu_str_new_z(yu_str_ctx *ctx, const char * restrict cstr, yu_str * re
 
 void yu_str_free(yu_str s);
 
+// Hands s over to the garbage collector, along with the caller's reference.
+// From then on it's kept alive by being reached (by values referencing it)
+// between sweeps, or by C code that gets the same string again from
+// yu_str_new; each such lookup holds it until its yu_str_free.
+void yu_str_gc_own(yu_str s);
+YU_INLINE
+void yu_str_gc_reach(yu_str s) {
+    YU_STR_DAT(s)->gc_reached = true;
+}
+// Frees every GC-owned string that wasn't reached since the last sweep (or
+// since it was handed over), so it's no longer interned and its buffer and
+// slot can be reused. Live slices still keep the slot from being reused.
+void yu_str_ctx_sweep(yu_str_ctx *ctx);
+
 YU_INLINE
 u64 yu_str_len(yu_str s) {
     return YU_STR_DAT(s)->egc_count;
@@ -59,7 +101,97 @@ u64 yu_str_len(yu_str s) {
 
 s32 yu_str_cmp(yu_str a, yu_str b);
 
+// Length of the leading run of s that's ASCII other than CR and LF, found 16
+// bytes at a time where SSE2 is available. Each such byte is a code point and,
+// unless it's the last one and a combining mark follows, a grapheme cluster.
+u64 yu_str_plain_ascii_prefix(const u8 *s, u64 len);
+
+// Iterators (here and in rope.c) that run into ASCII the slow way find out
+// how far it goes in one go, since text with some usually has a lot of it.
+// Then they step through the run a byte at a time while yu_str_ascii_cluster
+// says each byte is a cluster of its own, which is every byte but the last:
+// a combining mark might follow that one.
+YU_INLINE
+u64 yu_str_ascii_run_end(const u8 *s, u64 len, u64 from) {
+    return from + yu_str_plain_ascii_prefix(s + from, len - from);
+}
+YU_INLINE
+bool yu_str_ascii_cluster(u64 pos, u64 ascii_end) {
+    return pos + 1 < ascii_end;
+}
+
 YU_ERR_RET yu_str_at(yu_str s, s64 idx, yu_str *char_out);
 
 YU_ERR_RET yu_str_cat(yu_str a, yu_str b, yu_str *out);
 YU_ERR_RET yu_str_cat_z(yu_str a, const char * restrict cstr, yu_str *out);
+
+// A view of grapheme clusters [egc_start, egc_start + egc_len) of an interned
+// string that doesn't copy, normalize or intern anything. It keeps its parent
+// from being reused until yu_str_slice_free; yu_str_slice_intern makes a
+// string out of it if one's actually needed (e.g. to hash it or keep it).
+typedef struct {
+    yu_str parent;
+    u64 byte_start, byte_len;
+    u64 egc_start, egc_len;
+} yu_str_slice;
+
+// Slices `len` clusters of s starting at its `start`th
+YU_ERR_RET yu_str_slice_new(yu_str s, u64 start, u64 len, yu_str_slice *out);
+// Slices `len` clusters of sl starting at its `start`th, sharing sl's parent
+YU_ERR_RET yu_str_slice_sub(const yu_str_slice *sl, u64 start, u64 len, yu_str_slice *out);
+void yu_str_slice_free(yu_str_slice *sl);
+
+YU_INLINE
+const u8 *yu_str_slice_bytes(const yu_str_slice *sl) {
+    return sl->parent + sl->byte_start;
+}
+YU_INLINE
+u64 yu_str_slice_len(const yu_str_slice *sl) {
+    return sl->egc_len;
+}
+
+bool yu_str_slice_eq(const yu_str_slice *a, const yu_str_slice *b);
+YU_ERR_RET yu_str_slice_intern(const yu_str_slice *sl, yu_str *out);
+
+// Iterates over the bytes, code points or grapheme clusters of a string (or
+// slice), which is preferable to indexing. Kinds can be mixed, as long as the
+// iterator is at a cluster (or code point) boundary when asking for one.
+// Runs of plain ASCII are found ahead of time (see yu_str_plain_ascii_prefix)
+// and stepped through without any decoding.
+typedef struct {
+    const u8 *s;
+    u64 pos, len;
+    // Bytes before this are plain ASCII
+    u64 ascii_end;
+    // Iterating up to the end of the string, where a lone format character
+    // isn't counted as a cluster (slices can stop short of it)
+    bool ends_str;
+} yu_str_iter;
+
+void yu_str_iter_init(yu_str_iter *it, yu_str s);
+void yu_str_slice_iter_init(yu_str_iter *it, const yu_str_slice *sl);
+// Each returns false at the end of the string
+bool yu_str_next_byte(yu_str_iter *it, u8 *out);
+bool yu_str_next_cp(yu_str_iter *it, u32 *out);
+// The cluster is bytes [*start, *start + *len) of the string (or slice), so
+// it->s + *start points at it
+bool yu_str_next_grapheme(yu_str_iter *it, u64 *start, u64 *len);
+
+// Builds a string out of many pieces in linear time: they're appended to a
+// growable unfrozen buffer, which is normalized and interned just once, by
+// yu_str_builder_finish. Pieces may be any valid UTF-8; they needn't be
+// normalized, and a piece may end in the middle of a grapheme cluster.
+typedef struct {
+    yu_str_ctx *ctx;
+    yu_buf buf;
+} yu_str_builder;
+
+// size_hint is how many bytes to make room for up front; 0 is fine
+YU_ERR_RET yu_str_builder_init(yu_str_builder *b, yu_str_ctx *ctx, u64 size_hint);
+YU_ERR_RET yu_str_builder_append(yu_str_builder *b, const u8 *utf8, u64 len);
+YU_ERR_RET yu_str_builder_append_str(yu_str_builder *b, yu_str s);
+// Makes the string and frees the builder; it must be initialized again to
+// be reused. The builder is freed even if this fails.
+YU_ERR_RET yu_str_builder_finish(yu_str_builder *b, yu_str *out);
+// Frees the builder without making a string
+void yu_str_builder_free(yu_str_builder *b);
@@ -24,7 +24,12 @@
     X(alloc_aligned, "Allocated pointers should obey the specified alignment") \
     X(page_free, "free() on a reserved address space should be equivalent to decommit+release") \
     X(page_context_free, "When a context is freed all virtual pages allocated by it should be released") \
-    X(page_sizes, "_size() functions on a reserved address space should return the requested and rounded sizes")
+    X(page_sizes, "_size() functions on a reserved address space should return the requested and rounded sizes") \
+    X(limit_accounting, "A context with limits should account allocations by their usable size") \
+    X(limit_soft, "Crossing the soft limit should signal pressure once and still allocate") \
+    X(limit_hard, "Crossing the hard limit should fail unless a pressure hook frees enough") \
+    X(limit_commit, "Reserved pages should only count against the limits while committed") \
+    X(limit_buf_purge, "Pressure should purge a yu_buf_ctx's free list")
 
 struct foo {
     u64 ll;
@@ -172,6 +177,153 @@ TEST(page_sizes)
     PT_ASSERT_EQ(yu_usable_size(&ctx, ptr), yu_virtual_pagesize(0));
 END(page_sizes)
 
+TEST(limit_accounting)
+    struct yu_mem_limits lim;
+    yu_mem_limits_init(&lim, 0, 0);
+    PT_ASSERT(yu_alloc_set_limits(&ctx, &lim) == YU_OK);
+    void *a = yu_xalloc(&ctx, 10, 10), *b = yu_xalloc(&ctx, 1, 50);
+    PT_ASSERT_EQ(lim.used, yu_usable_size(&ctx, a) + yu_usable_size(&ctx, b));
+    a = yu_xrealloc(&ctx, a, 20, 10);
+    PT_ASSERT_EQ(lim.used, yu_usable_size(&ctx, a) + yu_usable_size(&ctx, b));
+    yu_free(&ctx, a);
+    yu_free(&ctx, b);
+    PT_ASSERT_EQ(lim.used, 0u);
+    PT_ASSERT(lim.peak >= 250u);
+    // Still a no-op with limits
+    yu_free(&ctx, NULL);
+    PT_ASSERT(yu_alloc_set_limits(&ctx, NULL) == YU_OK);
+END(limit_accounting)
+
+struct pressure_log {
+    u32 soft, hard;
+    void *victim;
+    yu_allocator *ctx;
+};
+
+static void log_pressure(yu_mem_pressure level, size_t YU_UNUSED(requested), void *data) {
+    struct pressure_log *log = data;
+    if (level == YU_MEM_PRESSURE_SOFT)
+        log->soft++;
+    else
+        log->hard++;
+    if (log->victim) {
+        yu_free(log->ctx, log->victim);
+        log->victim = NULL;
+    }
+}
+
+TEST(limit_soft)
+    struct yu_mem_limits lim;
+    struct pressure_log log = {0};
+    yu_mem_limits_init(&lim, 1000, 0);
+    yu_alloc_set_limits(&ctx, &lim);
+    PT_ASSERT(yu_alloc_add_pressure_hook(&ctx, log_pressure, &log));
+
+    void *a = yu_xalloc(&ctx, 1, 600), *b = yu_xalloc(&ctx, 1, 600), *c = yu_xalloc(&ctx, 1, 10);
+    PT_ASSERT_EQ(log.soft, 1u);
+    PT_ASSERT_EQ(log.hard, 0u);
+    // Dropping below the soft limit re-arms it
+    yu_free(&ctx, b);
+    yu_free(&ctx, c);
+    b = yu_xalloc(&ctx, 1, 600);
+    PT_ASSERT_EQ(log.soft, 2u);
+
+    yu_free(&ctx, a);
+    yu_free(&ctx, b);
+    PT_ASSERT(yu_alloc_remove_pressure_hook(&ctx, log_pressure, &log));
+    PT_ASSERT(!yu_alloc_remove_pressure_hook(&ctx, log_pressure, &log));
+    yu_alloc_set_limits(&ctx, NULL);
+END(limit_soft)
+
+TEST(limit_hard)
+    struct yu_mem_limits lim;
+    struct pressure_log log = { .ctx = (yu_allocator *)&ctx };
+    void *a, *b;
+    yu_mem_limits_init(&lim, 0, 1000);
+    yu_alloc_set_limits(&ctx, &lim);
+    yu_alloc_add_pressure_hook(&ctx, log_pressure, &log);
+
+    a = yu_xalloc(&ctx, 1, 600);
+    PT_ASSERT(yu_alloc(&ctx, &b, 1, 600, 0) == YU_ERR_ALLOC_FAIL);
+    PT_ASSERT_EQ(log.hard, 1u);
+
+    // This time the hook gives `a` back, so there's room
+    log.victim = a;
+    PT_ASSERT(yu_alloc(&ctx, &b, 1, 600, 0) == YU_OK);
+    PT_ASSERT_EQ(log.hard, 2u);
+    PT_ASSERT(log.victim == NULL);
+    PT_ASSERT(lim.used <= lim.hard);
+
+    yu_free(&ctx, b);
+    yu_alloc_set_limits(&ctx, NULL);
+END(limit_hard)
+
+TEST(limit_commit)
+    struct yu_mem_limits lim;
+    size_t pgsz = yu_virtual_pagesize(0);
+    void *pg;
+    yu_mem_limits_init(&lim, 0, 3 * pgsz);
+    yu_alloc_set_limits(&ctx, &lim);
+
+    yu_err err = yu_reserve(&ctx, &pg, 16, pgsz);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(lim.used, 0u);
+    // Partial pages count in full
+    err = yu_commit(&ctx, (u8 *)pg + pgsz/2, 1, pgsz);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(lim.used, 2 * pgsz);
+    PT_ASSERT(yu_commit(&ctx, (u8 *)pg + 4 * pgsz, 2, pgsz) == YU_ERR_ALLOC_FAIL);
+    err = yu_decommit(&ctx, pg, 2, pgsz);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(lim.used, 0u);
+    err = yu_commit(&ctx, (u8 *)pg + 4 * pgsz, 2, pgsz);
+    PT_ASSERT_EQ(err, YU_OK);
+    PT_ASSERT_EQ(lim.used, 2 * pgsz);
+
+    yu_decommit(&ctx, (u8 *)pg + 4 * pgsz, 2, pgsz);
+    yu_release(&ctx, pg);
+    PT_ASSERT_EQ(lim.used, 0u);
+    yu_alloc_set_limits(&ctx, NULL);
+END(limit_commit)
+
+TEST(limit_buf_purge)
+    struct yu_mem_limits lim;
+    yu_buf_ctx bufs;
+    yu_mem_limits_init(&lim, 0, 0);
+    yu_alloc_set_limits(&ctx, &lim);
+    yu_buf_ctx_init(&bufs, (yu_allocator *)&ctx);
+
+    yu_buf_free(yu_buf_new(&bufs, (const u8 *)"kondo", 5, true));
+    PT_ASSERT_EQ(bufs.num_free, 1u);
+    size_t before = lim.used;
+    // Squeeze the hard limit so that any allocation applies pressure
+    lim.hard = 1;
+    void *p;
+    PT_ASSERT(yu_alloc(&ctx, &p, 1, 64, 0) == YU_ERR_ALLOC_FAIL);
+    PT_ASSERT_EQ(bufs.num_free, 0u);
+    PT_ASSERT(lim.used < before);
+    PT_ASSERT_EQ(bufs.frozen_bufs.size, 0u);
+
+    // Pressure while frozen_bufs is mid-update (as when its own resize
+    // allocates) has to wait for the next yu_buf_new
+    lim.hard = 0;
+    yu_buf_free(yu_buf_new(&bufs, (const u8 *)"marie", 5, true));
+    lim.hard = 1;
+    bufs.busy++;
+    PT_ASSERT(yu_alloc(&ctx, &p, 1, 64, 0) == YU_ERR_ALLOC_FAIL);
+    bufs.busy--;
+    PT_ASSERT(bufs.purge_pending);
+    PT_ASSERT_EQ(bufs.num_free, 1u);
+    lim.hard = 0;
+    yu_buf_free(yu_buf_new(&bufs, (const u8 *)"tidy", 4, true));
+    PT_ASSERT(!bufs.purge_pending);
+    PT_ASSERT_EQ(bufs.num_free, 1u);
+    PT_ASSERT_EQ(bufs.frozen_bufs.size, 1u);
+
+    yu_buf_ctx_free(&bufs);
+    yu_alloc_set_limits(&ctx, NULL);
+END(limit_buf_purge)
+
 #if TEST_ALLOC == TEST_USE_SYS_ALLOC
 // Skip this test suite if we aren't defined to use the system allocator.
 // We rely on some internals of sys_alloc to check that things have been freed.
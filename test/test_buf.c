@@ -17,7 +17,9 @@
     X(cat, "Concatenating buffers should return a buffer with concatenated contents") \
     X(cat_interned, "Interned concatenation should intern the resulting buffer") \
     X(make_interned, "Performing operations on a non-interned buffer and then freezing it should intern it") \
-    X(userdata, "Buffers should be able to store associated data")
+    X(userdata, "Buffers should be able to store associated data") \
+    X(hash, "Buffer hashes should match their reference definitions at any length and alignment") \
+    X(recycle, "Dead frozen buffers should be revivable, bounded per size and recycled")
 
 #define new_buf(str, intern) yu_buf_new(&ctx, (unsigned char *)(str), strlen((str)), (intern))
 
@@ -93,8 +95,9 @@ TEST(make_interned)
     b = yu_buf_freeze(d);
     PT_ASSERT(a == b);
     PT_ASSERT(b != d);
-    yu_buf_free(d);
-    PT_ASSERT_EQ(memcmp(b, "silver soul", 11), 0);
+    // Freezing consumed d; the reference now belongs to b
+    yu_buf_free(b);
+    PT_ASSERT_EQ(memcmp(a, "silver soul", 11), 0);
 END(make_interned)
 
 TEST(userdata)
@@ -107,4 +110,95 @@ TEST(userdata)
     PT_ASSERT_EQ(*(int *)yu_buf_get_udata(yu_buf_get_udata(b)), 42);
 END(userdata)
 
+// MurmurHash64A as published, a byte at a time in the tail
+static u64 murmur64a_ref(const u8 *key, u64 len, u64 seed) {
+    const u64 m = 0xc6a4a7935bd1e995ull;
+    u64 h = seed ^ (len * m);
+    const u8 *end = key + len / 8 * 8;
+    for (; key != end; key += 8) {
+        u64 k;
+        memcpy(&k, key, 8);
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    for (u32 i = len & 7; i > 0; i--)
+        h ^= (u64)key[i - 1] << (8 * (i - 1));
+    if (len & 7)
+        h *= m;
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return h;
+}
+
+TEST(hash)
+    u8 bytes[1024 + 8], copy[1024 + 8];
+    u64 rng = 1;
+    for (u32 i = 0; i < sizeof(bytes); i++) {
+        rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+        bytes[i] = rng >> 56;
+    }
+    for (u32 len = 0; len <= 1024; len += len < 300 ? 1 : 61) {
+        for (u32 off = 0; off < 8; off += 3) {
+            PT_ASSERT_EQ(yu_murmur2(bytes + off, len), murmur64a_ref(bytes + off, len, 0x1fffffffffffffffull));
+            PT_ASSERT_EQ(yu_fnv1a(bytes + off, len), yu__fnv1a_portable(bytes + off, len));
+        }
+        // Same contents, different alignment
+        memcpy(copy + 5, bytes, len);
+        PT_ASSERT_EQ(yu_fnv1a(copy + 5, len), yu_fnv1a(bytes, len));
+        PT_ASSERT_EQ(yu_murmur2(copy + 5, len), yu_murmur2(bytes, len));
+    }
+
+    // Trailing zeros still count
+    PT_ASSERT(yu_fnv1a((const u8 *)"a\0", 1) != yu_fnv1a((const u8 *)"a\0", 2));
+    PT_ASSERT(yu_murmur2((const u8 *)"a\0", 1) != yu_murmur2((const u8 *)"a\0", 2));
+END(hash)
+
+TEST(recycle)
+    yu_buf a, b;
+    char name[16];
+
+    // A dead buffer can still be revived, and then isn't on a free list
+    a = new_buf("phoenix", true);
+    yu_buf_free(a);
+    PT_ASSERT_EQ(ctx.num_free, 1u);
+    b = new_buf("phoenix", true);
+    PT_ASSERT(a == b);
+    PT_ASSERT_EQ(ctx.num_free, 0u);
+    yu_buf_free(b);
+
+    // Each size class only keeps so many; the least recently freed go first
+    yu_buf live[YU_BUF_CTX_FREE_PER_CLASS * 2];
+    u32 k = YU_BUF_DAT(a)->capacity;
+    for (u32 i = 0; i < YU_BUF_CTX_FREE_PER_CLASS * 2; i++) {
+        snprintf(name, sizeof(name), "ashes%02u", i);
+        live[i] = new_buf(name, true);
+        PT_ASSERT_EQ(YU_BUF_DAT(live[i])->capacity, k);
+    }
+    for (u32 i = 0; i < YU_BUF_CTX_FREE_PER_CLASS * 2; i++)
+        yu_buf_free(live[i]);
+    PT_ASSERT_EQ(ctx.free[k].len, (u32)YU_BUF_CTX_FREE_PER_CLASS);
+    PT_ASSERT(ctx.free[k].len == ctx.num_free);
+    b = new_buf("ashes00", true);
+    PT_ASSERT(b != live[0]);
+    yu_buf_free(b);
+    b = new_buf("ashes15", true);
+    PT_ASSERT(b == live[15]);
+    yu_buf_free(b);
+    PT_ASSERT_EQ(ctx.free[k].len, (u32)YU_BUF_CTX_FREE_PER_CLASS);
+
+    // New buffers of that size come off the free list, which unintern them
+    yu_buf old = (yu_buf)(ctx.free[k].tail + 1);
+    u64 old_hash[2] = {YU_BUF_DAT(old)->hash[0], YU_BUF_DAT(old)->hash[1]};
+    b = yu_buf_alloc(&ctx, 1u << k);
+    PT_ASSERT(b == old);
+    PT_ASSERT_EQ(ctx.free[k].len, (u32)YU_BUF_CTX_FREE_PER_CLASS - 1);
+    PT_ASSERT(!yu_buf_table_get(&ctx.frozen_bufs, old_hash, NULL));
+    PT_ASSERT_EQ(yu_buf_len(b), 0u);
+    yu_buf_free(b);
+END(recycle)
+
 SUITE(buf, LIST_BUF_TESTS)
@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "test.h"
+
+#define inthash_1(x) ((u64)(x))
+#define inthash_2(x) ((u64)((x)*(x)))
+#define int_eq(a,b) ((a) == (b))
+
+YU_FLATTABLE(ft, u32, char *, inthash_1, inthash_2, int_eq)
+YU_FLATTABLE_IMPL(ft, u32, char *, inthash_1, inthash_2, int_eq)
+
+#define SETUP \
+    ft tbl; \
+    TEST_GET_INTERNAL_ALLOCATOR(mctx); \
+    ft_init(&tbl, 3, &mctx);
+
+#define TEARDOWN \
+    ft_free(&tbl); \
+    yu_alloc_ctx_free(&mctx);
+
+#define LIST_FLATTABLE_TESTS(X) \
+    X(getnull, "Retrieving a key that does not exists should return false") \
+    X(putget, "Storing a value should allow it to be retrieved later") \
+    X(putexists, "Overwriting a key should return the previous value") \
+    X(getdefault, "When given a default value, get should return it if the key was not found") \
+    X(grow, "Inserting more keys than the initial size should grow the table") \
+    X(collide, "Keys sharing a probe sequence should all be found") \
+    X(remove, "Removing a key should remove it from the table") \
+    X(tombstones, "Churning through inserts and removes should not grow the table") \
+    X(iter, "Iterating should go through all keys and values") \
+    X(stopiter, "Returning non-zero should stop iteration")
+
+TEST(getnull)
+    char *s = "I shouldn't change";
+    PT_ASSERT(!ft_get(&tbl, 7, &s));
+    PT_ASSERT_STR_EQ(s, "I shouldn't change");
+END(getnull)
+
+TEST(putget)
+    char *s = "don't touch me";
+    PT_ASSERT(!ft_put(&tbl, 1, "one", &s));
+    PT_ASSERT_STR_EQ(s, "don't touch me");
+    PT_ASSERT(ft_get(&tbl, 1, &s));
+    PT_ASSERT_STR_EQ(s, "one");
+END(putget)
+
+TEST(putexists)
+    char *s;
+    ft_put(&tbl, 10, "10", NULL);
+    PT_ASSERT(ft_put(&tbl, 10, "ten", &s));
+    PT_ASSERT_STR_EQ(s, "10");
+    PT_ASSERT(ft_get(&tbl, 10, &s));
+    PT_ASSERT_STR_EQ(s, "ten");
+END(putexists)
+
+TEST(getdefault)
+    PT_ASSERT_STR_EQ(ft_try_get(&tbl, 2, "NUTHIN'"), "NUTHIN'");
+    ft_put(&tbl, 7, "seven", NULL);
+    PT_ASSERT_STR_EQ(ft_try_get(&tbl, 7, "NUTHIN'"), "seven");
+END(getdefault)
+
+static char *as_words[] = {
+    "zero","one","two","three","four","five",
+    "six","seven","eight","nine","ten",
+    "eleven","twelve","thirteen","fourteen","fifteen",
+    "sixteen","seventeen","eighteen","nineteen","twenty",
+    "twenty-one","twenty-two","twenty-three","twenty-four","twenty-five",
+    "twenty-six","twenty-seven","twenty-eight","twenty-nine","thirty"
+};
+
+TEST(grow)
+    u8 old_cap = tbl.capacity;
+    for (u32 i = 0; i < 30; i++)
+        PT_ASSERT(!ft_put(&tbl, i, as_words[i], NULL));
+    PT_ASSERT_EQ(tbl.size, 30u);
+    PT_ASSERT_GT(tbl.capacity, old_cap);
+    for (u32 i = 0; i < 30; i++) {
+        char *s = ft_try_get(&tbl, i, "missing value");
+        PT_ASSERT_STR_EQ(s, as_words[i]);
+    }
+END(grow)
+
+TEST(collide)
+    // hash1 is the identity, so multiples of a large power of 2 all start
+    // probing at slot 0 no matter how big the table gets.
+    u32 n = 100;
+    for (u32 i = 0; i < n; i++)
+        PT_ASSERT(!ft_put(&tbl, i << 20, as_words[i % elemcount(as_words)], NULL));
+    PT_ASSERT_EQ(tbl.size, n);
+    bool all_found = true;
+    for (u32 i = 0; i < n; i++)
+        all_found &= ft_get(&tbl, i << 20, NULL);
+    PT_ASSERT(all_found);
+    PT_ASSERT(!ft_get(&tbl, n << 20, NULL));
+END(collide)
+
+TEST(remove)
+    for (u32 i = 0; i < 10; i++)
+        ft_put(&tbl, i, as_words[i], NULL);
+    PT_ASSERT(!ft_remove(&tbl, 20, NULL));
+    PT_ASSERT_EQ(tbl.size, 10u);
+    for (u32 i = 0; i < 10; i++) {
+        char *s;
+        PT_ASSERT(ft_remove(&tbl, i, &s));
+        PT_ASSERT_STR_EQ(s, as_words[i]);
+        PT_ASSERT(!ft_get(&tbl, i, NULL));
+        PT_ASSERT_EQ(tbl.size, 10 - i - 1);
+    }
+    PT_ASSERT_EQ(tbl.size, 0u);
+END(remove)
+
+TEST(tombstones)
+    for (u32 i = 0; i < 8; i++)
+        ft_put(&tbl, i, as_words[i], NULL);
+    u8 cap = tbl.capacity;
+    bool ok = true;
+    for (u32 i = 8; i < 20000; i++) {
+        ok &= ft_remove(&tbl, i - 8, NULL);
+        ft_put(&tbl, i, as_words[i % elemcount(as_words)], NULL);
+    }
+    PT_ASSERT(ok);
+    PT_ASSERT_EQ(tbl.size, 8u);
+    PT_ASSERT_EQ(tbl.capacity, cap);
+    for (u32 i = 20000 - 8; i < 20000; i++)
+        PT_ASSERT(ft_get(&tbl, i, NULL));
+END(tombstones)
+
+static u32 iterator(u32 key, char *val, void *count) {
+    PT_ASSERT_STR_EQ(val, as_words[key]);
+    ++(*((u32 *)count));
+    return 0;
+}
+
+TEST(iter)
+    u32 n = 0;
+    for (u32 i = 0; i < 30; i++)
+        ft_put(&tbl, i, as_words[i], NULL);
+    PT_ASSERT_EQ(ft_iter(&tbl, iterator, &n), 0u);
+    PT_ASSERT_EQ(n, 30u);
+END(iter)
+
+static u32 stop_iterator(u32 key, char * YU_UNUSED(val), void * YU_UNUSED(data)) {
+    return key == 8 ? 3 : 0;
+}
+
+TEST(stopiter)
+    for (u32 i = 0; i < 10; i++)
+        ft_put(&tbl, i, as_words[i], NULL);
+    PT_ASSERT_EQ(ft_iter(&tbl, stop_iterator, NULL), 3u);
+END(stopiter)
+
+SUITE(flattable, LIST_FLATTABLE_TESTS)
@@ -28,7 +28,9 @@
     X(root, "Rooted objects should not be freed in a GC cycle") \
     X(object_graph, "The GC should correctly traverse the object graph, including cycles") \
     X(write_barrier, "Objects written to after being scanned should be re-scanned") \
-    X(sanity_check, "GC should work")
+    X(sanity_check, "GC should work") \
+    X(strings, "Strings no surviving value references should be uninterned by major collections") \
+    X(pressure, "Memory pressure should collect right away unless the collector is busy")
 
 TEST(handle)
     value_handle x = gc_alloc_val(&gc, VALUE_FIXNUM),
@@ -194,6 +196,134 @@ TEST(sanity_check)
     PT_ASSERT_EQ(arena_allocated_count(b)+arena_allocated_count(c), 3u);
 END(sanity_check)
 
+TEST(strings)
+    yu_str_ctx strs;
+    yu_str kept, lost, young;
+    yu_str_ctx_init(&strs, (yu_allocator *)&mctx);
+    gc_track_strings(&gc, &strs);
+
+    PT_ASSERT(yu_str_new_z(&strs, "kept alive by a root", &kept) == YU_OK);
+    PT_ASSERT(yu_str_new_z(&strs, "referenced by nothing", &lost) == YU_OK);
+    value_handle k = gc_alloc_str(&gc, kept);
+    gc_alloc_str(&gc, lost);
+    gc_root(&gc, k);
+    struct yu_str_dat *kept_dat = YU_STR_DAT(kept), *lost_dat = YU_STR_DAT(lost);
+
+    // The collector owns them now
+    yu_str_free(kept);
+    PT_ASSERT(kept_dat->is_used);
+
+    gc.collecting_generation = GC_NUM_GENERATIONS-1;
+    gc_full_collect(&gc);
+    PT_ASSERT_EQ(value_deref(k)->v.s, kept);
+    PT_ASSERT(kept_dat->is_used);
+    PT_ASSERT(kept_dat->gc_weak);
+    PT_ASSERT(!lost_dat->is_used);
+    PT_ASSERT(!lost_dat->gc_weak);
+    PT_ASSERT_EQ(lost_dat->str, NULL);
+
+    // Minor collections can't tell yet whether older values still reference
+    // a string, so they leave strings alone
+    PT_ASSERT(yu_str_new_z(&strs, "dies young", &young) == YU_OK);
+    gc_alloc_str(&gc, young);
+    struct yu_str_dat *young_dat = YU_STR_DAT(young);
+    gc.collecting_generation = 0;
+    gc_full_collect(&gc);
+    PT_ASSERT(young_dat->is_used);
+
+    gc.collecting_generation = GC_NUM_GENERATIONS-1;
+    gc_full_collect(&gc);
+    PT_ASSERT(kept_dat->is_used);
+    PT_ASSERT(!young_dat->is_used);
+
+    gc_unroot(&gc, k);
+    // It was still marked as a root going into the first one
+    gc_full_collect(&gc);
+    gc_full_collect(&gc);
+    PT_ASSERT(!kept_dat->is_used);
+
+    // Getting a collector-owned string from C holds it until yu_str_free
+    yu_str held, again;
+    PT_ASSERT(yu_str_new_z(&strs, "looked up from C", &held) == YU_OK);
+    gc_alloc_str(&gc, held);
+    PT_ASSERT(yu_str_new_z(&strs, "looked up from C", &again) == YU_OK);
+    PT_ASSERT(again == held);
+    struct yu_str_dat *held_dat = YU_STR_DAT(held);
+    gc_full_collect(&gc);
+    gc_full_collect(&gc);
+    PT_ASSERT(held_dat->is_used);
+    PT_ASSERT(held_dat->str == held);
+    yu_str_free(again);
+    gc_full_collect(&gc);
+    PT_ASSERT(!held_dat->is_used);
+
+    // Handing an unreferenced collector-owned string to gc_alloc_str again
+    // mustn't lose it to the collection that allocation sets off
+    PT_ASSERT(yu_str_new_z(&strs, "handed over twice", &held) == YU_OK);
+    gc_alloc_str(&gc, held);
+    held_dat = YU_STR_DAT(held);
+    gc.collect_pending = gc.major_pending = true;
+    k = gc_alloc_str(&gc, held);
+    PT_ASSERT(!gc.collect_pending);
+    PT_ASSERT(held_dat->is_used);
+    gc_root(&gc, k);
+    gc_full_collect(&gc);
+    PT_ASSERT(held_dat->is_used);
+    PT_ASSERT(value_deref(k)->v.s == held);
+    gc_unroot(&gc, k);
+    yu_str_ctx_free(&strs);
+END(strings)
+
+TEST(pressure)
+    // Hooks live in the limits, so they have to be in place before gc_init
+    struct yu_mem_limits lim;
+    struct gc_info pgc;
+    void *p;
+    yu_mem_limits_init(&lim, 0, 0);
+    yu_alloc_set_limits(&mctx, &lim);
+    _gciniterr = gc_init(&pgc, (yu_allocator *)&mctx);
+    assert(_gciniterr == YU_OK);
+    a = pgc.arenas[0];
+
+    gc_alloc_val(&pgc, VALUE_FIXNUM);
+    gc_alloc_val(&pgc, VALUE_FIXNUM);
+    PT_ASSERT_EQ(arena_allocated_count(a), 2u);
+
+    // Neither was reachable, and an allocation from outside the collector is
+    // a safe point, so they're gone by the time it returns
+    lim.soft = 1;
+    p = yu_xalloc(&mctx, 1, 64);
+    PT_ASSERT(!pgc.collect_pending);
+    PT_ASSERT_EQ(arena_allocated_count(a), 0u);
+    yu_free(&mctx, p);
+
+    // Hard pressure collects before the limit is checked again
+    gc_alloc_val(&pgc, VALUE_FIXNUM);
+    lim.hard = lim.used;
+    PT_ASSERT(yu_alloc(&mctx, &p, 1, 64, 0) == YU_ERR_ALLOC_FAIL);
+    PT_ASSERT(!pgc.major_pending);
+    PT_ASSERT_EQ(arena_allocated_count(a), 0u);
+    lim.hard = 0;
+
+    // While the collector is busy, pressure has to wait for the next gc_alloc_val
+    gc_alloc_val(&pgc, VALUE_FIXNUM);
+    gc_alloc_val(&pgc, VALUE_FIXNUM);
+    lim.soft_signalled = false;
+    pgc.busy++;
+    p = yu_xalloc(&mctx, 1, 64);
+    pgc.busy--;
+    PT_ASSERT(pgc.collect_pending);
+    PT_ASSERT(!pgc.major_pending);
+    PT_ASSERT_EQ(arena_allocated_count(a), 2u);
+    gc_alloc_val(&pgc, VALUE_FIXNUM);
+    PT_ASSERT(!pgc.collect_pending);
+    PT_ASSERT_EQ(arena_allocated_count(a), 1u);
+
+    yu_free(&mctx, p);
+    gc_free(&pgc);
+    yu_alloc_set_limits(&mctx, NULL);
+END(pressure)
+
 
 SUITE(gc, LIST_GC_TESTS)
 
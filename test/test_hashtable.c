@@ -7,11 +7,16 @@
 
 #define inthash_1(x) ((u64)(x))
 #define inthash_2(x) ((u64)((x)*(x)))
+#define inthash_not(x) ((u64)~(x))
 #define int_eq(a,b) ((a) == (b))
 
 YU_HASHTABLE(ht, u32, char *, inthash_1, inthash_2, int_eq)
 YU_HASHTABLE_IMPL(ht, u32, char *, inthash_1, inthash_2, int_eq)
 
+// Keys equal mod 2^capacity land in the same left *and* right bucket
+YU_HASHTABLE(cht, u32, u32, inthash_1, inthash_not, int_eq)
+YU_HASHTABLE_IMPL(cht, u32, u32, inthash_1, inthash_not, int_eq)
+
 #define SETUP \
     ht tbl; \
     TEST_GET_INTERNAL_ALLOCATOR(mctx); \
@@ -28,7 +33,14 @@ YU_HASHTABLE_IMPL(ht, u32, char *, inthash_1, inthash_2, int_eq)
     X(getdefault, "When given a default value, get should return it if the key was not found") \
     X(grow, "Inserting more keys than the initial size should grow the table") \
     X(collide, "Collisions should be resolved, possibly by growing the table") \
+    X(collide_both, "Keys colliding on both hashes should grow the table only as far as needed") \
     X(remove, "Removing a key should remove it from the table") \
+    X(migrate, "Keys should stay reachable while the table is being resized") \
+    X(migrate_iter, "Iterating mid-resize should visit every key exactly once") \
+    X(reserve, "Reserving room for n keys should avoid resizing while they're put") \
+    X(shrink, "Removing most keys should shrink the table, but not below its initial size") \
+    X(compact, "Compacting should shrink the table to fit its keys") \
+    X(get_many, "Looking up many keys at once should agree with get") \
     X(iter, "Iterating should go through all keys and values") \
     X(stopiter, "Returning non-zero should stop iteration")
 
@@ -105,6 +117,24 @@ TEST(collide)
     PT_ASSERT_EQ(tbl.size, valcnt);
 END(collide)
 
+TEST(collide_both)
+    cht ctbl;
+    u32 v;
+    bool all_found = true;
+    cht_init(&ctbl, 3, &mctx);
+    // Every key shares one pair of buckets until the capacity passes 12, and
+    // a pair holds 4 keys, so 20 of them need 2^15 buckets. Getting there
+    // means grows from inside the migration of the grow before.
+    for (u32 i = 0; i < 20; i++)
+        cht_put(&ctbl, i << 12, i, NULL);
+    PT_ASSERT_EQ(ctbl.size, 20u);
+    PT_ASSERT_EQ(ctbl.capacity, 15);
+    for (u32 i = 0; i < 20; i++)
+        all_found &= cht_get(&ctbl, i << 12, &v) && v == i;
+    PT_ASSERT(all_found);
+    cht_free(&ctbl);
+END(collide_both)
+
 TEST(remove)
     for (u32 i = 0; i < 10; i++)
         ht_put(&tbl, i, as_words[i], NULL);
@@ -119,6 +149,137 @@ TEST(remove)
     PT_ASSERT_EQ(tbl.size, 0u);
 END(remove)
 
+// Put keys 0, 1, 2, … until a resize of a reasonably large table has just
+// started (nothing migrated yet); returns how many keys were put.
+static u32 fill_until_migrating(ht *t) {
+    u32 n = 0;
+    while (n < 256 || !t->old_left || t->migrate_pos)
+        ht_put(t, n, as_words[n % elemcount(as_words)], NULL), n++;
+    return n;
+}
+
+TEST(migrate)
+    char *s;
+    u32 n = fill_until_migrating(&tbl);
+    PT_ASSERT_EQ(tbl.size, n);
+
+    // Overwriting a key that hasn't moved yet must not duplicate it
+    PT_ASSERT(ht_put(&tbl, 0, "zero again", &s));
+    PT_ASSERT_STR_EQ(s, as_words[0]);
+    PT_ASSERT_EQ(tbl.size, n);
+    PT_ASSERT(ht_remove(&tbl, 1, NULL));
+    PT_ASSERT(!ht_get(&tbl, 1, NULL));
+    PT_ASSERT_EQ(tbl.size, n - 1);
+
+    // Lookups don't migrate anything themselves
+    u64 pos = tbl.migrate_pos;
+    PT_ASSERT(ht_get(&tbl, 2, NULL));
+    PT_ASSERT_EQ(tbl.migrate_pos, pos);
+
+    u32 ops = 0;
+    while (tbl.old_left) {
+        PT_ASSERT(ht_put(&tbl, 2, as_words[2], NULL));
+        ops++;
+    }
+    // Each op migrates a bounded number of buckets
+    PT_ASSERT_GT(ops, 1u);
+    PT_ASSERT_EQ(tbl.size, n - 1);
+    PT_ASSERT_STR_EQ(ht_try_get(&tbl, 0, NULL), "zero again");
+    for (u32 i = 2; i < n; i++)
+        PT_ASSERT_STR_EQ(ht_try_get(&tbl, i, NULL), as_words[i % elemcount(as_words)]);
+END(migrate)
+
+static u32 count_distinct(u32 key, char * YU_UNUSED(val), void *seen) {
+    ((u8 *)seen)[key]++;
+    return 0;
+}
+
+TEST(migrate_iter)
+    u32 n = fill_until_migrating(&tbl);
+    for (u32 i = 0; i < 3; i++)
+        ht_put(&tbl, i, as_words[i], NULL);
+    PT_ASSERT(tbl.old_left != NULL);
+
+    u8 *seen = calloc(n, 1);
+    PT_ASSERT_EQ(ht_iter(&tbl, count_distinct, seen), 0u);
+    for (u32 i = 0; i < n; i++)
+        PT_ASSERT_EQ(seen[i], 1);
+    free(seen);
+END(migrate_iter)
+
+TEST(reserve)
+    ht_reserve(&tbl, 1000);
+    u8 cap = tbl.capacity;
+    PT_ASSERT(tbl.old_left == NULL);
+    for (u32 i = 0; i < 1000; i++) {
+        ht_put(&tbl, i, as_words[i % elemcount(as_words)], NULL);
+        PT_ASSERT(tbl.old_left == NULL);
+    }
+    PT_ASSERT_EQ(tbl.capacity, cap);
+    // Reserving less than is already there does nothing
+    ht_reserve(&tbl, 10);
+    PT_ASSERT_EQ(tbl.capacity, cap);
+END(reserve)
+
+TEST(shrink)
+    u8 init_cap = tbl.capacity;
+    for (u32 i = 0; i < 2000; i++)
+        ht_put(&tbl, i, as_words[i % elemcount(as_words)], NULL);
+    u8 peak = tbl.capacity;
+    for (u32 i = 10; i < 2000; i++)
+        PT_ASSERT(ht_remove(&tbl, i, NULL));
+    while (tbl.old_left)
+        ht_remove(&tbl, 5000, NULL);
+    PT_ASSERT_LT(tbl.capacity, peak);
+    PT_ASSERT_EQ(tbl.size, 10u);
+    for (u32 i = 0; i < 10; i++)
+        PT_ASSERT_STR_EQ(ht_try_get(&tbl, i, NULL), as_words[i]);
+
+    for (u32 i = 0; i < 10; i++)
+        PT_ASSERT(ht_remove(&tbl, i, NULL));
+    while (tbl.old_left)
+        ht_remove(&tbl, 5000, NULL);
+    PT_ASSERT_EQ(tbl.capacity, init_cap);
+END(shrink)
+
+TEST(compact)
+    tbl.min_load = 0;
+    for (u32 i = 0; i < 2000; i++)
+        ht_put(&tbl, i, as_words[i % elemcount(as_words)], NULL);
+    for (u32 i = 100; i < 2000; i++)
+        ht_remove(&tbl, i, NULL);
+    u8 peak = tbl.capacity;
+    PT_ASSERT(ht_compact(&tbl));
+    PT_ASSERT(tbl.old_left == NULL);
+    PT_ASSERT_LT(tbl.capacity, peak);
+    PT_ASSERT_EQ(tbl.size, 100u);
+    for (u32 i = 0; i < 100; i++)
+        PT_ASSERT_STR_EQ(ht_try_get(&tbl, i, NULL), as_words[i % elemcount(as_words)]);
+    // Already as small as it gets
+    PT_ASSERT(!ht_compact(&tbl));
+END(compact)
+
+TEST(get_many)
+    u32 keys[100];
+    char *vals[100];
+    bool found[100];
+    for (u32 i = 0; i < 30; i++)
+        ht_put(&tbl, i * 2, as_words[i], NULL);
+    // More than one batch, half of them present
+    for (u32 i = 0; i < 100; i++) {
+        keys[i] = i;
+        vals[i] = "untouched";
+    }
+    PT_ASSERT_EQ(ht_get_many(&tbl, keys, 100, vals, found), 30u);
+    for (u32 i = 0; i < 100; i++) {
+        PT_ASSERT_EQ(found[i], i % 2 == 0 && i < 60);
+        PT_ASSERT_STR_EQ(vals[i], found[i] ? as_words[i / 2] : "untouched");
+    }
+    // Both outputs are optional
+    PT_ASSERT_EQ(ht_get_many(&tbl, keys, 100, NULL, NULL), 30u);
+    PT_ASSERT_EQ(ht_get_many(&tbl, keys, 0, NULL, NULL), 0u);
+END(get_many)
+
 u32 iterator(u32 key, char *val, void *count) {
     PT_ASSERT_STR_EQ(val, as_words[key]);
     ++(*((u32 *)count));
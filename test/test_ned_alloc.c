@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "test.h"
+
+#include "ned_alloc.h"
+
+#define SETUP \
+    ned_allocator ctx; \
+    ned_alloc_ctx_init(&ctx, 0);
+
+#define TEARDOWN \
+    yu_alloc_ctx_free(&ctx);
+
+#define LIST_NED_ALLOC_TESTS(X) \
+    X(alloc_zero, "alloc() should initialize the requested space to 0") \
+    X(page_reserve, "Reserved address spaces should be tracked by the context") \
+    X(page_release, "release() should stop tracking the address space") \
+    X(page_free, "free() on a reserved address space should be equivalent to decommit+release") \
+    X(page_context_free, "When a context is freed all virtual pages allocated by it should be released") \
+    X(page_sizes, "_size() functions on a reserved address space should return the requested and rounded sizes") \
+    X(decommit_trim, "Decommitting should trim the pool instead of growing it")
+
+TEST(alloc_zero)
+    int *ns;
+    yu_err err = yu_alloc(&ctx, (void **)&ns, 50, sizeof(int), 64);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ((uintptr_t)ns % 64, 0u);
+    bool all_z = true;
+    for (int i = 0; i < 50; i++) {
+        if (ns[i] != 0) {
+            all_z = false;
+            break;
+        }
+    }
+    PT_ASSERT(all_z);
+    yu_free(&ctx, ns);
+END(alloc_zero)
+
+TEST(page_reserve)
+    void *ptr;
+    size_t sz;
+    yu_err err = yu_reserve(&ctx, &ptr, 1024*1024, 3);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ((uintptr_t)ptr % yu_virtual_pagesize(0), 0u);
+    PT_ASSERT(sysmem_pgtbl_get(&ctx.pgs, ptr, &sz));
+    PT_ASSERT_EQ(sz, 1024*1024*3u);
+    err = yu_commit(&ctx, ptr, 1024, 64);
+    assert(err == YU_OK);
+    memcpy((char *)ptr+300, "kagura", 7);
+    PT_ASSERT_STR_EQ((char *)ptr+300, "kagura");
+END(page_reserve)
+
+TEST(page_release)
+    void *ptr;
+    yu_err err = yu_reserve(&ctx, &ptr, 65536, 1);
+    assert(err == YU_OK);
+    PT_ASSERT(yu_release(&ctx, ptr) == YU_OK);
+    PT_ASSERT(!sysmem_pgtbl_get(&ctx.pgs, ptr, NULL));
+    PT_ASSERT(yu_release(&ctx, ptr) != YU_OK);
+END(page_release)
+
+TEST(page_free)
+    void *ptr;
+    yu_err err = yu_reserve(&ctx, &ptr, 65536, 4);
+    assert(err == YU_OK);
+    err = yu_commit(&ctx, ptr, 1024, 64);
+    assert(err == YU_OK);
+    memcpy((char *)ptr+300, "shinpachi", 10);
+    yu_free(&ctx, ptr);
+    PT_ASSERT(!sysmem_pgtbl_get(&ctx.pgs, ptr, NULL));
+    void *check;
+    size_t check_sz = yu_virtual_alloc(&check, ptr, 310, YU_VIRTUAL_RESERVE | YU_VIRTUAL_COMMIT | YU_VIRTUAL_FIXED_ADDR);
+    PT_ASSERT(check_sz > 0);
+    PT_ASSERT_EQ(((char *)ptr)[301], 0);
+    yu_virtual_free(check, check_sz, YU_VIRTUAL_DECOMMIT | YU_VIRTUAL_RELEASE);
+END(page_free)
+
+TEST(page_context_free)
+    void *ptr1, *ptr2;
+    size_t req_sz = 65536;
+    yu_err err = yu_reserve(&ctx, &ptr1, req_sz, 1);
+    assert(err == YU_OK);
+    err = yu_reserve(&ctx, &ptr2, req_sz, 2);
+    assert(err == YU_OK);
+    memcpy(ptr1, "otae", 5);
+    memcpy(ptr2, "sadaharu", 9);
+    yu_alloc_ctx_free(&ctx);
+
+    char *check1, *check2;
+    size_t check_sz = yu_virtual_alloc((void **)&check1, ptr1, req_sz, YU_VIRTUAL_RESERVE | YU_VIRTUAL_COMMIT | YU_VIRTUAL_FIXED_ADDR);
+    PT_ASSERT(check_sz > 0);
+    check_sz = yu_virtual_alloc((void **)&check2, ptr2, req_sz*2, YU_VIRTUAL_RESERVE | YU_VIRTUAL_COMMIT | YU_VIRTUAL_FIXED_ADDR);
+    PT_ASSERT(check_sz > 0);
+    PT_ASSERT_EQ(check1[0]+check1[1]+check1[2], 0);
+    PT_ASSERT_EQ(check2[0]+check2[1]+check2[2], 0);
+    yu_virtual_free(check1, req_sz, YU_VIRTUAL_DECOMMIT | YU_VIRTUAL_RELEASE);
+    yu_virtual_free(check2, req_sz*2, YU_VIRTUAL_DECOMMIT | YU_VIRTUAL_RELEASE);
+
+    // Re-init so that TEARDOWN can free it
+    ned_alloc_ctx_init(&ctx, 0);
+END(page_context_free)
+
+TEST(page_sizes)
+    void *ptr;
+    yu_err err = yu_reserve(&ctx, &ptr, 1024, 1);
+    assert(err == YU_OK);
+    PT_ASSERT(ptr != NULL);
+    PT_ASSERT_EQ(yu_allocated_size(&ctx, ptr), 1024u);
+    PT_ASSERT_EQ(yu_usable_size(&ctx, ptr), yu_virtual_pagesize(0));
+END(page_sizes)
+
+TEST(decommit_trim)
+    void *blocks[4096], *pg;
+    for (u32 i = 0; i < elemcount(blocks); i++)
+        blocks[i] = yu_xalloc(&ctx, 1, 2048);
+    for (u32 i = 0; i < elemcount(blocks); i++)
+        yu_free(&ctx, blocks[i]);
+    size_t before = nedpmalloc_footprint(ctx.pool);
+
+    yu_err err = yu_reserve(&ctx, &pg, 65536, 1);
+    assert(err == YU_OK);
+    err = yu_commit(&ctx, pg, 65536, 1);
+    assert(err == YU_OK);
+    err = yu_decommit(&ctx, pg, 65536, 1);
+    assert(err == YU_OK);
+    // The freed blocks are given back by the trim, not just by being freed
+    PT_ASSERT_LT(nedpmalloc_footprint(ctx.pool), before);
+
+    // Nor is a pool that hasn't grown much swapped for a new one
+    nedpool *pool = ctx.pool;
+    err = yu_decommit(&ctx, pg, 65536, 1);
+    assert(err == YU_OK);
+    PT_ASSERT(ctx.pool == pool);
+
+    // And one with something still in it mustn't be swapped out from under it
+    for (u32 i = 0; i < elemcount(blocks); i++)
+        blocks[i] = yu_xalloc(&ctx, 1, 2048);
+    for (u32 i = 1; i < elemcount(blocks); i++)
+        yu_free(&ctx, blocks[i]);
+    pool = ctx.pool;
+    err = yu_decommit(&ctx, pg, 65536, 1);
+    assert(err == YU_OK);
+    PT_ASSERT(ctx.pool == pool);
+    yu_free(&ctx, blocks[0]);
+END(decommit_trim)
+
+SUITE(ned_alloc, LIST_NED_ALLOC_TESTS)
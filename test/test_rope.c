@@ -20,6 +20,11 @@
 #define LIST_ROPE_TESTS(X) \
   X(create_str, "Initializing a rope with a string should create a rope with the same contents") \
   X(unicode_str, "Code point counts should accurately be reported for UTF-8 strings") \
+  X(iter, "Iterating should visit the rope in place across nodes, like a yu_str") \
+  X(node_reuse, "Deleted nodes should be reused rather than allocating more") \
+  X(cursor, "Edits through cursors should match the same edits by position") \
+  X(from_file, "A rope made from a file should read and edit like one made from a string") \
+  X(find, "Searching should find the same matches as in the flattened rope, across nodes") \
 
 
 TEST(create_str)
@@ -41,4 +46,358 @@ TEST(unicode_str)
   PT_ASSERT_EQ(rope_char_count(r2), 4u);
 END(unicode_str)
 
+TEST(iter)
+  // Long enough to take several nodes; ROPE_NODE_STR_SIZE bytes at a time
+  // means some clusters straddle two of them
+  char s[1024] = "";
+  for (int i = 0; i < 12; i++)
+    strcat(s, "the lazy dog q\xcc\x82 नि ф, ");
+  rope *r2 = rope_new_with_utf8((yu_allocator *)&mctx, &rng, (const u8 *)s);
+  rope_text_iter it;
+  size_t n = 0, start, len;
+  uint32_t cp;
+  uint8_t byte;
+
+  rope_text_iter_init(&it, r2);
+  while (rope_next_byte(&it, &byte))
+    PT_ASSERT_EQ(byte, (u8)s[n++]);
+  PT_ASSERT_EQ(n, strlen(s));
+
+  n = 0;
+  rope_text_iter_init(&it, r2);
+  while (rope_next_cp(&it, &cp))
+    n++;
+  PT_ASSERT_EQ(n, rope_char_count(r2));
+
+  yu_str_ctx ctx;
+  yu_str str;
+  yu_str_iter sit;
+  u64 sstart, slen;
+  yu_str_ctx_init(&ctx, (yu_allocator *)&mctx);
+  yu_err err = yu_str_new_z(&ctx, s, &str);
+  assert(err == YU_OK);
+  yu_str_iter_init(&sit, str);
+  rope_text_iter_init(&it, r2);
+  while (rope_next_grapheme(&it, &start, &len)) {
+    PT_ASSERT(yu_str_next_grapheme(&sit, &sstart, &slen));
+    PT_ASSERT_EQ(start, sstart);
+    PT_ASSERT_EQ(len, slen);
+  }
+  PT_ASSERT(!yu_str_next_grapheme(&sit, &sstart, &slen));
+  yu_str_ctx_free(&ctx);
+
+  // The empty rope
+  rope_text_iter_init(&it, r);
+  PT_ASSERT(!rope_next_grapheme(&it, &start, &len));
+  rope_free(r2);
+END(iter)
+
+TEST(node_reuse)
+  char s[ROPE_NODE_STR_SIZE + 1];
+  memset(s, 'x', ROPE_NODE_STR_SIZE);
+  s[ROPE_NODE_STR_SIZE] = '\0';
+
+  // Every insert is a full node of its own
+  for (int i = 0; i < 200; i++)
+    PT_ASSERT(rope_insert(r, 0, (const u8 *)s) == ROPE_OK);
+  struct rope_slab *slabs = r->slabs;
+  rope_del(r, 0, rope_char_count(r));
+  PT_ASSERT_EQ(rope_byte_count(r), 0u);
+
+  for (int i = 0; i < 200; i++)
+    PT_ASSERT(rope_insert(r, rope_char_count(r), (const u8 *)s) == ROPE_OK);
+  PT_ASSERT(r->slabs == slabs);
+  PT_ASSERT_EQ(rope_byte_count(r), 200u * ROPE_NODE_STR_SIZE);
+
+  rope *r2 = rope_copy(r);
+  PT_ASSERT_EQ(rope_byte_count(r2), rope_byte_count(r));
+  rope_del(r, 0, rope_char_count(r));
+  u8 *c = rope_create_cstr(r2);
+  PT_ASSERT_EQ(c[0], 'x');
+  yu_free((yu_allocator *)&mctx, c);
+  rope_free(r2);
+END(node_reuse)
+
+TEST(cursor)
+  // Mirrors every edit in a plain array
+  char expect[4096] = "";
+  size_t len = 0;
+  u64 x = 1;
+  rope_cursor c, d;
+  rope_cursor_init(&c, r, 0);
+  rope_cursor_init(&d, r, 0);
+
+  for (int i = 0; i < 3000; i++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    size_t pos = x % (len + 1);
+    u32 what = (x >> 32) % 16;
+    if (what == 0) {
+      // Jump somewhere else
+      rope_cursor_seek(&c, pos);
+    } else if (what == 1 && c.pos > 0) {
+      // Backspace
+      rope_cursor_seek(&c, c.pos - 1);
+      rope_cursor_del(&c, 1);
+      memmove(expect + c.pos, expect + c.pos + 1, len - c.pos);
+      len--;
+    } else if (what == 2) {
+      // Someone else edits the rope, so c's path must be found again
+      const char *t = i % 2 ? "ab" : "a much longer string that takes a new node to fit in";
+      size_t tlen = strlen(t);
+      if (len + tlen >= sizeof(expect))
+        continue;
+      rope_cursor_seek(&d, pos);
+      PT_ASSERT(rope_cursor_insert(&d, (const u8 *)t) == ROPE_OK);
+      memmove(expect + pos + tlen, expect + pos, len - pos);
+      memcpy(expect + pos, t, tlen);
+      len += tlen;
+      if (c.pos > pos)
+        rope_cursor_seek(&c, c.pos + tlen);
+    } else if (what == 3 && len > 100) {
+      size_t n = (x >> 40) % 200;
+      rope_del(r, pos, n);
+      n = min(n, len - pos);
+      memmove(expect + pos, expect + pos + n, len - pos - n);
+      len -= n;
+      // Only follows the text c was in if it's left before the end; past it,
+      // c has to clamp itself
+      if (c.pos > pos + n)
+        rope_cursor_seek(&c, c.pos - n);
+    } else if (len + 1 < sizeof(expect)) {
+      // Typing
+      char ch[2] = { (char)('a' + what), '\0' };
+      size_t at = min(c.pos, len);
+      memmove(expect + at + 1, expect + at, len - at);
+      expect[at] = ch[0];
+      len++;
+      PT_ASSERT(rope_cursor_insert(&c, (const u8 *)ch) == ROPE_OK);
+    }
+    PT_ASSERT_EQ(rope_char_count(r), len);
+  }
+
+  expect[len] = '\0';
+  u8 *out = rope_create_cstr(r);
+  PT_ASSERT_STR_EQ((char *)out, expect);
+  yu_free((yu_allocator *)&mctx, out);
+
+  // A kept path that ends at the very start of a node isn't usable for
+  // inserting there: splitting it would leave the node empty
+  rope *q = rope_new((yu_allocator *)&mctx, &rng);
+  memset(expect, 'a', 200);
+  expect[200] = '\0';
+  PT_ASSERT(rope_insert(q, 0, (const u8 *)expect) == ROPE_OK);
+  // Start of the last node
+  size_t second = 0;
+  ROPE_FOREACH(q, n) {
+    if (n->nexts[0].node)
+      second += rope_node_chars(n);
+  }
+  rope_cursor_init(&c, q, second + 1);
+  PT_ASSERT(rope_cursor_insert(&c, (const u8 *)"y") == ROPE_OK);
+  rope_cursor_seek(&c, second);
+  memset(expect, 'b', 299);
+  expect[299] = '\0';
+  PT_ASSERT(rope_cursor_insert(&c, (const u8 *)expect) == ROPE_OK);
+  bool none_empty = true;
+  ROPE_FOREACH(q, n)
+    none_empty &= n == &q->head || rope_node_num_bytes(n) > 0;
+  PT_ASSERT(none_empty);
+  PT_ASSERT_EQ(rope_char_count(q), 500u);
+  rope_free(q);
+
+  // Deleting out from under a cursor leaves it at the end
+  q = rope_new_with_utf8((yu_allocator *)&mctx, &rng, (const u8 *)"0123456789");
+  rope_cursor_init(&c, q, 10);
+  rope_del(q, 0, 5);
+  rope_cursor_del(&c, 1);
+  PT_ASSERT(rope_cursor_insert(&c, (const u8 *)"x") == ROPE_OK);
+  PT_ASSERT_EQ(c.pos, 6u);
+  rope_del(q, 0, 3);
+  rope_cursor_del(&c, 1);
+  PT_ASSERT_EQ(c.pos, 3u);
+  out = rope_create_cstr(q);
+  PT_ASSERT_STR_EQ((char *)out, "89x");
+  yu_free((yu_allocator *)&mctx, out);
+  rope_free(q);
+END(cursor)
+
+// Character position of byte offset off in s
+static size_t char_pos(const char *s, size_t off) {
+  size_t n = 0;
+  for (size_t i = 0; i < off; i++)
+    n += (s[i] & 0xc0) != 0x80;
+  return n;
+}
+
+// Byte offset of character position pos in s
+static size_t byte_off(const char *s, size_t pos) {
+  size_t i = 0;
+  for (; s[i] && pos; i++)
+    pos -= (s[i + 1] & 0xc0) != 0x80;
+  return i;
+}
+
+struct find_all_data {
+  size_t found[16];
+  size_t count;
+};
+
+static uint32_t record_match(size_t pos, void *data) {
+  struct find_all_data *d = data;
+  d->found[d->count++] = pos;
+  return d->count == elemcount(d->found);
+}
+
+TEST(find)
+  char s[2048] = "";
+  for (int i = 0; i < 20; i++)
+    strcat(s, i % 3 ? "ab年ab" : "the lazy фox, ");
+  PT_ASSERT(rope_insert(r, 0, (const u8 *)s) == ROPE_OK);
+  // Take bits out and put them back so node boundaries land all over the place
+  for (size_t pos = 3; pos + 5 < rope_char_count(r); pos += 11) {
+    char piece[32] = "";
+    size_t off = byte_off(s, pos);
+    strncat(piece, s + off, byte_off(s, pos + 5) - off);
+    rope_del(r, pos, 5);
+    PT_ASSERT(rope_insert(r, pos, (const u8 *)piece) == ROPE_OK);
+  }
+  u8 *flat = rope_create_cstr(r);
+  PT_ASSERT_STR_EQ((char *)flat, s);
+  yu_free((yu_allocator *)&mctx, flat);
+
+  // Every substring starting on a character, including ones longer than a node
+  size_t len = strlen(s);
+  for (size_t i = 0; i < len; i += 5) {
+    if ((s[i] & 0xc0) == 0x80)
+      continue;
+    for (size_t n = 1; i + n <= len; n += n < 8 ? 1 : 97) {
+      if (i + n < len && (s[i + n] & 0xc0) == 0x80)
+        continue;
+      char needle[2048] = "";
+      strncat(needle, s + i, n);
+      size_t start = char_pos(s, i / 2);
+      size_t expect = char_pos(s, strstr(s + i / 2, needle) - s);
+      PT_ASSERT_EQ(rope_find(r, (const u8 *)needle, start), expect);
+    }
+  }
+  PT_ASSERT_EQ(rope_find(r, (const u8 *)"fox", 0), SIZE_MAX);
+  PT_ASSERT_EQ(rope_find(r, (const u8 *)"ф", 1000), SIZE_MAX);
+  PT_ASSERT_EQ(rope_find(r, (const u8 *)"", 3), 3u);
+  PT_ASSERT_EQ(rope_find(r, (const u8 *)"\xe5", 0), SIZE_MAX);
+
+  // Matches don't overlap
+  struct find_all_data d = { .count = 0 };
+  PT_ASSERT_EQ(rope_find_all(r, (const u8 *)"abab", record_match, &d), 6u);
+  const char *p = s;
+  for (size_t i = 0; i < d.count; i++, p += 4) {
+    p = strstr(p, "abab");
+    PT_ASSERT_EQ(d.found[i], char_pos(s, p - s));
+  }
+  PT_ASSERT(strstr(p, "abab") == NULL);
+  // Stops when asked to
+  d.count = 0;
+  PT_ASSERT_EQ(rope_find_all(r, (const u8 *)"b", record_match, &d), elemcount(d.found));
+  PT_ASSERT_EQ(rope_find_all(r, (const u8 *)"", record_match, &d), 0u);
+END(find)
+
+#define FROM_FILE_PATH "test/rope_from_file.tmp"
+
+static bool write_file(const char *s, size_t len, size_t reps) {
+  FILE *f = fopen(FROM_FILE_PATH, "wb");
+  if (!f)
+    return false;
+  for (size_t i = 0; i < reps; i++)
+    fwrite(s, 1, len, f);
+  return fclose(f) == 0;
+}
+
+// Whether r holds the code points in expect
+static bool rope_matches(rope *r, const u32 *expect, size_t len) {
+  rope_text_iter it;
+  uint32_t cp;
+  size_t i = 0;
+  rope_text_iter_init(&it, r);
+  while (rope_next_cp(&it, &cp)) {
+    if (i == len || cp != expect[i++])
+      return false;
+  }
+  return i == len && rope_char_count(r) == len;
+}
+
+TEST(from_file)
+  // 6 bytes a repetition, so chunks start and end in the middle of characters
+  const char unit[] = "年ф\n";
+  const u32 unit_cps[] = { 0x5e74, 0x444, '\n' };
+  const size_t reps = 16666, unit_len = strlen(unit);
+  PT_ASSERT(write_file(unit, unit_len, reps));
+
+  rope *r2 = rope_new_from_file((yu_allocator *)&mctx, &rng, FROM_FILE_PATH);
+  PT_ASSERT(r2 != NULL);
+  PT_ASSERT_EQ(rope_byte_count(r2), reps * unit_len);
+  PT_ASSERT_EQ(rope_char_count(r2), reps * 3);
+  PT_ASSERT(r2->head.nexts[0].node->what == ROPE_NODE_MAPPED);
+  rope *r3 = rope_copy(r2);
+
+  size_t len = reps * 3;
+  u32 *expect = yu_xalloc((yu_allocator *)&mctx, len + 4096, sizeof(u32));
+  for (size_t i = 0; i < len; i++)
+    expect[i] = unit_cps[i % 3];
+  PT_ASSERT(rope_matches(r2, expect, len));
+  PT_ASSERT_EQ(rope_find(r2, (const u8 *)"\n年", len / 2), len / 2 + 2);
+
+  // Inserts and deletes anywhere, of anything from a character to several
+  // chunks, and some typing through a cursor
+  u64 x = 1;
+  rope_cursor c;
+  rope_cursor_init(&c, r2, len / 2);
+  for (int i = 0; i < 400; i++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    size_t pos = x % (len + 1);
+    u32 what = (x >> 32) % 4;
+    if (what == 0 && len < reps * 3 + 4000) {
+      rope_cursor_seek(&c, pos);
+      PT_ASSERT(rope_cursor_insert(&c, (const u8 *)"\xce\xbe") == ROPE_OK);
+      memmove(expect + pos + 1, expect + pos, (len - pos) * sizeof(u32));
+      expect[pos] = 0x3be;
+      len++;
+    } else if (what == 1 && len < reps * 3 + 4000) {
+      PT_ASSERT(rope_insert(r2, pos, (const u8 *)"zz") == ROPE_OK);
+      memmove(expect + pos + 2, expect + pos, (len - pos) * sizeof(u32));
+      expect[pos] = expect[pos + 1] = 'z';
+      len += 2;
+    } else {
+      size_t n = (x >> 40) % (what == 2 ? 8 : 20000);
+      rope_del(r2, pos, n);
+      n = min(n, len - pos);
+      memmove(expect + pos, expect + pos + n, (len - pos - n) * sizeof(u32));
+      len -= n;
+    }
+    PT_ASSERT_EQ(rope_char_count(r2), len);
+  }
+  PT_ASSERT(rope_matches(r2, expect, len));
+
+  // The copy shares the mapping, which outlives the rope it came from
+  rope_free(r2);
+  for (size_t i = 0; i < reps * 3; i++)
+    expect[i] = unit_cps[i % 3];
+  PT_ASSERT(rope_matches(r3, expect, reps * 3));
+  rope_del(r3, 1, reps * 3 - 2);
+  u8 *out = rope_create_cstr(r3);
+  PT_ASSERT_STR_EQ((char *)out, "年\n");
+  yu_free((yu_allocator *)&mctx, out);
+  rope_free(r3);
+  yu_free((yu_allocator *)&mctx, expect);
+
+  // Truncated in the middle of a character
+  PT_ASSERT(write_file(unit, 4, 1));
+  PT_ASSERT(rope_new_from_file((yu_allocator *)&mctx, &rng, FROM_FILE_PATH) == NULL);
+  PT_ASSERT(write_file("", 0, 0));
+  r2 = rope_new_from_file((yu_allocator *)&mctx, &rng, FROM_FILE_PATH);
+  PT_ASSERT(r2 != NULL);
+  PT_ASSERT_EQ(rope_char_count(r2), 0u);
+  rope_free(r2);
+  remove(FROM_FILE_PATH);
+  PT_ASSERT(rope_new_from_file((yu_allocator *)&mctx, &rng, FROM_FILE_PATH) == NULL);
+END(from_file)
+
 SUITE(rope, LIST_ROPE_TESTS)
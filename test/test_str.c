@@ -18,7 +18,13 @@
 
 #define LIST_STR_TESTS(X) \
     X(intern, "Strings should be interned") \
-    X(length, "Length should be in grapheme clusters")
+    X(length, "Length should be in grapheme clusters") \
+    X(dat_pool, "String data should stay put and be recycled after freeing") \
+    X(fast_path, "ASCII and normalized input should match the normalizing path") \
+    X(index, "Any grapheme cluster should be reachable by index") \
+    X(slice, "Slices should view their parent without copying") \
+    X(builder, "Builders should make the same string as building it in one go") \
+    X(iter, "Iterators should visit every byte, code point and grapheme cluster")
 
 TEST(intern)
     yu_str s, t;
@@ -38,5 +44,296 @@ TEST(length)
     PT_ASSERT_EQ(yu_str_len(s), 6u);
 END(length)
 
+TEST(dat_pool)
+    yu_str foo, again, s;
+    struct yu_str_dat *foo_dat;
+    char name[32];
+    yu_err err;
+
+    err = yu_str_new_z(&ctx, "foo", &foo);
+    assert(err == YU_OK);
+    foo_dat = YU_STR_DAT(foo);
+
+    // Enough strings to need a few more chunks; earlier ones mustn't move
+    for (u32 i = 0; i < YU_STR_DAT_CHUNK * 3; i++) {
+        snprintf(name, sizeof(name), "str%u", i);
+        err = yu_str_new_z(&ctx, name, &s);
+        assert(err == YU_OK);
+    }
+    PT_ASSERT(YU_STR_DAT(foo) == foo_dat);
+    PT_ASSERT(foo_dat->str == foo);
+
+    // Asking for a freed string again before its slot is reused revives it
+    yu_str_free(foo);
+    err = yu_str_new_z(&ctx, "foo", &again);
+    assert(err == YU_OK);
+    PT_ASSERT(again == foo);
+    PT_ASSERT(YU_STR_DAT(again) == foo_dat);
+
+    // Once a freed slot is reused, it's for the new string
+    yu_str_free(foo);
+    err = yu_str_new_z(&ctx, "bar", &s);
+    assert(err == YU_OK);
+    PT_ASSERT(YU_STR_DAT(s) == foo_dat);
+    PT_ASSERT_EQ(yu_str_len(s), 3u);
+
+    // ...and none of the old string's properties carry over
+    yu_str_free(s);
+    err = yu_str_new_z(&ctx, "h\xc3\xa9llo", &s);
+    assert(err == YU_OK);
+    PT_ASSERT(YU_STR_DAT(s) == foo_dat);
+    PT_ASSERT(!foo_dat->is_ascii);
+    PT_ASSERT_EQ(yu_str_len(s), 5u);
+    yu_str c;
+    err = yu_str_at(s, 2, &c);
+    PT_ASSERT_EQ(err, YU_OK);
+    PT_ASSERT_EQ(yu_buf_len(c), 1u);
+    PT_ASSERT_EQ(c[0], 'l');
+END(dat_pool)
+
+// Interns both spellings and checks they're the same string with the expected
+// number of graphemes
+static bool same_str(yu_str_ctx *ctx, const char *a, const char *b, u64 graphemes) {
+    yu_str sa, sb;
+    if (yu_str_new_z(ctx, a, &sa) != YU_OK || yu_str_new_z(ctx, b, &sb) != YU_OK)
+        return false;
+    return sa == sb && yu_str_len(sa) == graphemes;
+}
+
+TEST(fast_path)
+    yu_str s, c;
+    yu_err err;
+
+    // Long enough to go through the vector loop and its tail
+    const char *ascii = "The quick brown fox jumps over the lazy dog, twice.";
+    err = yu_str_new_z(&ctx, ascii, &s);
+    assert(err == YU_OK);
+    PT_ASSERT(YU_STR_DAT(s)->is_ascii);
+    PT_ASSERT(YU_STR_DAT(s)->egc_marks == NULL);
+    PT_ASSERT_EQ(yu_str_len(s), (u64)strlen(ascii));
+    err = yu_str_at(s, -2, &c);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(yu_buf_len(c), 1u);
+    PT_ASSERT_EQ(c[0], 'e');
+
+    // Line breaks still become U+2028, wherever they fall
+    PT_ASSERT(same_str(&ctx, "a line of text that is long\r\nenough", "a line of text that is long\xe2\x80\xa8" "enough", 34));
+    PT_ASSERT(same_str(&ctx, "x\n", "x\xe2\x80\xa8", 2));
+    PT_ASSERT(same_str(&ctx, "\xc2\x85", "\xe2\x80\xa8", 1));
+
+    // Precomposed text is taken as is; decomposed text still gets composed
+    PT_ASSERT(same_str(&ctx, "caf\xc3\xa9", "cafe\xcc\x81", 4));
+    // A combining mark right after a run of ASCII joins the last character
+    PT_ASSERT(same_str(&ctx, "abcdefghijklmnopqrstuvwxyz\xcc\x82", "abcdefghijklmnopqrstuvwxy\xe1\xba\x91", 26));
+    // Hangul jamo compose algorithmically
+    PT_ASSERT(same_str(&ctx, "\xe1\x84\x80\xe1\x85\xa1", "\xea\xb0\x80", 1));
+    // Singleton decompositions (the ohm sign is an omega)
+    PT_ASSERT(same_str(&ctx, "\xe2\x84\xa6", "\xce\xa9", 1));
+    // Excluded compositions don't compose back (devanagari qa stays ka + nukta)
+    PT_ASSERT(same_str(&ctx, "\xe0\xa5\x98", "\xe0\xa4\x95\xe0\xa4\xbc", 1));
+
+    err = yu_str_new_z(&ctx, "ok \xff", &s);
+    PT_ASSERT(err == YU_ERR_BAD_STRING_ENCODING);
+END(fast_path)
+
+TEST(index)
+    // Clusters of 1, 3 and 6 bytes (q + acute has no precomposed form, नि
+    // is two codepoints) in a string well past a few strides
+    static const char *clusters[] = {"a", "q\xcc\x81", "\xe0\xa4\xa8\xe0\xa4\xbf"};
+    const u32 n = 1000;
+    char *text = malloc(n * 6 + 1);
+    u64 text_len = 0;
+    for (u32 i = 0; i < n; i++) {
+        strcpy(text + text_len, clusters[i * 7 % 3]);
+        text_len += strlen(clusters[i * 7 % 3]);
+    }
+
+    yu_str s, c;
+    yu_err err = yu_str_new_z(&ctx, text, &s);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(yu_str_len(s), n);
+    PT_ASSERT(YU_STR_DAT(s)->egc_marks != NULL);
+    for (u32 i = 0; i < n; i++) {
+        const char *want = clusters[i * 7 % 3];
+        err = yu_str_at(s, i, &c);
+        assert(err == YU_OK);
+        PT_ASSERT_EQ(yu_buf_len(c), (u64)strlen(want));
+        PT_ASSERT(memcmp(c, want, strlen(want)) == 0);
+    }
+    err = yu_str_at(s, -1, &c);
+    assert(err == YU_OK);
+    PT_ASSERT(memcmp(c, clusters[(n - 1) * 7 % 3], yu_buf_len(c)) == 0);
+    err = yu_str_at(s, n, &c);
+    PT_ASSERT(err == YU_ERR_STRING_INDEX_OUT_OF_BOUNDS);
+
+    // Short strings have no marks at all
+    err = yu_str_new_z(&ctx, "hiनिффनि", &s);
+    assert(err == YU_OK);
+    PT_ASSERT(YU_STR_DAT(s)->egc_marks == NULL);
+    err = yu_str_at(s, 4, &c);
+    assert(err == YU_OK);
+    PT_ASSERT(memcmp(c, "ф", yu_buf_len(c)) == 0);
+    free(text);
+END(index)
+
+TEST(slice)
+    yu_str s, t, u;
+    yu_str_slice a, b, c;
+    yu_err err;
+
+    // 'hello', a space, नि (6 bytes, 1 cluster), 'ф' (2 bytes)
+    err = yu_str_new_z(&ctx, "hello निф", &s);
+    assert(err == YU_OK);
+    err = yu_str_slice_new(s, 6, 2, &a);
+    assert(err == YU_OK);
+    PT_ASSERT(a.parent == s);
+    PT_ASSERT_EQ(a.byte_start, 6u);
+    PT_ASSERT_EQ(a.byte_len, 8u);
+    PT_ASSERT_EQ(yu_str_slice_len(&a), 2u);
+    PT_ASSERT(yu_str_slice_bytes(&a) == s + 6);
+
+    err = yu_str_slice_sub(&a, 1, 1, &b);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(b.egc_start, 7u);
+    PT_ASSERT(memcmp(yu_str_slice_bytes(&b), "ф", b.byte_len) == 0);
+
+    err = yu_str_slice_new(s, 7, 2, &c);
+    PT_ASSERT(err == YU_ERR_STRING_INDEX_OUT_OF_BOUNDS);
+    err = yu_str_slice_sub(&a, 2, 1, &c);
+    PT_ASSERT(err == YU_ERR_STRING_INDEX_OUT_OF_BOUNDS);
+    err = yu_str_slice_new(s, 8, 0, &c);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(c.byte_start, yu_buf_len(s));
+    PT_ASSERT_EQ(c.byte_len, 0u);
+    yu_str_slice_free(&c);
+
+    // Interning gives the same string as building it from scratch
+    err = yu_str_slice_intern(&b, &t);
+    assert(err == YU_OK);
+    err = yu_str_new_z(&ctx, "ф", &u);
+    assert(err == YU_OK);
+    PT_ASSERT(t == u);
+    PT_ASSERT_EQ(yu_str_len(t), 1u);
+
+    err = yu_str_new_z(&ctx, "фф", &t);
+    assert(err == YU_OK);
+    err = yu_str_slice_new(t, 1, 1, &c);
+    assert(err == YU_OK);
+    PT_ASSERT(yu_str_slice_eq(&b, &c));
+    PT_ASSERT(!yu_str_slice_eq(&a, &c));
+    yu_str_slice_free(&c);
+
+    // A freed string isn't reused while slices still look at it
+    struct yu_str_dat *dat = YU_STR_DAT(s);
+    yu_str_free(s);
+    err = yu_str_new_z(&ctx, "something else", &t);
+    assert(err == YU_OK);
+    PT_ASSERT(YU_STR_DAT(t) != dat);
+    PT_ASSERT(memcmp(yu_str_slice_bytes(&a), "निф", a.byte_len) == 0);
+    yu_str_slice_free(&b);
+    yu_str_slice_free(&a);
+    err = yu_str_new_z(&ctx, "and another", &t);
+    assert(err == YU_OK);
+    PT_ASSERT(YU_STR_DAT(t) == dat);
+END(slice)
+
+TEST(builder)
+    yu_str_builder b;
+    yu_str s, t, piece;
+    yu_err err;
+
+    // Enough pieces to regrow a few times
+    err = yu_str_builder_init(&b, &ctx, 0);
+    assert(err == YU_OK);
+    for (u32 i = 0; i < 100; i++) {
+        err = yu_str_builder_append(&b, (const u8 *)"abc", 3);
+        assert(err == YU_OK);
+    }
+    err = yu_str_builder_finish(&b, &s);
+    assert(err == YU_OK);
+    PT_ASSERT(b.buf == NULL);
+    PT_ASSERT_EQ(yu_buf_len(s), 300u);
+    PT_ASSERT_EQ(yu_str_len(s), 300u);
+    PT_ASSERT(memcmp(s + 297, "abc", 3) == 0);
+
+    // The whole is normalized, not each piece: e + a combining acute accent
+    // added separately still compose, and CR LF is still one line break
+    err = yu_str_builder_init(&b, &ctx, 64);
+    assert(err == YU_OK);
+    err = yu_str_new_z(&ctx, "caf", &piece);
+    assert(err == YU_OK);
+    err = yu_str_builder_append_str(&b, piece);
+    assert(err == YU_OK);
+    err = yu_str_builder_append(&b, (const u8 *)"e", 1);
+    assert(err == YU_OK);
+    err = yu_str_builder_append(&b, (const u8 *)"\xcc\x81\r", 3);
+    assert(err == YU_OK);
+    err = yu_str_builder_append(&b, (const u8 *)"\n", 1);
+    assert(err == YU_OK);
+    err = yu_str_builder_finish(&b, &s);
+    assert(err == YU_OK);
+    err = yu_str_new_z(&ctx, "caf\xc3\xa9\xe2\x80\xa8", &t);
+    assert(err == YU_OK);
+    PT_ASSERT(s == t);
+
+    err = yu_str_builder_init(&b, &ctx, 0);
+    assert(err == YU_OK);
+    err = yu_str_builder_append(&b, (const u8 *)"\xff", 1);
+    assert(err == YU_OK);
+    err = yu_str_builder_finish(&b, &s);
+    PT_ASSERT(err == YU_ERR_BAD_STRING_ENCODING);
+    PT_ASSERT(b.buf == NULL);
+END(builder)
+
+TEST(iter)
+    yu_str s, c;
+    yu_str_slice sl;
+    yu_str_iter it;
+    yu_err err;
+    u64 start, len, n = 0;
+    u32 cp;
+    u8 byte;
+
+    // An ASCII run longer than a vector, one ending in a combining
+    // sequence (q̂ has no precomposed form) and a few multi-byte clusters
+    err = yu_str_new_z(&ctx, "the quick brown fox jumps over the lazy dog q\xcc\x82 नि\r\nфx", &s);
+    assert(err == YU_OK);
+
+    yu_str_iter_init(&it, s);
+    while (yu_str_next_grapheme(&it, &start, &len)) {
+        err = yu_str_at(s, n++, &c);
+        assert(err == YU_OK);
+        PT_ASSERT_EQ(yu_buf_len(c), len);
+        PT_ASSERT(memcmp(s + start, c, len) == 0);
+    }
+    PT_ASSERT_EQ(n, yu_str_len(s));
+
+    n = 0;
+    yu_str_iter_init(&it, s);
+    while (yu_str_next_cp(&it, &cp))
+        ++n;
+    PT_ASSERT_EQ(n, (u64)utf8proc_decompose(s, yu_buf_len(s), NULL, 0, 0));
+    PT_ASSERT(!yu_str_next_byte(&it, &byte));
+
+    // Kinds can be mixed at cluster boundaries
+    yu_str_iter_init(&it, s);
+    PT_ASSERT(yu_str_next_byte(&it, &byte));
+    PT_ASSERT_EQ(byte, 't');
+    PT_ASSERT(yu_str_next_cp(&it, &cp));
+    PT_ASSERT_EQ(cp, (u32)'h');
+    PT_ASSERT(yu_str_next_grapheme(&it, &start, &len));
+    PT_ASSERT_EQ(start, 2u);
+
+    err = yu_str_slice_new(s, 44, 2, &sl);
+    assert(err == YU_OK);
+    yu_str_slice_iter_init(&it, &sl);
+    PT_ASSERT(yu_str_next_grapheme(&it, &start, &len));
+    PT_ASSERT_EQ(len, 3u);
+    PT_ASSERT(yu_str_next_grapheme(&it, &start, &len));
+    PT_ASSERT_EQ(start, 3u);
+    PT_ASSERT_EQ(len, 1u);
+    PT_ASSERT(!yu_str_next_grapheme(&it, &start, &len));
+    yu_str_slice_free(&sl);
+END(iter)
 
 SUITE(str, LIST_STR_TESTS)
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2016 Peter Cannici
+ * Licensed under the MIT (X11) license. See LICENSE.
+ */
+
+#include "test.h"
+
+#include "tl_alloc.h"
+#include <pthread.h>
+
+#define SETUP \
+    sys_allocator backing; \
+    sys_alloc_ctx_init(&backing); \
+    tl_heap heap; \
+    tl_heap_init(&heap, (yu_allocator *)&backing); \
+    tl_allocator ctx; \
+    tl_alloc_ctx_init(&ctx, &heap);
+
+#define TEARDOWN \
+    yu_alloc_ctx_free(&ctx); \
+    yu_alloc_ctx_free(&backing);
+
+#define LIST_TL_ALLOC_TESTS(X) \
+    X(alloc_zero, "alloc() should initialize the requested space to 0") \
+    X(magazine_reuse, "A freed block should be handed out again for the same size class") \
+    X(large_aligned, "Large and over-aligned allocations should bypass the size classes") \
+    X(realloc_grow, "realloc() should preserve contents and zero any new space") \
+    X(remote_free, "Blocks freed by another thread's context should return to their owner") \
+    X(page_release, "Reserved pages should be tracked by the reserving context") \
+    X(context_free, "Freeing a context should return its slabs and large blocks to the heap") \
+    X(orphan_adopt, "A context freed with blocks still out should leave them to the next one")
+
+TEST(alloc_zero)
+    int *ns;
+    yu_err err = yu_alloc(&ctx, (void **)&ns, 50, sizeof(int), 0);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ((uintptr_t)ns % TL_DEFAULT_ALIGNMENT, 0u);
+    bool all_z = true;
+    for (int i = 0; i < 50; i++)
+        all_z &= ns[i] == 0;
+    PT_ASSERT(all_z);
+
+    memset(ns, 0xff, 50 * sizeof(int));
+    yu_free(&ctx, ns);
+    err = yu_alloc(&ctx, (void **)&ns, 50, sizeof(int), 0);
+    assert(err == YU_OK);
+    all_z = true;
+    for (int i = 0; i < 50; i++)
+        all_z &= ns[i] == 0;
+    PT_ASSERT(all_z);
+    yu_free(&ctx, ns);
+
+    // Zero-byte requests still get a (smallest-class) block
+    void *empty;
+    err = yu_alloc(&ctx, &empty, 0, sizeof(int), 0);
+    PT_ASSERT_EQ(err, YU_OK);
+    PT_ASSERT(empty != NULL);
+    PT_ASSERT_EQ(yu_allocated_size(&ctx, empty), 0u);
+    yu_free(&ctx, empty);
+END(alloc_zero)
+
+TEST(magazine_reuse)
+    void *a = yu_xalloc(&ctx, 1, 100), *b;
+    PT_ASSERT_EQ(yu_allocated_size(&ctx, a), 100u);
+    PT_ASSERT_EQ(yu_usable_size(&ctx, a), 128u);
+    PT_ASSERT(tl_block_owner(a) == &ctx);
+    yu_free(&ctx, a);
+    b = yu_xalloc(&ctx, 1, 120);
+    PT_ASSERT(a == b);
+    yu_free(&ctx, b);
+END(magazine_reuse)
+
+TEST(large_aligned)
+    void *big = yu_xalloc(&ctx, 1, 100000), *al;
+    PT_ASSERT_EQ(yu_usable_size(&ctx, big), 100000u);
+    PT_ASSERT(ctx.pool->large != NULL);
+    yu_err err = yu_alloc(&ctx, &al, 1, 24, 256);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ((uintptr_t)al % 256, 0u);
+    PT_ASSERT_EQ(yu_allocated_size(&ctx, al), 24u);
+    yu_free(&ctx, big);
+    yu_free(&ctx, al);
+    PT_ASSERT(ctx.pool->large == NULL);
+END(large_aligned)
+
+TEST(realloc_grow)
+    char *s = yu_xalloc(&ctx, 1, 20), *orig = s;
+    memcpy(s, "hijikata", 9);
+    yu_err err = yu_realloc(&ctx, (void **)&s, 1, 30, 0);
+    assert(err == YU_OK);
+    PT_ASSERT(s == orig);
+    PT_ASSERT_STR_EQ(s, "hijikata");
+    PT_ASSERT_EQ(s[25], 0);
+    err = yu_realloc(&ctx, (void **)&s, 1, 10000, 0);
+    assert(err == YU_OK);
+    PT_ASSERT(s != orig);
+    PT_ASSERT_STR_EQ(s, "hijikata");
+    PT_ASSERT_EQ(s[9999], 0);
+    yu_free(&ctx, s);
+END(realloc_grow)
+
+struct remote_free_args {
+    tl_heap *heap;
+    void **blocks;
+    u32 count;
+};
+
+static void *remote_free_thread(void *data) {
+    struct remote_free_args *args = data;
+    tl_allocator mine;
+    tl_alloc_ctx_init(&mine, args->heap);
+    // Mix in some local traffic so both contexts hit the heap at once
+    void *scratch[64];
+    for (u32 i = 0; i < elemcount(scratch); i++)
+        scratch[i] = yu_xalloc(&mine, 1, 4000);
+    for (u32 i = 0; i < args->count; i++)
+        yu_free(&mine, args->blocks[i]);
+    for (u32 i = 0; i < elemcount(scratch); i++)
+        yu_free(&mine, scratch[i]);
+    yu_alloc_ctx_free(&mine);
+    return NULL;
+}
+
+TEST(remote_free)
+    void *blocks[256];
+    for (u32 i = 0; i < elemcount(blocks); i++)
+        blocks[i] = yu_xalloc(&ctx, 1, 48);
+
+    struct remote_free_args args = { &heap, blocks, elemcount(blocks) };
+    pthread_t th;
+    pthread_create(&th, NULL, remote_free_thread, &args);
+    pthread_join(th, NULL);
+
+    PT_ASSERT(ctx.pool->remote != NULL);
+    PT_ASSERT(ctx.pool->magazines[2] == NULL);
+
+    // The magazine for this class is empty, so the next allocation drains
+    void *again = yu_xalloc(&ctx, 1, 64);
+    PT_ASSERT(ctx.pool->remote == NULL);
+    bool found = false;
+    for (u32 i = 0; i < elemcount(blocks); i++)
+        found |= blocks[i] == again;
+    PT_ASSERT(found);
+    yu_free(&ctx, again);
+END(remote_free)
+
+TEST(page_release)
+    void *ptr;
+    yu_err err = yu_reserve(&ctx, &ptr, 65536, 1);
+    assert(err == YU_OK);
+    PT_ASSERT(sysmem_pgtbl_get(&ctx.pgs, ptr, NULL));
+    err = yu_commit(&ctx, ptr, 65536, 1);
+    assert(err == YU_OK);
+    PT_ASSERT_EQ(yu_allocated_size(&ctx, ptr), 65536u);
+    PT_ASSERT(yu_release(&ctx, ptr) == YU_OK);
+    PT_ASSERT(!sysmem_pgtbl_get(&ctx.pgs, ptr, NULL));
+    PT_ASSERT(yu_release(&ctx, ptr) != YU_OK);
+END(page_release)
+
+TEST(context_free)
+    void *blocks[1000];
+    for (u32 i = 0; i < elemcount(blocks); i++)
+        blocks[i] = yu_xalloc(&ctx, 1, 1000);
+    void *big = yu_xalloc(&ctx, 1, 1000000);
+    for (u32 i = 0; i < elemcount(blocks); i++)
+        yu_free(&ctx, blocks[i]);
+    yu_free(&ctx, big);
+    // Freed blocks stay in the magazines and the slabs stay with the context
+    PT_ASSERT(backing.allocd.size > 0);
+    yu_alloc_ctx_free(&ctx);
+    PT_ASSERT_EQ(backing.allocd.size, 0u);
+    PT_ASSERT(heap.orphans == NULL);
+
+    // Re-init so that TEARDOWN can free it
+    tl_alloc_ctx_init(&ctx, &heap);
+END(context_free)
+
+TEST(orphan_adopt)
+    tl_allocator dead;
+    tl_alloc_ctx_init(&dead, &heap);
+    void *small = yu_xalloc(&dead, 1, 48), *big = yu_xalloc(&dead, 1, 100000);
+    struct tl_pool *pool = dead.pool;
+    yu_alloc_ctx_free(&dead);
+    PT_ASSERT(heap.orphans == pool);
+    PT_ASSERT(tl_block_owner(small) == NULL);
+
+    // Freeing into an orphan is still a remote free
+    yu_free(&ctx, small);
+    PT_ASSERT(pool->remote != NULL);
+
+    tl_allocator heir;
+    tl_alloc_ctx_init(&heir, &heap);
+    PT_ASSERT(heir.pool == pool);
+    PT_ASSERT(heap.orphans == NULL);
+    PT_ASSERT(tl_block_owner(big) == &heir);
+    PT_ASSERT(yu_xalloc(&heir, 1, 64) == small);
+    yu_free(&heir, small);
+    yu_free(&heir, big);
+    PT_ASSERT_EQ(pool->live, 0u);
+    yu_alloc_ctx_free(&heir);
+    PT_ASSERT(heap.orphans == NULL);
+END(orphan_adopt)
+
+SUITE(tl_alloc, LIST_TL_ALLOC_TESTS)
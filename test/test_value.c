@@ -23,7 +23,11 @@
     X(gray_bit, "Boxed values should maintain a gray bit") \
     X(hash, "Value hashes should be well-distributed") \
     X(hash_tuple, "Hashes from equal tuples should be equal") \
-    X(equal, "Only equal values should be equal")
+    X(hash_tuple_cyclic, "Tuples that contain themselves should hash and compare without recursing forever") \
+    X(hash_bignum, "Equal bignums should hash equal regardless of sign handling or precision") \
+    X(equal, "Only equal values should be equal") \
+    X(equal_structural, "Equality should compare contents, not hashes") \
+    X(short_str, "Short ASCII strings should be immediates that act like boxed strings")
 
 TEST(double)
     value_t x = value_from_double(42.101010);
@@ -223,8 +227,111 @@ TEST(hash_tuple)
     s->v.tup[1] = value_from_int(322);
     PT_ASSERT_EQ(value_hash1(value_from_ptr(&t)), value_hash1(value_from_ptr(&s)));
     PT_ASSERT_EQ(value_hash2(value_from_ptr(&t)), value_hash2(value_from_ptr(&s)));
+    // Cached in the first chunk
+    PT_ASSERT(t->tuple_cache.flags != 0);
+    // ...as two separately accumulated words
+    PT_ASSERT(t->tuple_cache.h1 != t->tuple_cache.h2);
+    // ...without making every value bigger
+    PT_ASSERT_EQ(sizeof(struct boxed_value), 40u);
+
+    // Element order matters
+    s->v.tup[0] = value_from_int(322);
+    s->v.tup[1] = value_from_int(42);
+    boxed_value_set_type(s, VALUE_TUPLE);
+    PT_ASSERT(value_hash1(value_from_ptr(&t)) != value_hash1(value_from_ptr(&s)));
+    PT_ASSERT(value_hash2(value_from_ptr(&t)) != value_hash2(value_from_ptr(&s)));
 END(hash_tuple)
 
+TEST(hash_tuple_cyclic)
+    struct arena_handle *a = arena_new((yu_allocator *)&mctx);
+    struct boxed_value *t[6];
+    for (u32 i = 0; i < 6; i++) {
+        t[i] = arena_alloc_val(a);
+        boxed_value_set_type(t[i], VALUE_TUPLE);
+        t[i]->v.tup[0] = value_from_int(i % 2 ? 7 : 42);
+        t[i]->v.tup[2] = value_empty();
+    }
+    value_t x[6];
+    for (u32 i = 0; i < 6; i++)
+        x[i] = value_from_ptr(&t[i]);
+
+    // (42, <self>) and (7, <self>) twice over
+    t[0]->v.tup[1] = x[0];
+    t[2]->v.tup[1] = x[2];
+    t[1]->v.tup[1] = x[1];
+    PT_ASSERT_EQ(value_hash1(x[0]), value_hash1(x[2]));
+    PT_ASSERT_EQ(value_hash2(x[0]), value_hash2(x[2]));
+    PT_ASSERT(value_eq(x[0], x[2]));
+    PT_ASSERT(!value_eq(x[0], x[1]));
+
+    // a = (42, b), b = (7, a), and a copy of the pair
+    t[0]->v.tup[1] = x[1];
+    t[1]->v.tup[1] = x[0];
+    t[2]->v.tup[1] = x[3];
+    t[3]->v.tup[1] = x[2];
+    for (u32 i = 0; i < 4; i++)
+        boxed_value_set_type(t[i], VALUE_TUPLE);
+    PT_ASSERT_EQ(value_hash1(x[0]), value_hash1(x[2]));
+    PT_ASSERT_EQ(value_hash2(x[1]), value_hash2(x[3]));
+    PT_ASSERT(value_eq(x[0], x[2]));
+    PT_ASSERT(value_eq(x[1], x[3]));
+    PT_ASSERT(!value_eq(x[0], x[3]));
+
+    // An acyclic tuple with the same shape up to the point the cycle closes
+    t[4]->v.tup[1] = x[5];
+    t[5]->v.tup[1] = value_from_int(0);
+    PT_ASSERT(!value_eq(x[0], x[4]));
+    PT_ASSERT(!value_eq(x[4], x[0]));
+    PT_ASSERT(value_hash1(x[0]) != value_hash1(x[4]));
+END(hash_tuple_cyclic)
+
+TEST(hash_bignum)
+    struct arena_handle *a = arena_new((yu_allocator *)&mctx);
+    struct boxed_value *b[4];
+    mpz_t z[3];
+    for (u32 i = 0; i < 4; i++)
+        b[i] = arena_alloc_val(a);
+
+    mpz_init_set_str(z[0], "-98765432109876543210987654321", 10);
+    mpz_init_set_str(z[1], "-98765432109876543210987654321", 10);
+    mpz_init_set_str(z[2], "98765432109876543210987654321", 10);
+    for (u32 i = 0; i < 3; i++) {
+        boxed_value_set_type(b[i], VALUE_INT);
+        b[i]->v.i = &z[i];
+    }
+    value_t x = value_from_ptr(&b[0]), y = value_from_ptr(&b[1]), w = value_from_ptr(&b[2]);
+    PT_ASSERT_EQ(value_hash1(x), value_hash1(y));
+    PT_ASSERT_EQ(value_hash2(x), value_hash2(y));
+    PT_ASSERT(value_hash1(x) != value_hash1(w));
+    PT_ASSERT(value_hash2(x) != value_hash2(w));
+    // Cached on first use
+    PT_ASSERT(b[0]->v.big.hash[0] != 0 || b[0]->v.big.hash[1] != 0);
+    PT_ASSERT_EQ(value_hash1(x), value_hash1(x));
+
+    // Too big for a double, at two different precisions
+    mpfr_t r[2];
+    mpfr_init2(r[0], 64);
+    mpfr_init2(r[1], 300);
+    mpfr_set_str(r[0], "1e400", 10, MPFR_RNDN);
+    mpfr_set(r[1], r[0], MPFR_RNDN);
+    for (u32 i = 0; i < 2; i++) {
+        boxed_value_set_type(b[i], VALUE_REAL);
+        b[i]->v.r = &r[i];
+    }
+    PT_ASSERT(value_eq(x, y));
+    PT_ASSERT_EQ(value_hash1(x), value_hash1(y));
+    PT_ASSERT_EQ(value_hash2(x), value_hash2(y));
+    mpfr_mul_2ui(r[1], r[1], 1, MPFR_RNDN);
+    boxed_value_set_type(b[1], VALUE_REAL);
+    PT_ASSERT(!value_eq(x, y));
+    PT_ASSERT(value_hash1(x) != value_hash1(y));
+
+    for (u32 i = 0; i < 3; i++)
+        mpz_clear(z[i]);
+    mpfr_clear(r[0]);
+    mpfr_clear(r[1]);
+END(hash_bignum)
+
 TEST(equal)
     struct arena_handle *a = arena_new((yu_allocator *)&mctx);
     yu_str_ctx sctx;
@@ -261,5 +368,133 @@ TEST(equal)
     PT_ASSERT(value_eq(y, z));
 END(equal)
 
+TEST(equal_structural)
+    struct arena_handle *a = arena_new((yu_allocator *)&mctx);
+    yu_str_ctx sctx1, sctx2;
+    yu_str_ctx_init(&sctx1, (yu_allocator *)&mctx);
+    yu_str_ctx_init(&sctx2, (yu_allocator *)&mctx);
+
+    // Bignums too big to unbox
+    mpz_t i, j;
+    mpz_init_set_str(i, "123456789012345678901234567890", 10);
+    mpz_init_set_str(j, "123456789012345678901234567890", 10);
+    struct boxed_value *bi = arena_alloc_val(a), *bj = arena_alloc_val(a);
+    boxed_value_set_type(bi, VALUE_INT);
+    boxed_value_set_type(bj, VALUE_INT);
+    bi->v.i = &i;
+    bj->v.i = &j;
+    PT_ASSERT(value_eq(value_from_ptr(&bi), value_from_ptr(&bj)));
+    mpz_add_ui(j, j, 1);
+    PT_ASSERT(!value_eq(value_from_ptr(&bi), value_from_ptr(&bj)));
+
+    // The same text from two string contexts isn't the same buffer
+    yu_str s1, s2;
+    yu_err err = yu_str_new_z(&sctx1, "golden wind", &s1);
+    assert(err == YU_OK);
+    err = yu_str_new_z(&sctx2, "golden wind", &s2);
+    assert(err == YU_OK);
+    PT_ASSERT(s1 != s2);
+    struct boxed_value *c1 = arena_alloc_val(a), *c2 = arena_alloc_val(a);
+    boxed_value_set_type(c1, VALUE_STR);
+    boxed_value_set_type(c2, VALUE_STR);
+    c1->v.s = s1;
+    c2->v.s = s2;
+    value_t x = value_from_ptr(&c1), y = value_from_ptr(&c2);
+    PT_ASSERT(value_eq(x, y));
+    PT_ASSERT_EQ(value_hash1(x), value_hash1(y));
+
+    // Tags count, but only for values that stay boxed
+    c1->tag = s1;
+    PT_ASSERT(!value_eq(x, y));
+    c2->tag = s2;
+    PT_ASSERT(value_eq(x, y));
+    bj->tag = s1;
+    mpz_set_ui(j, 42);
+    PT_ASSERT(value_eq(value_from_int(42), value_from_ptr(&bj)));
+    PT_ASSERT_EQ(value_hash1(value_from_int(42)), value_hash1(value_from_ptr(&bj)));
+
+    // Tuples compare element by element, in order
+    struct boxed_value *t = arena_alloc_val(a), *u = arena_alloc_val(a),
+                       *t2 = arena_alloc_val(a), *u2 = arena_alloc_val(a);
+    boxed_value_set_type(t, VALUE_TUPLE);
+    boxed_value_set_type(u, VALUE_TUPLE);
+    boxed_value_set_type(t2, VALUE_TUPLE);
+    boxed_value_set_type(u2, VALUE_TUPLE);
+    t->v.tup[0] = u->v.tup[0] = value_from_int(1);
+    t->v.tup[1] = x;
+    u->v.tup[1] = y;
+    t->v.tup[2] = value_from_ptr(&t2);
+    u->v.tup[2] = value_from_ptr(&u2);
+    t2->v.tup[0] = u2->v.tup[0] = value_from_double(2.5);
+    t2->v.tup[1] = u2->v.tup[1] = value_true();
+    t2->v.tup[2] = u2->v.tup[2] = value_empty();
+    PT_ASSERT(value_eq(value_from_ptr(&t), value_from_ptr(&u)));
+    u2->v.tup[0] = value_true();
+    u2->v.tup[1] = value_from_double(2.5);
+    PT_ASSERT(!value_eq(value_from_ptr(&t), value_from_ptr(&u)));
+    u2->v.tup[2] = value_from_ptr(&t2);
+    PT_ASSERT(!value_eq(value_from_ptr(&t), value_from_ptr(&u)));
+
+    // Tables are only equal to themselves
+    struct boxed_value *tb1 = arena_alloc_val(a), *tb2 = arena_alloc_val(a);
+    boxed_value_set_type(tb1, VALUE_TABLE);
+    boxed_value_set_type(tb2, VALUE_TABLE);
+    PT_ASSERT(value_eq(value_from_ptr(&tb1), value_from_ptr(&tb1)));
+    PT_ASSERT(!value_eq(value_from_ptr(&tb1), value_from_ptr(&tb2)));
+
+    mpz_clear(i);
+    mpz_clear(j);
+    yu_str_ctx_free(&sctx1);
+    yu_str_ctx_free(&sctx2);
+END(equal_structural)
+
+TEST(short_str)
+    struct arena_handle *a = arena_new((yu_allocator *)&mctx);
+    yu_str_ctx sctx;
+    yu_str_ctx_init(&sctx, (yu_allocator *)&mctx);
+    static const char *packable[] = {"", "x", "foo", "gintok", "counter", "function", "iteration", "identifier", "the_heart"};
+    static const char *unpackable[] = {"gintoki sakata", "\xc3\xa9t\xc3\xa9", "zzzzzzzzz", "hello there", "a\0b"};
+    static const u64 unpackable_len[] = {14, 5, 9, 11, 3};
+    u8 buf[VALUE_SHORT_STR_MAX];
+    value_t v;
+    u64 len;
+
+    for (u32 i = 0; i < elemcount(packable); i++) {
+        u64 n = strlen(packable[i]);
+        PT_ASSERT(value_short_str_pack((const u8 *)packable[i], n, &v));
+        PT_ASSERT(value_is_short_str(v));
+        PT_ASSERT(!value_is_ptr(v));
+        PT_ASSERT_EQ(value_what(v), VALUE_STR);
+        const u8 *bytes = value_str_bytes(v, buf, &len);
+        PT_ASSERT_EQ(len, n);
+        PT_ASSERT_EQ(memcmp(bytes, packable[i], n), 0);
+
+        // A boxed string with the same contents is equal and hashes the same
+        yu_str s;
+        yu_err err = yu_str_new(&sctx, (const u8 *)packable[i], n, &s);
+        assert(err == YU_OK);
+        struct boxed_value *b = arena_alloc_val(a);
+        boxed_value_set_type(b, VALUE_STR);
+        b->v.s = s;
+        b->tag = NULL;
+        value_t boxed = value_from_ptr(&b);
+        PT_ASSERT(value_eq(v, boxed));
+        PT_ASSERT(value_eq(boxed, v));
+        PT_ASSERT_EQ(value_hash1(v), value_hash1(boxed));
+        PT_ASSERT_EQ(value_hash2(v), value_hash2(boxed));
+        PT_ASSERT(value_eq(value_unbox(b), v));
+    }
+    for (u32 i = 0; i < elemcount(unpackable); i++)
+        PT_ASSERT(!value_short_str_pack((const u8 *)unpackable[i], unpackable_len[i], &v));
+
+    value_t w;
+    PT_ASSERT(value_short_str_pack((const u8 *)"foo", 3, &v));
+    PT_ASSERT(value_short_str_pack((const u8 *)"fop", 3, &w));
+    PT_ASSERT(!value_eq(v, w));
+    PT_ASSERT(value_hash1(v) != value_hash1(w));
+    PT_ASSERT(!value_eq(v, value_from_int(0)));
+
+    yu_str_ctx_free(&sctx);
+END(short_str)
 
 SUITE(value, LIST_VALUE_TESTS)